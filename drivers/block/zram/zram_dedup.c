@@ -0,0 +1,219 @@
+/*
+ * Content based deduplication of zram pages
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/rbtree.h>
+
+#include "zram_drv.h"
+#include "zram_dedup.h"
+
+/* One hash bucket per 1024 pages of disksize, at least 1024 buckets */
+#define ZRAM_HASH_SHIFT		10
+#define ZRAM_HASH_SIZE_MIN	(1 << 10)
+#define ZRAM_HASH_SIZE_MAX	(1UL << 31)
+
+u32 zram_dedup_checksum(unsigned char *mem)
+{
+	return jhash2((const u32 *)mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+static struct zram_hash *zram_dedup_bucket(struct zram_meta *meta,
+					u32 checksum)
+{
+	return &meta->hash[checksum % meta->hash_size];
+}
+
+static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+			unsigned char *mem, unsigned char *buf)
+{
+	struct zram_meta *meta = zram->meta;
+	bool match = false;
+	unsigned char *cmem;
+
+	cmem = zs_map_object(meta->mem_pool, entry->handle, ZS_MM_RO);
+	if (entry->len == PAGE_SIZE)
+		match = !memcmp(mem, cmem, PAGE_SIZE);
+	else if (!zcomp_decompress(zram->comp, cmem, entry->len, buf))
+		match = !memcmp(mem, buf, PAGE_SIZE);
+	zs_unmap_object(meta->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look for a stored object whose content is identical to @mem and take
+ * a reference on it. @buf is a scratch buffer of at least PAGE_SIZE used
+ * to decompress candidates whose checksum collides with @checksum.
+ *
+ * Called in atomic context; the bucket lock is held while candidates are
+ * compared, which is cheap as the table has many buckets.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, unsigned char *mem,
+				u32 checksum, unsigned char *buf)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_hash *hash = zram_dedup_bucket(meta, checksum);
+	struct zram_entry *entry, *found = NULL;
+	struct rb_node *rb_node;
+
+	spin_lock(&hash->lock);
+	rb_node = hash->rb_root.rb_node;
+	while (rb_node) {
+		entry = rb_entry(rb_node, struct zram_entry, rb_node);
+		if (checksum == entry->checksum)
+			break;
+		if (checksum < entry->checksum)
+			rb_node = rb_node->rb_left;
+		else
+			rb_node = rb_node->rb_right;
+	}
+
+	if (!rb_node)
+		goto out;
+
+	/* rewind to the left-most entry with the same checksum */
+	while ((rb_node = rb_prev(&entry->rb_node))) {
+		struct zram_entry *tmp;
+
+		tmp = rb_entry(rb_node, struct zram_entry, rb_node);
+		if (tmp->checksum != checksum)
+			break;
+		entry = tmp;
+	}
+
+	for (;;) {
+		if (zram_dedup_match(zram, entry, mem, buf)) {
+			entry->refcount++;
+			atomic64_add(entry->len, &zram->stats.dup_data_size);
+			found = entry;
+			break;
+		}
+
+		rb_node = rb_next(&entry->rb_node);
+		if (!rb_node)
+			break;
+		entry = rb_entry(rb_node, struct zram_entry, rb_node);
+		if (entry->checksum != checksum)
+			break;
+	}
+out:
+	spin_unlock(&hash->lock);
+	return found;
+}
+
+/*
+ * Wrap a freshly stored zsmalloc object in a shareable entry and publish
+ * it in the hash table. The returned entry holds one reference for the
+ * caller's slot.
+ */
+struct zram_entry *zram_dedup_new(struct zram *zram, unsigned long handle,
+				unsigned int len, u32 checksum)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_hash *hash = zram_dedup_bucket(meta, checksum);
+	struct zram_entry *entry, *tmp;
+	struct rb_node **rb_node, *parent = NULL;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+
+	spin_lock(&hash->lock);
+	rb_node = &hash->rb_root.rb_node;
+	while (*rb_node) {
+		parent = *rb_node;
+		tmp = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum < tmp->checksum)
+			rb_node = &parent->rb_left;
+		else
+			rb_node = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, rb_node);
+	rb_insert_color(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	return entry;
+}
+
+/* Drop a slot's reference, freeing the object with the last one */
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_hash *hash = zram_dedup_bucket(meta, entry->checksum);
+	unsigned long refcount;
+
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		rb_erase(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	if (refcount) {
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+		return;
+	}
+
+	zs_free(meta->mem_pool, entry->handle);
+	kfree(entry);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+}
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages)
+{
+	size_t i;
+
+	meta->hash_size = clamp_t(size_t, num_pages >> ZRAM_HASH_SHIFT,
+				ZRAM_HASH_SIZE_MIN, ZRAM_HASH_SIZE_MAX);
+	meta->hash = vzalloc(meta->hash_size * sizeof(struct zram_hash));
+	if (!meta->hash) {
+		pr_err("Error allocating zram entry hash\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < meta->hash_size; i++) {
+		spin_lock_init(&meta->hash[i].lock);
+		meta->hash[i].rb_root = RB_ROOT;
+	}
+
+	return 0;
+}
+
+/*
+ * Release all entries left in the table. Their objects go away with the
+ * pool, so only the entries themselves are freed here.
+ */
+void zram_dedup_fini(struct zram_meta *meta)
+{
+	struct zram_entry *entry, *n;
+	size_t i;
+
+	if (!meta->hash)
+		return;
+
+	for (i = 0; i < meta->hash_size; i++)
+		rbtree_postorder_for_each_entry_safe(entry, n,
+				&meta->hash[i].rb_root, rb_node)
+			kfree(entry);
+
+	vfree(meta->hash);
+	meta->hash = NULL;
+	meta->hash_size = 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * Content based deduplication of zram pages
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+struct zram;
+struct zram_meta;
+struct zram_entry;
+
+#ifdef CONFIG_ZRAM_DEDUP
+static inline bool zram_dedup_enabled(struct zram_meta *meta)
+{
+	return meta->hash;
+}
+
+u32 zram_dedup_checksum(unsigned char *mem);
+struct zram_entry *zram_dedup_find(struct zram *zram, unsigned char *mem,
+				u32 checksum, unsigned char *buf);
+struct zram_entry *zram_dedup_new(struct zram *zram, unsigned long handle,
+				unsigned int len, u32 checksum);
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages);
+void zram_dedup_fini(struct zram_meta *meta);
+#else
+static inline bool zram_dedup_enabled(struct zram_meta *meta)
+{
+	return false;
+}
+
+static inline u32 zram_dedup_checksum(unsigned char *mem) { return 0; }
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+		unsigned char *mem, u32 checksum, unsigned char *buf)
+{
+	return NULL;
+}
+static inline struct zram_entry *zram_dedup_new(struct zram *zram,
+		unsigned long handle, unsigned int len, u32 checksum)
+{
+	return NULL;
+}
+static inline void zram_dedup_put(struct zram *zram,
+		struct zram_entry *entry) {}
+
+static inline int zram_dedup_init(struct zram_meta *meta,
+		size_t num_pages)
+{
+	return 0;
+}
+static inline void zram_dedup_fini(struct zram_meta *meta) {}
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
@@ -34,13 +34,22 @@
 #include <linux/err.h>
 #include <linux/show_mem_notifier.h>
 #include <linux/ratelimit.h>
+#include <linux/file.h>
 
 #include "zram_drv.h"
+#include "zram_dedup.h"
 
 /* Globals */
 static int zram_major;
 static struct zram *zram_devices;
+/* decompresses batched reads in parallel, see zram_read_bio_async() */
+static struct workqueue_struct *zram_read_wq;
 static const char *default_compressor = "lz4";
+/*
+ * Pages that compress to this size or more would take a zspage of
+ * their own anyway, so they are stored uncompressed.
+ */
+static size_t huge_class_size;
 
 /*
  * We don't need to see memory allocation errors more than once every 1
@@ -194,17 +203,14 @@ static ssize_t mem_used_total_show(struct device *dev,
 	return scnprintf(buf, PAGE_SIZE, "%llu\n", val << PAGE_SHIFT);
 }
 
+/*
+ * Compression streams are per-CPU now, so there is always one stream
+ * per online CPU. The attribute is kept for compatibility only.
+ */
 static ssize_t max_comp_streams_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
-	int val;
-	struct zram *zram = dev_to_zram(dev);
-
-	down_read(&zram->init_lock);
-	val = zram->max_comp_streams;
-	up_read(&zram->init_lock);
-
-	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", num_online_cpus());
 }
 
 static ssize_t mem_limit_show(struct device *dev,
@@ -279,30 +285,8 @@ static ssize_t mem_used_max_store(struct device *dev,
 static ssize_t max_comp_streams_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
-	int num;
-	struct zram *zram = dev_to_zram(dev);
-	int ret;
-
-	ret = kstrtoint(buf, 0, &num);
-	if (ret < 0)
-		return ret;
-	if (num < 1)
-		return -EINVAL;
-
-	down_write(&zram->init_lock);
-	if (init_done(zram)) {
-		if (!zcomp_set_max_streams(zram->comp, num)) {
-			pr_info("Cannot change max compression streams\n");
-			ret = -EINVAL;
-			goto out;
-		}
-	}
-
-	zram->max_comp_streams = num;
-	ret = len;
-out:
-	up_write(&zram->init_lock);
-	return ret;
+	deprecated_attr_warn("max_comp_streams");
+	return len;
 }
 
 static ssize_t comp_algorithm_show(struct device *dev,
@@ -365,11 +349,281 @@ static void zram_set_obj_size(struct zram_meta *meta,
 	meta->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static inline int zram_get_priority(struct zram_meta *meta, u32 index)
+{
+	if (zram_test_flag(meta, index, ZRAM_RECOMP))
+		return ZRAM_SECONDARY_COMP;
+	return ZRAM_PRIMARY_COMP;
+}
+
+static inline struct zcomp *zram_slot_comp(struct zram *zram, u32 index)
+{
+	if (zram_test_flag(zram->meta, index, ZRAM_RECOMP))
+		return zram->recomp;
+	return zram->comp;
+}
+
+static inline void zram_algo_stat_add(struct zram *zram, int prio,
+					size_t size)
+{
+	atomic64_inc(&zram->stats.algo_pages[prio]);
+	atomic64_add(size, &zram->stats.algo_data_size[prio]);
+}
+
+static inline void zram_algo_stat_sub(struct zram *zram, int prio,
+					size_t size)
+{
+	atomic64_dec(&zram->stats.algo_pages[prio]);
+	atomic64_sub(size, &zram->stats.algo_data_size[prio]);
+}
+#else
+static inline int zram_get_priority(struct zram_meta *meta, u32 index)
+{
+	return ZRAM_PRIMARY_COMP;
+}
+
+static inline struct zcomp *zram_slot_comp(struct zram *zram, u32 index)
+{
+	return zram->comp;
+}
+
+static inline void zram_algo_stat_add(struct zram *zram, int prio,
+					size_t size) {}
+static inline void zram_algo_stat_sub(struct zram *zram, int prio,
+					size_t size) {}
+#endif
+
 static inline int is_partial_io(struct bio_vec *bvec)
 {
 	return bvec->bv_len != PAGE_SIZE;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Max number of pages written back to the backing device with
+ * a single writeback batch.
+ */
+#define ZRAM_WB_BATCH_PAGES	32
+
+struct zram_wb_ctl {
+	atomic_t pending;
+	int error;
+	struct completion done;
+};
+
+static inline bool zram_wb_enabled(struct zram *zram)
+{
+	return zram->backing_dev;
+}
+
+static void reset_bdev(struct zram *zram)
+{
+	struct block_device *bdev;
+
+	if (!zram_wb_enabled(zram))
+		return;
+
+	bdev = zram->bdev;
+	/* hope filp_close flush all of IO */
+	filp_close(zram->backing_dev, NULL);
+	set_blocksize(bdev, zram->old_block_size);
+	blkdev_put(bdev, FMODE_READ|FMODE_WRITE|FMODE_EXCL);
+	zram->backing_dev = NULL;
+	zram->old_block_size = 0;
+	zram->bdev = NULL;
+
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct file *file;
+	char *p;
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	file = zram->backing_dev;
+	if (!file) {
+		memcpy(buf, "none\n", 5);
+		up_read(&zram->init_lock);
+		return 5;
+	}
+
+	p = d_path(&file->f_path, buf, PAGE_SIZE - 1);
+	if (IS_ERR(p)) {
+		ret = PTR_ERR(p);
+		goto out;
+	}
+
+	ret = strlen(p);
+	memmove(buf, p, ret);
+	buf[ret++] = '\n';
+out:
+	up_read(&zram->init_lock);
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char *file_name;
+	size_t sz;
+	struct file *backing_dev = NULL;
+	struct inode *inode;
+	unsigned int old_block_size = 0;
+	unsigned long nr_pages, *bitmap = NULL;
+	struct block_device *bdev = NULL;
+	int err;
+	struct zram *zram = dev_to_zram(dev);
+
+	file_name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!file_name)
+		return -ENOMEM;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		pr_info("Can't setup backing device for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	strlcpy(file_name, buf, PATH_MAX);
+	/* ignore trailing newline */
+	sz = strlen(file_name);
+	if (sz > 0 && file_name[sz - 1] == '\n')
+		file_name[sz - 1] = 0x00;
+
+	backing_dev = filp_open(file_name, O_RDWR|O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev)) {
+		err = PTR_ERR(backing_dev);
+		backing_dev = NULL;
+		goto out;
+	}
+
+	inode = backing_dev->f_mapping->host;
+
+	/* Support only block device in this moment */
+	if (!S_ISBLK(inode->i_mode)) {
+		err = -ENOTBLK;
+		goto out;
+	}
+
+	bdev = bdgrab(I_BDEV(inode));
+	err = blkdev_get(bdev, FMODE_READ|FMODE_WRITE|FMODE_EXCL, zram);
+	if (err < 0) {
+		/* blkdev_get() drops the bdev reference on failure */
+		bdev = NULL;
+		goto out;
+	}
+
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	old_block_size = block_size(bdev);
+	err = set_blocksize(bdev, PAGE_SIZE);
+	if (err)
+		goto out;
+
+	reset_bdev(zram);
+
+	zram->old_block_size = old_block_size;
+	zram->bdev = bdev;
+	zram->backing_dev = backing_dev;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	up_write(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", file_name);
+	kfree(file_name);
+
+	return len;
+out:
+	vfree(bitmap);
+
+	if (bdev)
+		blkdev_put(bdev, FMODE_READ|FMODE_WRITE|FMODE_EXCL);
+
+	if (backing_dev)
+		filp_close(backing_dev, NULL);
+
+	up_write(&zram->init_lock);
+
+	kfree(file_name);
+
+	return err;
+}
+
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	/* skip 0 bit so that a valid block index is never a zero handle */
+	unsigned long blk_idx = 1;
+retry:
+	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
+	if (blk_idx >= zram->nr_pages)
+		return 0;
+
+	if (test_and_set_bit(blk_idx, zram->bitmap))
+		goto retry;
+
+	atomic64_inc(&zram->stats.bd_count);
+	return blk_idx;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+	int was_set;
+
+	was_set = test_and_clear_bit(blk_idx, zram->bitmap);
+	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
+}
+
+/* synchronously read a whole page stored at @blk_idx on the backing device */
+static int read_from_bdev(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	struct bio *bio;
+	int ret;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
+	bio->bi_bdev = zram->bdev;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	ret = submit_bio_wait(READ, bio);
+	bio_put(bio);
+	if (!ret)
+		atomic64_inc(&zram->stats.bd_reads);
+
+	return ret;
+}
+#else
+static inline bool zram_wb_enabled(struct zram *zram) { return false; }
+static inline void reset_bdev(struct zram *zram) {}
+static inline void free_block_bdev(struct zram *zram,
+			unsigned long blk_idx) {}
+static inline int read_from_bdev(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	return -EIO;
+}
+#endif
+
 /*
  * Check if request is within bounds and aligned on zram logical blocks.
  */
@@ -403,12 +657,19 @@ static void zram_meta_free(struct zram_meta *meta, u64 disksize)
 	for (index = 0; index < num_pages; index++) {
 		unsigned long handle = meta->table[index].handle;
 
-		if (!handle)
+		/*
+		 * blocks on the backing device go away with reset_bdev()
+		 * and shared entries with zram_dedup_fini()
+		 */
+		if (!handle || zram_test_flag(meta, index, ZRAM_SAME) ||
+				zram_test_flag(meta, index, ZRAM_WB) ||
+				zram_test_flag(meta, index, ZRAM_DEDUP))
 			continue;
 
 		zs_free(meta->mem_pool, handle);
 	}
 
+	zram_dedup_fini(meta);
 	zs_destroy_pool(meta->mem_pool);
 	vfree(meta->table);
 	kfree(meta);
@@ -418,7 +679,7 @@ static struct zram_meta *zram_meta_alloc(int device_id, u64 disksize)
 {
 	size_t num_pages;
 	char pool_name[8];
-	struct zram_meta *meta = kmalloc(sizeof(*meta), GFP_KERNEL);
+	struct zram_meta *meta = kzalloc(sizeof(*meta), GFP_KERNEL);
 
 	if (!meta)
 		return NULL;
@@ -437,6 +698,9 @@ static struct zram_meta *zram_meta_alloc(int device_id, u64 disksize)
 		goto out_error;
 	}
 
+	if (!huge_class_size)
+		huge_class_size = zs_huge_class_size(meta->mem_pool);
+
 	return meta;
 
 out_error:
@@ -454,7 +718,9 @@ static inline bool zram_meta_get(struct zram *zram)
 
 static inline void zram_meta_put(struct zram *zram)
 {
-	atomic_dec(&zram->refcount);
+	/* asynchronous reads may drop the last reference */
+	if (atomic_dec_and_test(&zram->refcount))
+		wake_up(&zram->io_done);
 }
 
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
@@ -464,31 +730,56 @@ static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 	*offset = (*offset + bvec->bv_len) % PAGE_SIZE;
 }
 
-static int page_zero_filled(void *ptr)
+/*
+ * Check whether the page consists of one repeated word and return that
+ * word in @element. The last word is tested first so that most pages
+ * which are not same-filled bail out immediately. The scan compares
+ * four words per iteration and ORs the differences together, which
+ * keeps the loop free of per-word branches and lets the compiler use
+ * wide loads.
+ */
+static bool page_same_filled(void *ptr, unsigned long *element)
 {
-	unsigned int pos;
-	unsigned long *page;
+	unsigned long *page = (unsigned long *)ptr;
+	unsigned long val = page[0];
+	unsigned int pos, last_pos = PAGE_SIZE / sizeof(*page) - 1;
 
-	page = (unsigned long *)ptr;
+	if (val != page[last_pos])
+		return false;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
-			return 0;
+	for (pos = 0; pos < last_pos; pos += 4) {
+		if ((page[pos] ^ val) | (page[pos + 1] ^ val) |
+				(page[pos + 2] ^ val) | (page[pos + 3] ^ val))
+			return false;
 	}
 
-	return 1;
+	*element = val;
+	return true;
+}
+
+static void zram_fill_page(void *ptr, unsigned long len,
+				unsigned long value)
+{
+	unsigned long *page = (unsigned long *)ptr;
+	unsigned int pos;
+
+	WARN_ON_ONCE(!IS_ALIGNED(len, sizeof(unsigned long)));
+	if (likely(!value)) {
+		memset(ptr, 0, len);
+		return;
+	}
+
+	for (pos = 0; pos < len / sizeof(*page); pos++)
+		page[pos] = value;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page);
-	if (is_partial_io(bvec))
-		memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	else
-		clear_page(user_mem);
+	zram_fill_page(user_mem + bvec->bv_offset, bvec->bv_len, element);
 	kunmap_atomic(user_mem);
 
 	flush_dcache_page(page);
@@ -505,19 +796,49 @@ static void zram_free_page(struct zram *zram, size_t index)
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(meta, index, ZRAM_ZERO)) {
-			zram_clear_flag(meta, index, ZRAM_ZERO);
+	/*
+	 * A slot under writeback or recompression loses ZRAM_PP_SLOT here
+	 * so that post-processing can tell it was freed or overwritten
+	 * meanwhile.
+	 */
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	zram_clear_flag(meta, index, ZRAM_PP_SLOT);
+	zram_clear_flag(meta, index, ZRAM_HUGE);
+
+	if (zram_wb_enabled(zram) && zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_clear_flag(meta, index, ZRAM_WB);
+		free_block_bdev(zram, handle);
+		atomic64_dec(&zram->stats.pages_stored);
+		meta->table[index].handle = 0;
+		return;
+	}
+
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_clear_flag(meta, index, ZRAM_SAME);
+		if (!meta->table[index].element)
 			atomic64_dec(&zram->stats.zero_pages);
-		}
+		atomic64_dec(&zram->stats.same_pages);
+		meta->table[index].element = 0;
 		return;
 	}
 
-	zs_free(meta->mem_pool, handle);
+	if (unlikely(!handle))
+		return;
+
+	zram_algo_stat_sub(zram, zram_get_priority(meta, index),
+			zram_get_obj_size(meta, index));
+	zram_clear_flag(meta, index, ZRAM_RECOMP);
+
+	if (zram_test_flag(meta, index, ZRAM_DEDUP)) {
+		zram_clear_flag(meta, index, ZRAM_DEDUP);
+		zram_dedup_put(zram, (struct zram_entry *)handle);
+	} else {
+		zs_free(meta->mem_pool, handle);
+	}
 
 	atomic64_sub(zram_get_obj_size(meta, index),
 			&zram->stats.compr_data_size);
@@ -539,17 +860,43 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	handle = meta->table[index].handle;
 	size = zram_get_obj_size(meta, index);
 
-	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
+	if (!handle || zram_test_flag(meta, index, ZRAM_SAME)) {
+		/* an unused slot reads as zero filled */
+		unsigned long element = meta->table[index].element;
+
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		memset(mem, 0, PAGE_SIZE);
+		zram_fill_page(mem, PAGE_SIZE, element);
 		return 0;
 	}
 
+	if (zram_wb_enabled(zram) && zram_test_flag(meta, index, ZRAM_WB)) {
+		struct page *page;
+		void *src;
+
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		page = alloc_page(GFP_NOIO);
+		if (!page)
+			return -ENOMEM;
+
+		ret = read_from_bdev(zram, page, handle);
+		if (!ret) {
+			src = kmap_atomic(page);
+			memcpy(mem, src, PAGE_SIZE);
+			kunmap_atomic(src);
+		}
+		__free_page(page);
+		return ret;
+	}
+
+	if (zram_test_flag(meta, index, ZRAM_DEDUP))
+		handle = ((struct zram_entry *)handle)->handle;
+
 	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_RO);
 	if (size == PAGE_SIZE)
 		memcpy(mem, cmem, PAGE_SIZE);
 	else
-		ret = zcomp_decompress(zram->comp, cmem, size, mem);
+		ret = zcomp_decompress(zram_slot_comp(zram, index), cmem,
+					size, mem);
 	zs_unmap_object(meta->mem_pool, handle);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
@@ -567,49 +914,75 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 {
 	int ret;
 	struct page *page;
-	unsigned char *user_mem, *uncmem = NULL;
+	unsigned char *user_mem, *uncmem;
 	struct zram_meta *meta = zram->meta;
 	page = bvec->bv_page;
 
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_clear_flag(meta, index, ZRAM_IDLE);
 	if (unlikely(!meta->table[index].handle) ||
-			zram_test_flag(meta, index, ZRAM_ZERO)) {
+			zram_test_flag(meta, index, ZRAM_SAME)) {
+		unsigned long element = meta->table[index].element;
+
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		handle_zero_page(bvec);
+		handle_same_page(bvec, element);
 		return 0;
 	}
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-	if (is_partial_io(bvec))
-		/* Use  a temporary buffer to decompress the page */
+	if (zram_wb_enabled(zram) && zram_test_flag(meta, index, ZRAM_WB)) {
+		unsigned long blk_idx = meta->table[index].handle;
+
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		if (!is_partial_io(bvec)) {
+			ret = read_from_bdev(zram, page, blk_idx);
+			if (!ret)
+				flush_dcache_page(page);
+			return ret;
+		}
+		/* partial IO goes through the temporary buffer below */
+	} else {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	}
+
+	if (is_partial_io(bvec)) {
+		/*
+		 * Use a temporary buffer to decompress the page. It is
+		 * filled before kmap_atomic() since reading a page back
+		 * from the backing device may sleep.
+		 */
 		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+		if (!uncmem) {
+			pr_info("Unable to allocate temp memory\n");
+			return -ENOMEM;
+		}
 
-	user_mem = kmap_atomic(page);
-	if (!is_partial_io(bvec))
-		uncmem = user_mem;
+		ret = zram_decompress_page(zram, uncmem, index);
+		if (unlikely(ret))
+			goto out_free;
 
-	if (!uncmem) {
-		pr_info("Unable to allocate temp memory\n");
-		ret = -ENOMEM;
-		goto out_cleanup;
+		user_mem = kmap_atomic(page);
+		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
+				bvec->bv_len);
+		kunmap_atomic(user_mem);
+		flush_dcache_page(page);
+out_free:
+		kfree(uncmem);
+		return ret;
 	}
 
-	ret = zram_decompress_page(zram, uncmem, index);
+	/*
+	 * The slot may be written back under us once the table lock is
+	 * dropped, so keep the mapping sleepable for read_from_bdev().
+	 */
+	user_mem = kmap(page);
+	ret = zram_decompress_page(zram, user_mem, index);
+	kunmap(page);
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret))
-		goto out_cleanup;
-
-	if (is_partial_io(bvec))
-		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
-				bvec->bv_len);
+		return ret;
 
 	flush_dcache_page(page);
-	ret = 0;
-out_cleanup:
-	kunmap_atomic(user_mem);
-	if (is_partial_io(bvec))
-		kfree(uncmem);
-	return ret;
+	return 0;
 }
 
 static inline void update_used_max(struct zram *zram,
@@ -639,6 +1012,9 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	struct zcomp_strm *zstrm;
 	bool locked = false;
 	unsigned long alloced_pages;
+	unsigned long element;
+	struct zram_entry *entry = NULL;
+	u32 checksum = 0;
 	static unsigned long zram_rs_time;
 
 	page = bvec->bv_page;
@@ -670,20 +1046,40 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = user_mem;
 	}
 
-	if (page_zero_filled(uncmem)) {
+	if (page_same_filled(uncmem, &element)) {
 		if (user_mem)
 			kunmap_atomic(user_mem);
 		/* Free memory associated with this sector now. */
 		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
 		zram_free_page(zram, index);
-		zram_set_flag(meta, index, ZRAM_ZERO);
+		zram_set_flag(meta, index, ZRAM_SAME);
+		meta->table[index].element = element;
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-		atomic64_inc(&zram->stats.zero_pages);
+		if (!element)
+			atomic64_inc(&zram->stats.zero_pages);
+		atomic64_inc(&zram->stats.same_pages);
 		ret = 0;
 		goto out;
 	}
 
+	if (zram_dedup_enabled(meta)) {
+		checksum = zram_dedup_checksum(uncmem);
+		/* the stream buffer is free until we compress */
+		entry = zram_dedup_find(zram, uncmem, checksum,
+					zstrm->buffer);
+		if (entry) {
+			if (!is_partial_io(bvec)) {
+				kunmap_atomic(user_mem);
+				user_mem = NULL;
+				uncmem = NULL;
+			}
+			clen = entry->len;
+			handle = (unsigned long)entry;
+			goto found_dup;
+		}
+	}
+
 	ret = zcomp_compress(zram->comp, zstrm, uncmem, &clen);
 	if (!is_partial_io(bvec)) {
 		kunmap_atomic(user_mem);
@@ -696,7 +1092,7 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		goto out;
 	}
 	src = zstrm->buffer;
-	if (unlikely(clen > max_zpage_size)) {
+	if (unlikely(clen >= huge_class_size)) {
 		clen = PAGE_SIZE;
 		if (is_partial_io(bvec))
 			src = uncmem;
@@ -736,6 +1132,17 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	locked = false;
 	zs_unmap_object(meta->mem_pool, handle);
 
+	if (zram_dedup_enabled(meta)) {
+		entry = zram_dedup_new(zram, handle, clen, checksum);
+		if (!entry) {
+			zs_free(meta->mem_pool, handle);
+			ret = -ENOMEM;
+			goto out;
+		}
+		handle = (unsigned long)entry;
+	}
+
+found_dup:
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
@@ -745,11 +1152,16 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 
 	meta->table[index].handle = handle;
 	zram_set_obj_size(meta, index, clen);
+	if (entry)
+		zram_set_flag(meta, index, ZRAM_DEDUP);
+	if (clen == PAGE_SIZE)
+		zram_set_flag(meta, index, ZRAM_HUGE);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
 	/* Update stats */
 	atomic64_add(clen, &zram->stats.compr_data_size);
 	atomic64_inc(&zram->stats.pages_stored);
+	zram_algo_stat_add(zram, ZRAM_PRIMARY_COMP, clen);
 out:
 	if (locked)
 		zcomp_strm_release(zram->comp, zstrm);
@@ -820,23 +1232,545 @@ static void zram_bio_discard(struct zram *zram, u32 index,
 	}
 }
 
-static void zram_reset_device(struct zram *zram)
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
 {
-	struct zram_meta *meta;
-	struct zcomp *comp;
-	u64 disksize;
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
 
-	down_write(&zram->init_lock);
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
 
-	zram->limit_pages = 0;
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
 
-	if (!init_done(zram)) {
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (kstrtoint(buf, 10, &val) || (val != 0 && val != 1))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
 		up_write(&zram->init_lock);
-		return;
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
 	}
-
-	meta = zram->meta;
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		/*
+		 * Any access to the slot clears ZRAM_IDLE again, so slots
+		 * still flagged on the next pass were not used meanwhile.
+		 */
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if ((meta->table[index].handle ||
+				zram_test_flag(meta, index, ZRAM_SAME)) &&
+				!zram_test_flag(meta, index, ZRAM_PP_SLOT))
+			zram_set_flag(meta, index, ZRAM_IDLE);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+struct zram_wb_slot {
+	struct page *page;
+	unsigned long index;
+	unsigned long blk_idx;
+};
+
+static void zram_wb_end_io(struct bio *bio, int err)
+{
+	struct zram_wb_ctl *ctl = bio->bi_private;
+
+	if (err)
+		ctl->error = err;
+	bio_put(bio);
+	if (atomic_dec_and_test(&ctl->pending))
+		complete(&ctl->done);
+}
+
+static struct bio *zram_wb_bio_alloc(struct zram *zram,
+			struct zram_wb_ctl *ctl, unsigned long blk_idx,
+			int nr_vecs)
+{
+	struct bio *bio = bio_alloc(GFP_NOIO, nr_vecs);
+
+	bio->bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
+	bio->bi_bdev = zram->bdev;
+	bio->bi_end_io = zram_wb_end_io;
+	bio->bi_private = ctl;
+	atomic_inc(&ctl->pending);
+	return bio;
+}
+
+/*
+ * Write @nr slots to the backing device. Slots with contiguous block
+ * indices share a bio, and the whole batch is plugged so the block
+ * layer can merge what is left. Returns 0 or the first bio error.
+ */
+static int zram_wb_submit_batch(struct zram *zram,
+			struct zram_wb_slot *slots, int nr)
+{
+	struct zram_wb_ctl ctl;
+	struct blk_plug plug;
+	struct bio *bio = NULL;
+	int i;
+
+	atomic_set(&ctl.pending, 1);
+	init_completion(&ctl.done);
+	ctl.error = 0;
+
+	blk_start_plug(&plug);
+	for (i = 0; i < nr; i++) {
+		if (bio && slots[i].blk_idx != slots[i - 1].blk_idx + 1) {
+			submit_bio(WRITE, bio);
+			bio = NULL;
+		}
+
+		if (!bio)
+			bio = zram_wb_bio_alloc(zram, &ctl, slots[i].blk_idx,
+						nr - i);
+
+		if (bio_add_page(bio, slots[i].page, PAGE_SIZE, 0))
+			continue;
+
+		/* queue limits reached, start over with a new bio */
+		if (bio->bi_vcnt) {
+			submit_bio(WRITE, bio);
+			bio = zram_wb_bio_alloc(zram, &ctl, slots[i].blk_idx,
+						nr - i);
+			if (bio_add_page(bio, slots[i].page, PAGE_SIZE, 0))
+				continue;
+		}
+
+		/* not even a single page fits, never submit an empty bio */
+		bio_put(bio);
+		atomic_dec(&ctl.pending);
+		bio = NULL;
+		ctl.error = -EIO;
+	}
+	if (bio)
+		submit_bio(WRITE, bio);
+	blk_finish_plug(&plug);
+
+	if (!atomic_dec_and_test(&ctl.pending))
+		wait_for_completion_io(&ctl.done);
+
+	return ctl.error;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	struct zram_wb_slot *slots;
+	unsigned long nr_pages, index = 0;
+	enum zram_pageflags mode;
+	ssize_t ret = len;
+	int i, nr, err;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = ZRAM_IDLE;
+	else if (sysfs_streq(buf, "huge"))
+		mode = ZRAM_HUGE;
+	else
+		return -EINVAL;
+
+	slots = kcalloc(ZRAM_WB_BATCH_PAGES, sizeof(*slots), GFP_KERNEL);
+	if (!slots)
+		return -ENOMEM;
+
+	for (i = 0; i < ZRAM_WB_BATCH_PAGES; i++) {
+		slots[i].page = alloc_page(GFP_KERNEL);
+		if (!slots[i].page) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (!zram_wb_enabled(zram)) {
+		ret = -ENODEV;
+		goto release_init_lock;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	while (index < nr_pages && ret == len) {
+		/* Gather a batch of eligible slots */
+		for (nr = 0; index < nr_pages && nr < ZRAM_WB_BATCH_PAGES;
+				index++) {
+			unsigned long blk_idx;
+
+			bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+			if (!meta->table[index].handle ||
+				zram_test_flag(meta, index, ZRAM_SAME) ||
+				zram_test_flag(meta, index, ZRAM_WB) ||
+				zram_test_flag(meta, index, ZRAM_PP_SLOT) ||
+				!zram_test_flag(meta, index, mode)) {
+				bit_spin_unlock(ZRAM_ACCESS,
+						&meta->table[index].value);
+				continue;
+			}
+			zram_set_flag(meta, index, ZRAM_PP_SLOT);
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+			blk_idx = alloc_block_bdev(zram);
+			if (blk_idx && !zram_decompress_page(zram,
+					page_address(slots[nr].page), index)) {
+				slots[nr].index = index;
+				slots[nr].blk_idx = blk_idx;
+				nr++;
+				continue;
+			}
+
+			if (blk_idx)
+				free_block_bdev(zram, blk_idx);
+			else
+				ret = -ENOSPC;
+
+			bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+			zram_clear_flag(meta, index, ZRAM_PP_SLOT);
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+			if (ret != len)
+				break;
+		}
+
+		if (!nr)
+			continue;
+
+		err = zram_wb_submit_batch(zram, slots, nr);
+		if (err)
+			ret = err;
+
+		for (i = 0; i < nr; i++) {
+			unsigned long idx = slots[i].index;
+
+			bit_spin_lock(ZRAM_ACCESS, &meta->table[idx].value);
+			/*
+			 * The slot lock was released during writeback, so
+			 * the slot may have been freed, overwritten or (for
+			 * idle writeback) accessed again. All of those clear
+			 * the flags tested here and the block is dropped.
+			 */
+			if (err || !zram_test_flag(meta, idx, ZRAM_PP_SLOT) ||
+				!zram_test_flag(meta, idx, mode)) {
+				zram_clear_flag(meta, idx, ZRAM_PP_SLOT);
+				bit_spin_unlock(ZRAM_ACCESS,
+						&meta->table[idx].value);
+				free_block_bdev(zram, slots[i].blk_idx);
+				continue;
+			}
+
+			zram_free_page(zram, idx);
+			zram_set_flag(meta, idx, ZRAM_WB);
+			meta->table[idx].handle = slots[i].blk_idx;
+			atomic64_inc(&zram->stats.pages_stored);
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[idx].value);
+
+			atomic64_inc(&zram->stats.bd_writes);
+		}
+	}
+
+release_init_lock:
+	up_read(&zram->init_lock);
+out_free:
+	for (i = 0; i < ZRAM_WB_BATCH_PAGES; i++)
+		if (slots[i].page)
+			__free_page(slots[i].page);
+	kfree(slots);
+
+	return ret;
+}
+#endif
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+#define ZRAM_RECOMP_IDLE	(1 << 0)
+#define ZRAM_RECOMP_HUGE	(1 << 1)
+
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_algorithm, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+	strlcpy(zram->recomp_algorithm, buf, sizeof(zram->recomp_algorithm));
+	up_write(&zram->init_lock);
+	return len;
+}
+
+static bool zram_recomp_eligible(struct zram_meta *meta, u32 index, int mode)
+{
+	if (!meta->table[index].handle ||
+		zram_test_flag(meta, index, ZRAM_SAME) ||
+		zram_test_flag(meta, index, ZRAM_WB) ||
+		zram_test_flag(meta, index, ZRAM_PP_SLOT) ||
+		zram_test_flag(meta, index, ZRAM_DEDUP) ||
+		zram_test_flag(meta, index, ZRAM_RECOMP))
+		return false;
+
+	if ((mode & ZRAM_RECOMP_IDLE) &&
+			!zram_test_flag(meta, index, ZRAM_IDLE))
+		return false;
+
+	if ((mode & ZRAM_RECOMP_HUGE) &&
+			!zram_test_flag(meta, index, ZRAM_HUGE))
+		return false;
+
+	return true;
+}
+
+/*
+ * Recompress a single slot with the secondary algorithm. The slot keeps
+ * its current object unless the secondary algorithm saves memory.
+ * @page is a lowmem page used to hold the uncompressed data.
+ */
+static void zram_recompress_slot(struct zram *zram, u32 index,
+				struct page *page, int mode)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm;
+	unsigned long handle;
+	size_t old_size, clen;
+	unsigned char *cmem;
+	int ret;
+
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	if (!zram_recomp_eligible(meta, index, mode)) {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return;
+	}
+	zram_set_flag(meta, index, ZRAM_PP_SLOT);
+	old_size = zram_get_obj_size(meta, index);
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+	if (zram_decompress_page(zram, page_address(page), index))
+		goto out_unmark;
+
+	zstrm = zcomp_strm_find(zram->recomp);
+	ret = zcomp_compress(zram->recomp, zstrm, page_address(page), &clen);
+	/* keep the slot as it is if the secondary algorithm does no better */
+	if (ret || clen >= old_size || clen >= huge_class_size) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		goto out_unmark;
+	}
+
+	handle = zs_malloc(meta->mem_pool, clen);
+	if (!handle) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		goto out_unmark;
+	}
+
+	cmem = zs_map_object(meta->mem_pool, handle, ZS_MM_WO);
+	memcpy(cmem, zstrm->buffer, clen);
+	zs_unmap_object(meta->mem_pool, handle);
+	zcomp_strm_release(zram->recomp, zstrm);
+
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	/* the slot was freed or overwritten while we were working on it */
+	if (!zram_test_flag(meta, index, ZRAM_PP_SLOT)) {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zs_free(meta->mem_pool, handle);
+		return;
+	}
+
+	zram_free_page(zram, index);
+	meta->table[index].handle = handle;
+	zram_set_obj_size(meta, index, clen);
+	zram_set_flag(meta, index, ZRAM_RECOMP);
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+	atomic64_add(clen, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+	zram_algo_stat_add(zram, ZRAM_SECONDARY_COMP, clen);
+	return;
+
+out_unmark:
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_clear_flag(meta, index, ZRAM_PP_SLOT);
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+}
+
+static void zram_recompress_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, recomp_work);
+	unsigned long nr_pages, index;
+	struct page *page;
+	int mode;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp)
+		goto out;
+
+	/* only changed under the write lock, stable for the whole pass */
+	mode = zram->recomp_mode;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		zram_recompress_slot(zram, index, page, mode);
+		cond_resched();
+	}
+out:
+	up_read(&zram->init_lock);
+	__free_page(page);
+}
+
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int mode;
+	ssize_t ret = len;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = ZRAM_RECOMP_IDLE;
+	else if (sysfs_streq(buf, "huge"))
+		mode = ZRAM_RECOMP_HUGE;
+	else if (sysfs_streq(buf, "huge_idle"))
+		mode = ZRAM_RECOMP_IDLE | ZRAM_RECOMP_HUGE;
+	else
+		return -EINVAL;
+
+	/* waits for a running pass, which holds init_lock for read */
+	down_write(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (!zram->recomp) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	/* don't change the mode of a pass that is queued but not started */
+	if (work_pending(&zram->recomp_work)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	/* the pass runs in the background, one at a time per device */
+	zram->recomp_mode = mode;
+	queue_work(system_unbound_wq, &zram->recomp_work);
+out:
+	up_write(&zram->init_lock);
+	return ret;
+}
+
+static ssize_t algo_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret = 0;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram))
+		goto out;
+
+	ret = scnprintf(buf, PAGE_SIZE, "%-8s %8llu %8llu\n",
+			zram->comp->backend->name,
+			(u64)atomic64_read(&zram->stats.algo_pages[
+						ZRAM_PRIMARY_COMP]),
+			(u64)atomic64_read(&zram->stats.algo_data_size[
+						ZRAM_PRIMARY_COMP]));
+	if (zram->recomp)
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+			"%-8s %8llu %8llu\n",
+			zram->recomp->backend->name,
+			(u64)atomic64_read(&zram->stats.algo_pages[
+						ZRAM_SECONDARY_COMP]),
+			(u64)atomic64_read(&zram->stats.algo_data_size[
+						ZRAM_SECONDARY_COMP]));
+out:
+	up_read(&zram->init_lock);
+	return ret;
+}
+#endif
+
+static void zram_reset_device(struct zram *zram)
+{
+	struct zram_meta *meta;
+	struct zcomp *comp;
+	struct zcomp *recomp = NULL;
+	u64 disksize;
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	/* the recompression pass takes init_lock itself */
+	cancel_work_sync(&zram->recomp_work);
+#endif
+	down_write(&zram->init_lock);
+
+	zram->limit_pages = 0;
+
+	if (!init_done(zram)) {
+		up_write(&zram->init_lock);
+		return;
+	}
+
+	meta = zram->meta;
 	comp = zram->comp;
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	recomp = zram->recomp;
+	zram->recomp = NULL;
+#endif
 	disksize = zram->disksize;
 	/*
 	 * Refcount will go down to 0 eventually and r/w handler
@@ -853,7 +1787,7 @@ static void zram_reset_device(struct zram *zram)
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zram->disksize = 0;
-	zram->max_comp_streams = 1;
+	reset_bdev(zram);
 
 	set_capacity(zram->disk, 0);
 	part_stat_set_all(&zram->disk->part0, 0);
@@ -862,6 +1796,8 @@ static void zram_reset_device(struct zram *zram)
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(meta, disksize);
 	zcomp_destroy(comp);
+	if (recomp)
+		zcomp_destroy(recomp);
 }
 
 static ssize_t disksize_store(struct device *dev,
@@ -869,6 +1805,7 @@ static ssize_t disksize_store(struct device *dev,
 {
 	u64 disksize;
 	struct zcomp *comp;
+	struct zcomp *recomp = NULL;
 	struct zram_meta *meta;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
@@ -882,7 +1819,15 @@ static ssize_t disksize_store(struct device *dev,
 	if (!meta)
 		return -ENOMEM;
 
-	comp = zcomp_create(zram->compressor, zram->max_comp_streams);
+#ifdef CONFIG_ZRAM_DEDUP
+	if (zram->use_dedup) {
+		err = zram_dedup_init(meta, disksize >> PAGE_SHIFT);
+		if (err)
+			goto out_free_meta;
+	}
+#endif
+
+	comp = zcomp_create(zram->compressor);
 	if (IS_ERR(comp)) {
 		pr_info("Cannot initialise %s compressing backend\n",
 				zram->compressor);
@@ -890,6 +1835,19 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (!sysfs_streq(zram->recomp_algorithm, "")) {
+		recomp = zcomp_create(zram->recomp_algorithm);
+		if (IS_ERR(recomp)) {
+			pr_info("Cannot initialise %s recompressing backend\n",
+					zram->recomp_algorithm);
+			err = PTR_ERR(recomp);
+			zcomp_destroy(comp);
+			goto out_free_meta;
+		}
+	}
+#endif
+
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		pr_info("Cannot change disksize for initialized device\n");
@@ -901,6 +1859,9 @@ static ssize_t disksize_store(struct device *dev,
 	atomic_set(&zram->refcount, 1);
 	zram->meta = meta;
 	zram->comp = comp;
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	zram->recomp = recomp;
+#endif
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 	up_write(&zram->init_lock);
@@ -917,6 +1878,8 @@ static ssize_t disksize_store(struct device *dev,
 out_destroy_comp:
 	up_write(&zram->init_lock);
 	zcomp_destroy(comp);
+	if (recomp)
+		zcomp_destroy(recomp);
 out_free_meta:
 	zram_meta_free(meta, disksize);
 	return err;
@@ -968,6 +1931,156 @@ out:
 	return ret;
 }
 
+/*
+ * Pages decompressed by one work item, so the queueing and completion cost
+ * is spread over several decompressions, and the smallest bio worth
+ * splitting across workers.
+ */
+#define ZRAM_READ_BATCH		8
+#define ZRAM_READ_ASYNC_MIN	(2 * ZRAM_READ_BATCH)
+
+struct zram_read_ctl;
+
+struct zram_read_work {
+	struct work_struct work;
+	struct zram_read_ctl *ctl;
+	u32 index;
+	unsigned int nr;
+	struct bio_vec bvec[ZRAM_READ_BATCH];
+};
+
+/*
+ * A bio whose pages are decompressed in parallel on zram_read_wq, one
+ * batch per work item. The last batch to finish completes the bio.
+ */
+struct zram_read_ctl {
+	struct zram *zram;
+	struct bio *bio;
+	atomic_t pending;
+	int error;
+	struct zram_read_work works[0];
+};
+
+static void zram_read_ctl_put(struct zram_read_ctl *ctl)
+{
+	struct zram *zram = ctl->zram;
+
+	if (!atomic_dec_and_test(&ctl->pending))
+		return;
+
+	if (ctl->error) {
+		bio_io_error(ctl->bio);
+	} else {
+		set_bit(BIO_UPTODATE, &ctl->bio->bi_flags);
+		bio_endio(ctl->bio, 0);
+	}
+
+	kfree(ctl);
+	zram_meta_put(zram);
+}
+
+static void zram_read_batch(struct zram_read_work *rw)
+{
+	struct zram_read_ctl *ctl = rw->ctl;
+	unsigned int i;
+
+	for (i = 0; i < rw->nr; i++) {
+		if (zram_bvec_rw(ctl->zram, &rw->bvec[i], rw->index + i, 0,
+					READ) < 0)
+			ctl->error = -EIO;
+	}
+	zram_read_ctl_put(ctl);
+}
+
+static void zram_read_work_fn(struct work_struct *work)
+{
+	zram_read_batch(container_of(work, struct zram_read_work, work));
+}
+
+/*
+ * Allocate @nr batches. The caller holds a reference on the ctl until it
+ * has queued all of them, and the ctl holds a meta reference until it
+ * completes. Returns NULL if the read should be done synchronously
+ * instead.
+ */
+static struct zram_read_ctl *zram_read_ctl_alloc(struct zram *zram,
+						unsigned int nr)
+{
+	struct zram_read_ctl *ctl;
+
+	if (!zram_read_wq)
+		return NULL;
+
+	ctl = kzalloc(sizeof(*ctl) + nr * sizeof(struct zram_read_work),
+			GFP_NOIO | __GFP_NOWARN);
+	if (!ctl)
+		return NULL;
+
+	/* can't fail, the caller is already holding a reference */
+	zram_meta_get(zram);
+	ctl->zram = zram;
+	atomic_set(&ctl->pending, nr + 1);
+	return ctl;
+}
+
+/*
+ * Read a large bio by decompressing batches of its pages in parallel.
+ * Only bios of at least ZRAM_READ_ASYNC_MIN whole, aligned pages take
+ * this path; below that the workqueue round trip costs about as much as
+ * the decompression it offloads. Returns false if the bio has to be
+ * handled synchronously.
+ */
+static bool zram_read_bio_async(struct zram *zram, struct bio *bio)
+{
+	struct zram_read_ctl *ctl;
+	struct zram_read_work *rw;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	unsigned int nr = 0, nr_batches, i;
+	u32 index;
+
+	if (bio->bi_iter.bi_sector & (SECTORS_PER_PAGE - 1))
+		return false;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		if (bvec.bv_len != PAGE_SIZE)
+			return false;
+		nr++;
+	}
+
+	if (nr < ZRAM_READ_ASYNC_MIN)
+		return false;
+
+	nr_batches = DIV_ROUND_UP(nr, ZRAM_READ_BATCH);
+	ctl = zram_read_ctl_alloc(zram, nr_batches);
+	if (!ctl)
+		return false;
+
+	ctl->bio = bio;
+	index = bio->bi_iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	i = 0;
+	bio_for_each_segment(bvec, bio, iter) {
+		rw = &ctl->works[i / ZRAM_READ_BATCH];
+		if (!rw->nr) {
+			rw->ctl = ctl;
+			rw->index = index + i;
+			INIT_WORK(&rw->work, zram_read_work_fn);
+		}
+		rw->bvec[rw->nr++] = bvec;
+		i++;
+
+		/* keep the first batch for the submitter, see below */
+		if (rw != ctl->works &&
+		    (rw->nr == ZRAM_READ_BATCH || i == nr))
+			queue_work(zram_read_wq, &rw->work);
+	}
+
+	/* decompress the first batch here while the workers do the rest */
+	zram_read_batch(ctl->works);
+	zram_read_ctl_put(ctl);
+	return true;
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset, rw;
@@ -986,6 +2099,9 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 	}
 
 	rw = bio_data_dir(bio);
+	if (rw == READ && zram_read_bio_async(zram, bio))
+		return;
+
 	bio_for_each_segment(bvec, bio, iter) {
 		int max_transfer_size = PAGE_SIZE - offset;
 
@@ -1104,8 +2220,26 @@ out:
 	return err;
 }
 
+/*
+ * Lets the swap ratio code weigh zram against a slower swap device.
+ * Called with swap spinlocks held, so only the atomic stats are read.
+ */
+static unsigned int zram_swap_compr_ratio(struct block_device *bdev)
+{
+	struct zram *zram = bdev->bd_disk->private_data;
+	u64 orig_size = atomic64_read(&zram->stats.pages_stored) << PAGE_SHIFT;
+	u64 compr_size = atomic64_read(&zram->stats.compr_data_size);
+
+	if (!orig_size)
+		return 0;
+
+	return min_t(u64, div64_u64(orig_size * 100, max(compr_size, 1ULL)),
+			UINT_MAX);
+}
+
 static const struct block_device_operations zram_devops = {
 	.swap_slot_free_notify = zram_slot_free_notify,
+	.swap_compr_ratio = zram_swap_compr_ratio,
 	.rw_page = zram_rw_page,
 	.owner = THIS_MODULE
 };
@@ -1120,6 +2254,19 @@ static DEVICE_ATTR_RW(mem_limit);
 static DEVICE_ATTR_RW(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_WO(idle);
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
+static DEVICE_ATTR_RO(algo_stat);
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR_RW(backing_dev);
+static DEVICE_ATTR_WO(writeback);
+#endif
 
 static ssize_t io_stat_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
@@ -1155,21 +2302,45 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
-			(u64)atomic64_read(&zram->stats.zero_pages),
-			(u64)atomic64_read(&zram->stats.num_migrated));
+			(u64)atomic64_read(&zram->stats.same_pages),
+			(u64)atomic64_read(&zram->stats.num_migrated),
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.meta_data_size));
 	up_read(&zram->init_lock);
 
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"%8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.bd_count),
+			(u64)atomic64_read(&zram->stats.bd_reads),
+			(u64)atomic64_read(&zram->stats.bd_writes));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
 static DEVICE_ATTR_RO(io_stat);
 static DEVICE_ATTR_RO(mm_stat);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR_RO(bd_stat);
+#endif
 ZRAM_ATTR_RO(num_reads);
 ZRAM_ATTR_RO(num_writes);
 ZRAM_ATTR_RO(failed_reads);
@@ -1200,6 +2371,20 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_comp_algorithm.attr,
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
+	&dev_attr_idle.attr,
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_use_dedup.attr,
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+	&dev_attr_algo_stat.attr,
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_stat.attr,
+#endif
 	NULL,
 };
 
@@ -1218,6 +2403,9 @@ static int create_device(struct zram *zram, int device_id)
 	int ret = -ENOMEM;
 
 	init_rwsem(&zram->init_lock);
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	INIT_WORK(&zram->recomp_work, zram_recompress_work);
+#endif
 
 	queue = blk_alloc_queue(GFP_KERNEL);
 	if (!queue) {
@@ -1281,7 +2469,6 @@ static int create_device(struct zram *zram, int device_id)
 
 	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
 	zram->meta = NULL;
-	zram->max_comp_streams = 1;
 	return 0;
 
 out_free_queue:
@@ -1315,6 +2502,8 @@ static void destroy_devices(unsigned int nr)
 	put_disk(zram->disk);
 
 	kfree(zram_devices);
+	if (zram_read_wq)
+		destroy_workqueue(zram_read_wq);
 	unregister_blkdev(zram_major, "zram");
 	pr_info("Destroyed %u device(s)\n", nr);
 }
@@ -1342,6 +2531,15 @@ static int __init zram_init(void)
 		return -ENOMEM;
 	}
 
+	/*
+	 * Unbound so that a batch spreads over all CPUs, and it serves
+	 * swap-in so it needs a rescuer. Reads stay synchronous without it.
+	 */
+	zram_read_wq = alloc_workqueue("zram_read",
+			WQ_UNBOUND | WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!zram_read_wq)
+		pr_warn("Unable to allocate read workqueue\n");
+
 	for (dev_id = 0; dev_id < num_devices; dev_id++) {
 		ret = create_device(&zram_devices[dev_id], dev_id);
 		if (ret)
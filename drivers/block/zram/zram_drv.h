@@ -16,6 +16,8 @@
 #define _ZRAM_DRV_H_
 
 #include <linux/spinlock.h>
+#include <linux/rbtree.h>
+#include <linux/workqueue.h>
 #include <linux/zsmalloc.h>
 
 #include "zcomp.h"
@@ -26,22 +28,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*-- Configurable parameters */
-
-/*
- * Pages that compress to size greater than this are stored
- * uncompressed in memory.
- */
-static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
-
-/*
- * NOTE: max_zpage_size must be less than or equal to:
- *   ZS_MAX_ALLOC_SIZE. Otherwise, zs_malloc() would
- * always return failure.
- */
-
-/*-- End of configurable params */
-
 #define SECTOR_SHIFT		9
 #define SECTORS_PER_PAGE_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
@@ -63,20 +49,48 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
  */
 #define ZRAM_FLAG_SHIFT 24
 
+/* Compression algorithms a slot can be stored with, see ZRAM_RECOMP */
+#define ZRAM_PRIMARY_COMP	0
+#define ZRAM_SECONDARY_COMP	1
+#define ZRAM_MAX_COMPS		2
+
 /* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO = ZRAM_FLAG_SHIFT,
+	/* Page consists of the same element, stored in table.element */
+	ZRAM_SAME = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
+	ZRAM_WB,	/* page is stored on backing_device */
+	ZRAM_PP_SLOT,	/* page is under writeback or recompression */
+	ZRAM_HUGE,	/* Incompressible page */
+	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_DEDUP,	/* table.handle points to a shared zram_entry */
+	ZRAM_RECOMP,	/* page is compressed with the secondary algorithm */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/* Shared compressed object, refcounted by the slots storing its content */
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 len;
+	u32 checksum;
+	unsigned long refcount;
+	unsigned long handle;
+};
+
+struct zram_hash {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
 /* Allocated for each disk page */
 struct zram_table_entry {
-	unsigned long handle;
+	union {
+		unsigned long handle;
+		unsigned long element;
+	};
 	unsigned long value;
 };
 
@@ -90,13 +104,30 @@ struct zram_stats {
 	atomic64_t invalid_io;	/* non-page-aligned I/O requests */
 	atomic64_t notify_free;	/* no. of swap slot free notifications */
 	atomic64_t zero_pages;		/* no. of zero filled pages */
+	atomic64_t same_pages;		/* no. of same element filled pages */
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
+	atomic64_t dup_data_size;	/* compressed size of pages duplicated */
+	atomic64_t meta_data_size;	/* size of zram_entries */
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	/* no. of pages and their compressed size per algorithm */
+	atomic64_t algo_pages[ZRAM_MAX_COMPS];
+	atomic64_t algo_data_size[ZRAM_MAX_COMPS];
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in backing device */
+	atomic64_t bd_reads;		/* no. of reads from backing device */
+	atomic64_t bd_writes;		/* no. of writes to backing device */
+#endif
 };
 
 struct zram_meta {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
+#ifdef CONFIG_ZRAM_DEDUP
+	struct zram_hash *hash;
+	size_t hash_size;
+#endif
 };
 
 struct zram {
@@ -109,7 +140,6 @@ struct zram {
 	 * the number of pages zram can consume for storing compressed data
 	 */
 	unsigned long limit_pages;
-	int max_comp_streams;
 
 	struct zram_stats stats;
 	atomic_t refcount; /* refcount for zram_meta */
@@ -121,5 +151,23 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	char compressor[10];
+#ifdef CONFIG_ZRAM_DEDUP
+	bool use_dedup;
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	/* secondary algorithm, NULL unless recomp_algorithm is set */
+	struct zcomp *recomp;
+	char recomp_algorithm[10];
+	struct work_struct recomp_work;
+	int recomp_mode;
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned int old_block_size;
+	/* bitmap of used blocks on backing_dev, bit 0 is never used */
+	unsigned long *bitmap;
+	unsigned long nr_pages;
+#endif
 };
 #endif
@@ -79,6 +79,8 @@ struct kgsl_dma_buf_meta {
 };
 
 static void kgsl_mem_entry_detach_process(struct kgsl_mem_entry *entry);
+static void kgsl_mem_entry_unlink_process(struct kgsl_mem_entry *entry);
+static void kgsl_mem_entry_release_process(struct kgsl_mem_entry *entry);
 
 static const struct file_operations kgsl_fops;
 
@@ -276,22 +278,20 @@ static void kgsl_destroy_ion(struct kgsl_dma_buf_meta *meta)
 }
 #endif
 
-void
-kgsl_mem_entry_destroy(struct kref *kref)
+/*
+ * Unmap the entry from the GPU, drop its process reference and give the
+ * backing memory back. This is the expensive part of freeing a large buffer
+ * so it normally runs from the low priority free worker.
+ */
+static void _kgsl_mem_entry_destroy(struct kgsl_mem_entry *entry)
 {
-	struct kgsl_mem_entry *entry = container_of(kref,
-						    struct kgsl_mem_entry,
-						    refcount);
 	unsigned int memtype;
 
-	if (entry == NULL)
-		return;
-
 	/* pull out the memtype before the flags get cleared */
 	memtype = kgsl_memdesc_usermem_type(&entry->memdesc);
 
-	/* Detach from process list */
-	kgsl_mem_entry_detach_process(entry);
+	/* Unmap from the GPU and release the process */
+	kgsl_mem_entry_release_process(entry);
 
 	if (memtype != KGSL_MEM_ENTRY_KERNEL)
 		atomic_long_sub(entry->memdesc.size,
@@ -334,6 +334,92 @@ kgsl_mem_entry_destroy(struct kref *kref)
 
 	kfree(entry);
 }
+
+/* Number of entries to free between rescheduling points */
+#define KGSL_FREE_BATCH 16
+
+/* Runs on the free worker and frees everything on the deferred list */
+static void _kgsl_mem_entry_free_work(struct kthread_work *work)
+{
+	struct kgsl_mem_entry *entry, *tmp;
+	struct llist_node *list;
+	int count = 0;
+
+	list = llist_del_all(&kgsl_driver.free_list);
+	if (list == NULL)
+		return;
+
+	/* Free in the order the entries were queued */
+	list = llist_reverse_order(list);
+
+	atomic_long_inc(&kgsl_driver.free_stats.batches);
+
+	llist_for_each_entry_safe(entry, tmp, list, free_node) {
+		uint64_t size = entry->memdesc.size;
+
+		_kgsl_mem_entry_destroy(entry);
+
+		atomic_long_sub(size, &kgsl_driver.free_stats.pending);
+		atomic_long_dec(&kgsl_driver.free_stats.queued);
+
+		if (++count % KGSL_FREE_BATCH == 0)
+			cond_resched();
+	}
+}
+
+/*
+ * Hand the entry to the free worker unless that would leave more than
+ * deferred_free_limit bytes waiting to be freed. Returns true if the entry
+ * was queued.
+ */
+static bool kgsl_mem_entry_defer_free(struct kgsl_mem_entry *entry)
+{
+	uint64_t size = entry->memdesc.size;
+	uint64_t pending;
+
+	if (kgsl_driver.free_thread == NULL)
+		return false;
+
+	pending = atomic_long_add_return(size, &kgsl_driver.free_stats.pending);
+	if (pending > kgsl_driver.deferred_free_limit) {
+		atomic_long_sub(size, &kgsl_driver.free_stats.pending);
+		atomic_long_inc(&kgsl_driver.free_stats.sync);
+		return false;
+	}
+
+	if (pending > atomic_long_read(&kgsl_driver.free_stats.pending_max))
+		atomic_long_set(&kgsl_driver.free_stats.pending_max, pending);
+	KGSL_STATS_ADD(1, &kgsl_driver.free_stats.queued,
+		&kgsl_driver.free_stats.queued_max);
+
+	if (llist_add(&entry->free_node, &kgsl_driver.free_list))
+		queue_kthread_work(&kgsl_driver.free_worker,
+			&kgsl_driver.free_work);
+
+	return true;
+}
+
+void
+kgsl_mem_entry_destroy(struct kref *kref)
+{
+	struct kgsl_mem_entry *entry = container_of(kref,
+						    struct kgsl_mem_entry,
+						    refcount);
+
+	if (entry == NULL)
+		return;
+
+	/*
+	 * Take the entry out of the process right away so it can't be found
+	 * any more, then leave the GPU unmap and the page freeing to the free
+	 * worker so that the caller (usually a render thread tearing down a
+	 * surface) doesn't pay for it.
+	 */
+	kgsl_mem_entry_unlink_process(entry);
+
+	if (!kgsl_mem_entry_defer_free(entry))
+		_kgsl_mem_entry_destroy(entry);
+}
 EXPORT_SYMBOL(kgsl_mem_entry_destroy);
 
 /* Allocate a IOVA for memory objects that don't use SVM */
@@ -421,12 +507,12 @@ static int kgsl_mem_entry_attach_process(struct kgsl_device *device,
 	return ret;
 }
 
-/* Detach a memory entry from a process and unmap it from the MMU */
-static void kgsl_mem_entry_detach_process(struct kgsl_mem_entry *entry)
+/* Remove a memory entry from the process idr and the process statistics */
+static void kgsl_mem_entry_unlink_process(struct kgsl_mem_entry *entry)
 {
 	unsigned int type;
 
-	if (entry == NULL)
+	if (entry == NULL || entry->priv == NULL)
 		return;
 
 	/*
@@ -441,6 +527,13 @@ static void kgsl_mem_entry_detach_process(struct kgsl_mem_entry *entry)
 	type = kgsl_memdesc_usermem_type(&entry->memdesc);
 	entry->priv->stats[type].cur -= entry->memdesc.size;
 	spin_unlock(&entry->priv->mem_lock);
+}
+
+/* Unmap a memory entry from the MMU and drop its process reference */
+static void kgsl_mem_entry_release_process(struct kgsl_mem_entry *entry)
+{
+	if (entry == NULL || entry->priv == NULL)
+		return;
 
 	kgsl_mmu_put_gpuaddr(&entry->memdesc);
 
@@ -449,6 +542,13 @@ static void kgsl_mem_entry_detach_process(struct kgsl_mem_entry *entry)
 	entry->priv = NULL;
 }
 
+/* Detach a memory entry from a process and unmap it from the MMU */
+static void kgsl_mem_entry_detach_process(struct kgsl_mem_entry *entry)
+{
+	kgsl_mem_entry_unlink_process(entry);
+	kgsl_mem_entry_release_process(entry);
+}
+
 /**
  * kgsl_context_dump() - dump information about a draw context
  * @device: KGSL device that owns the context
@@ -3753,6 +3853,19 @@ struct kgsl_driver kgsl_driver  = {
 	.stats.secure_max = ATOMIC_LONG_INIT(0),
 	.stats.mapped = ATOMIC_LONG_INIT(0),
 	.stats.mapped_max = ATOMIC_LONG_INIT(0),
+
+	.free_list = LLIST_HEAD_INIT(kgsl_driver.free_list),
+	/*
+	 * Bound how much memory can sit on the deferred free list before
+	 * callers go back to freeing synchronously
+	 */
+	.deferred_free_limit = SZ_64M,
+	.free_stats.pending = ATOMIC_LONG_INIT(0),
+	.free_stats.pending_max = ATOMIC_LONG_INIT(0),
+	.free_stats.queued = ATOMIC_LONG_INIT(0),
+	.free_stats.queued_max = ATOMIC_LONG_INIT(0),
+	.free_stats.batches = ATOMIC_LONG_INIT(0),
+	.free_stats.sync = ATOMIC_LONG_INIT(0),
 };
 EXPORT_SYMBOL(kgsl_driver);
 
@@ -4022,6 +4135,15 @@ EXPORT_SYMBOL(kgsl_device_platform_remove);
 
 static void kgsl_core_exit(void)
 {
+	struct task_struct *free_thread = kgsl_driver.free_thread;
+
+	/* Free anything still waiting on the deferred list */
+	kgsl_driver.free_thread = NULL;
+	if (free_thread != NULL) {
+		flush_kthread_worker(&kgsl_driver.free_worker);
+		kthread_stop(free_thread);
+	}
+
 	kgsl_events_exit();
 	kgsl_cffdump_destroy();
 	kgsl_core_debugfs_close();
@@ -4130,6 +4252,24 @@ static int __init kgsl_core_init(void)
 
 	sched_setscheduler(kgsl_driver.worker_thread, SCHED_FIFO, &param);
 
+	/*
+	 * Buffers are unmapped and freed from a low priority thread so that
+	 * tearing down a surface doesn't stall the render thread. If the
+	 * thread can't be started memory is simply freed synchronously.
+	 */
+	init_kthread_worker(&kgsl_driver.free_worker);
+	init_kthread_work(&kgsl_driver.free_work, _kgsl_mem_entry_free_work);
+
+	kgsl_driver.free_thread = kthread_run(kthread_worker_fn,
+		&kgsl_driver.free_worker, "kgsl_free_worker");
+
+	if (IS_ERR(kgsl_driver.free_thread)) {
+		pr_warn("unable to start kgsl free thread\n");
+		kgsl_driver.free_thread = NULL;
+	} else {
+		set_user_nice(kgsl_driver.free_thread, MAX_NICE);
+	}
+
 	kgsl_events_init();
 
 	result = kgsl_cmdbatch_init();
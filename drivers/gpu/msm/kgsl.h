@@ -27,6 +27,7 @@
 #include <linux/dma-attrs.h>
 #include <linux/uaccess.h>
 #include <linux/kthread.h>
+#include <linux/llist.h>
 #include <asm/cacheflush.h>
 
 /* The number of memstore arrays limits the number of contexts allowed.
@@ -104,6 +105,15 @@ struct kgsl_context;
  * @full_cache_threshold: the threshold that triggers a full cache flush
  * @workqueue: Pointer to a single threaded workqueue
  * @mem_workqueue: Pointer to a workqueue for deferring memory entries
+ * @worker: kthread worker for high priority driver work
+ * @worker_thread: Thread backing @worker
+ * @free_worker: Low priority kthread worker that frees memory entries
+ * @free_thread: Thread backing @free_worker
+ * @free_work: Work item that drains @free_list
+ * @free_list: Memory entries waiting to be unmapped and freed
+ * @deferred_free_limit: Maximum number of bytes that may be waiting on
+ * @free_list before memory entries are freed synchronously again
+ * @free_stats: Struct containing atomic deferred free statistics
  */
 struct kgsl_driver {
 	struct cdev cdev;
@@ -135,6 +145,19 @@ struct kgsl_driver {
 	struct workqueue_struct *mem_workqueue;
 	struct kthread_worker worker;
 	struct task_struct *worker_thread;
+	struct kthread_worker free_worker;
+	struct task_struct *free_thread;
+	struct kthread_work free_work;
+	struct llist_head free_list;
+	unsigned int deferred_free_limit;
+	struct {
+		atomic_long_t pending;
+		atomic_long_t pending_max;
+		atomic_long_t queued;
+		atomic_long_t queued_max;
+		atomic_long_t batches;
+		atomic_long_t sync;
+	} free_stats;
 };
 
 extern struct kgsl_driver kgsl_driver;
@@ -238,6 +261,7 @@ struct kgsl_memdesc {
  * @dev_priv: back pointer to the device file that created this entry.
  * @metadata: String containing user specified metadata for the entry
  * @work: Work struct used to schedule a kgsl_mem_entry_put in atomic contexts
+ * @free_node: Node in the deferred free list once the last reference is gone
  */
 struct kgsl_mem_entry {
 	struct kref refcount;
@@ -249,6 +273,7 @@ struct kgsl_mem_entry {
 	int pending_free;
 	char metadata[KGSL_GPUOBJ_ALLOC_METADATA_MAX + 1];
 	struct work_struct work;
+	struct llist_node free_node;
 };
 
 struct kgsl_device_private;
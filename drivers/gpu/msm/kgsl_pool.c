@@ -16,15 +16,36 @@
 #include <linux/slab.h>
 #include <linux/highmem.h>
 #include <linux/version.h>
+#include <linux/debugfs.h>
+#include <linux/freezer.h>
+#include <linux/kthread.h>
+#include <linux/seq_file.h>
+#include <linux/vmstat.h>
+#include <linux/wait.h>
 
 #include "kgsl.h"
 #include "kgsl_device.h"
+#include "kgsl_debugfs.h"
 #include "kgsl_pool.h"
 
 #define KGSL_MAX_POOLS 4
 #define KGSL_MAX_POOL_ORDER 8
 #define KGSL_MAX_RESERVED_PAGES 4096
 
+/*
+ * The high order pools that may allocate from the system are prefilled
+ * up to pool_prefill_kb each in the background, so that large buffers
+ * get 64K and 1M chunks instead of retrying down to 4K pages. The
+ * prefill thread lets the page allocator compact memory for it, which
+ * the allocation path never does. It runs as SCHED_IDLE, only while
+ * there is plenty of free memory, and not for a while after the
+ * shrinker ran.
+ */
+static unsigned int kgsl_pool_prefill_kb = 8192;
+module_param_named(pool_prefill_kb, kgsl_pool_prefill_kb, uint, 0644);
+
+#define KGSL_POOL_PREFILL_BACKOFF	(5 * HZ)
+
 /**
  * struct kgsl_page_pool - Structure to hold information for the pool
  * @pool_order: Page order describing the size of the page
@@ -34,6 +55,10 @@
  * from system memory
  * @list_lock: Spinlock for page list in the pool
  * @page_list: List of pages held/reserved in this pool
+ * @hit: Number of allocations served from the pool
+ * @miss: Number of allocations that found the pool empty
+ * @retry: Number of allocations that had to retry with a lower order
+ * @prefilled: Number of pages added to the pool by the prefill thread
  */
 struct kgsl_page_pool {
 	unsigned int pool_order;
@@ -42,12 +67,22 @@ struct kgsl_page_pool {
 	bool allocation_allowed;
 	spinlock_t list_lock;
 	struct list_head page_list;
+	atomic_long_t hit;
+	atomic_long_t miss;
+	atomic_long_t retry;
+	atomic_long_t prefilled;
 };
 
 static struct kgsl_page_pool kgsl_pools[KGSL_MAX_POOLS];
 static int kgsl_num_pools;
 static int kgsl_pool_max_pages;
 
+static struct task_struct *kgsl_pool_prefill_task;
+static DECLARE_WAIT_QUEUE_HEAD(kgsl_pool_prefill_wait);
+static bool kgsl_pool_prefill_pending;
+/* jiffies of the last shrinker scan, 0 if none yet */
+static unsigned long kgsl_pool_shrunk;
+
 
 /* Returns KGSL pool corresponding to input page order*/
 static struct kgsl_page_pool *
@@ -207,6 +242,107 @@ kgsl_pool_reduce(unsigned int target_pages, bool exit)
 	return pcount;
 }
 
+/* Number of pages the prefill thread keeps in the pool */
+static int kgsl_pool_prefill_target(struct kgsl_page_pool *pool)
+{
+	if (!pool->pool_order || !pool->allocation_allowed)
+		return 0;
+
+	return kgsl_pool_prefill_kb >> (PAGE_SHIFT - 10);
+}
+
+static bool kgsl_pool_backed_off(void)
+{
+	unsigned long shrunk = ACCESS_ONCE(kgsl_pool_shrunk);
+
+	return shrunk && time_in_range(jiffies, shrunk,
+			shrunk + KGSL_POOL_PREFILL_BACKOFF);
+}
+
+static bool kgsl_pool_can_prefill(struct kgsl_page_pool *pool)
+{
+	int chunk = 1 << pool->pool_order;
+
+	if (kgsl_pool_backed_off())
+		return false;
+
+	if (kgsl_pool_max_pages &&
+			kgsl_pool_size_total() + chunk > kgsl_pool_max_pages)
+		return false;
+
+	/*
+	 * Compaction needs free pages to work with, stay well above the
+	 * watermarks so that prefilling never ends up reclaiming.
+	 */
+	return global_page_state(NR_FREE_PAGES) >
+		(totalram_pages >> 4) + kgsl_pool_prefill_target(pool);
+}
+
+static void kgsl_pool_prefill_kick(struct kgsl_page_pool *pool)
+{
+	if (kgsl_pool_prefill_task == NULL || kgsl_pool_prefill_pending)
+		return;
+
+	if (kgsl_pool_size(pool) < kgsl_pool_prefill_target(pool) &&
+			!kgsl_pool_backed_off()) {
+		kgsl_pool_prefill_pending = true;
+		wake_up(&kgsl_pool_prefill_wait);
+	}
+}
+
+static void kgsl_pool_prefill(void)
+{
+	int i;
+
+	/* Largest chunks first, they are the hardest to come by */
+	for (i = kgsl_num_pools - 1; i >= 0; i--) {
+		struct kgsl_page_pool *pool = &kgsl_pools[i];
+		/*
+		 * Unlike kgsl_gfp_mask(), allow the allocator to wait and to
+		 * do I/O and FS work, without which direct compaction skips
+		 * the zone, so it can compact memory into a free chunk of
+		 * this order. Still give up early rather than loop in reclaim.
+		 */
+		gfp_t gfp_mask = GFP_KERNEL | __GFP_HIGHMEM | __GFP_COMP |
+			__GFP_NORETRY | __GFP_NO_KSWAPD | __GFP_NOWARN;
+
+		while (kgsl_pool_size(pool) < kgsl_pool_prefill_target(pool)) {
+			struct page *page;
+
+			if (kthread_should_stop() ||
+					!kgsl_pool_can_prefill(pool))
+				return;
+
+			page = alloc_pages(gfp_mask, pool->pool_order);
+			if (page == NULL)
+				break;
+
+			_kgsl_pool_add_page(pool, page);
+			atomic_long_inc(&pool->prefilled);
+			cond_resched();
+		}
+	}
+}
+
+static int kgsl_pool_prefill_thread(void *data)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	/* Only soak up CPU time nobody else wants */
+	sched_setscheduler(current, SCHED_IDLE, &param);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(kgsl_pool_prefill_wait,
+				kgsl_pool_prefill_pending ||
+				kthread_should_stop());
+		kgsl_pool_prefill_pending = false;
+		kgsl_pool_prefill();
+	}
+
+	return 0;
+}
+
 /**
  * kgsl_pool_free_sgt() - Free scatter-gather list
  * @sgt: pointer of the sg list
@@ -361,8 +497,12 @@ int kgsl_pool_alloc_page(int *page_size, struct page **pages,
 	if (page == NULL) {
 		gfp_t gfp_mask = kgsl_gfp_mask(order);
 
+		atomic_long_inc(&pool->miss);
+		kgsl_pool_prefill_kick(pool);
+
 		/* Only allocate non-reserved memory for certain pools */
 		if (!pool->allocation_allowed && pool_idx > 0) {
+			atomic_long_inc(&pool->retry);
 			size = PAGE_SIZE <<
 					kgsl_pools[pool_idx-1].pool_order;
 			goto eagain;
@@ -373,6 +513,7 @@ int kgsl_pool_alloc_page(int *page_size, struct page **pages,
 		if (!page) {
 			if (pool_idx > 0) {
 				/* Retry with lower order pages */
+				atomic_long_inc(&pool->retry);
 				size = PAGE_SIZE <<
 					kgsl_pools[pool_idx-1].pool_order;
 				goto eagain;
@@ -381,6 +522,9 @@ int kgsl_pool_alloc_page(int *page_size, struct page **pages,
 		}
 
 		_kgsl_pool_zero_page(page, order);
+	} else {
+		atomic_long_inc(&pool->hit);
+		kgsl_pool_prefill_kick(pool);
 	}
 
 done:
@@ -453,6 +597,9 @@ kgsl_pool_shrink_scan_objects(struct shrinker *shrinker,
 	/* Target pages represents new  pool size */
 	int target_pages = (nr > total_pages) ? 0 : (total_pages - nr);
 
+	/* Memory is tight, keep the prefill thread away for a while */
+	kgsl_pool_shrunk = jiffies | 1;
+
 	/* Reduce pool size to target_pages */
 	return kgsl_pool_reduce(target_pages, false);
 }
@@ -491,9 +638,47 @@ static void kgsl_pool_config(unsigned int order, unsigned int reserved_pages,
 	kgsl_pools[kgsl_num_pools].allocation_allowed = allocation_allowed;
 	spin_lock_init(&kgsl_pools[kgsl_num_pools].list_lock);
 	INIT_LIST_HEAD(&kgsl_pools[kgsl_num_pools].page_list);
+	atomic_long_set(&kgsl_pools[kgsl_num_pools].hit, 0);
+	atomic_long_set(&kgsl_pools[kgsl_num_pools].miss, 0);
+	atomic_long_set(&kgsl_pools[kgsl_num_pools].retry, 0);
+	atomic_long_set(&kgsl_pools[kgsl_num_pools].prefilled, 0);
 	kgsl_num_pools++;
 }
 
+static int kgsl_pool_stats_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	seq_printf(s, "%5s %8s %8s %10s %10s %10s %10s\n", "order", "pages",
+			"reserved", "hit", "miss", "retry", "prefilled");
+
+	for (i = 0; i < kgsl_num_pools; i++) {
+		struct kgsl_page_pool *pool = &kgsl_pools[i];
+
+		seq_printf(s, "%5u %8d %8u %10ld %10ld %10ld %10ld\n",
+				pool->pool_order, kgsl_pool_size(pool),
+				pool->reserved_pages,
+				atomic_long_read(&pool->hit),
+				atomic_long_read(&pool->miss),
+				atomic_long_read(&pool->retry),
+				atomic_long_read(&pool->prefilled));
+	}
+
+	return 0;
+}
+
+static int kgsl_pool_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kgsl_pool_stats_show, NULL);
+}
+
+static const struct file_operations kgsl_pool_stats_fops = {
+	.open = kgsl_pool_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static void kgsl_of_parse_mempools(struct device_node *node)
 {
 	struct device_node *child;
@@ -548,10 +733,25 @@ void kgsl_init_page_pools(struct platform_device *pdev)
 
 	/* Initialize shrinker */
 	register_shrinker(&kgsl_pool_shrinker);
+
+	debugfs_create_file("page_pools", 0444, kgsl_get_debugfs_dir(), NULL,
+			&kgsl_pool_stats_fops);
+
+	/* Start filling the high order pools beyond their reserve */
+	kgsl_pool_prefill_pending = true;
+	kgsl_pool_prefill_task = kthread_run(kgsl_pool_prefill_thread, NULL,
+			"kgsl_pool_prefill");
+	if (IS_ERR(kgsl_pool_prefill_task))
+		kgsl_pool_prefill_task = NULL;
 }
 
 void kgsl_exit_page_pools(void)
 {
+	if (kgsl_pool_prefill_task != NULL) {
+		kthread_stop(kgsl_pool_prefill_task);
+		kgsl_pool_prefill_task = NULL;
+	}
+
 	/* Release all pages in pools, if any.*/
 	kgsl_pool_reduce(0, true);
 
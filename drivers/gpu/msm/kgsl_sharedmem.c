@@ -245,6 +245,18 @@ static ssize_t kgsl_drv_memstat_show(struct device *dev,
 		val = atomic_long_read(&kgsl_driver.stats.mapped);
 	else if (!strcmp(attr->attr.name, "mapped_max"))
 		val = atomic_long_read(&kgsl_driver.stats.mapped_max);
+	else if (!strcmp(attr->attr.name, "deferred_free"))
+		val = atomic_long_read(&kgsl_driver.free_stats.pending);
+	else if (!strcmp(attr->attr.name, "deferred_free_max"))
+		val = atomic_long_read(&kgsl_driver.free_stats.pending_max);
+	else if (!strcmp(attr->attr.name, "deferred_free_depth"))
+		val = atomic_long_read(&kgsl_driver.free_stats.queued);
+	else if (!strcmp(attr->attr.name, "deferred_free_depth_max"))
+		val = atomic_long_read(&kgsl_driver.free_stats.queued_max);
+	else if (!strcmp(attr->attr.name, "deferred_free_batches"))
+		val = atomic_long_read(&kgsl_driver.free_stats.batches);
+	else if (!strcmp(attr->attr.name, "deferred_free_sync"))
+		val = atomic_long_read(&kgsl_driver.free_stats.sync);
 
 	return snprintf(buf, PAGE_SIZE, "%llu\n", val);
 }
@@ -272,6 +284,29 @@ static ssize_t kgsl_drv_full_cache_threshold_show(struct device *dev,
 			kgsl_driver.full_cache_threshold);
 }
 
+static ssize_t kgsl_drv_deferred_free_limit_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	int ret;
+	unsigned int limit = 0;
+
+	ret = kgsl_sysfs_store(buf, &limit);
+	if (ret)
+		return ret;
+
+	kgsl_driver.deferred_free_limit = limit;
+	return count;
+}
+
+static ssize_t kgsl_drv_deferred_free_limit_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			kgsl_driver.deferred_free_limit);
+}
+
 static DEVICE_ATTR(vmalloc, 0444, kgsl_drv_memstat_show, NULL);
 static DEVICE_ATTR(vmalloc_max, 0444, kgsl_drv_memstat_show, NULL);
 static DEVICE_ATTR(page_alloc, 0444, kgsl_drv_memstat_show, NULL);
@@ -282,6 +317,15 @@ static DEVICE_ATTR(secure, 0444, kgsl_drv_memstat_show, NULL);
 static DEVICE_ATTR(secure_max, 0444, kgsl_drv_memstat_show, NULL);
 static DEVICE_ATTR(mapped, 0444, kgsl_drv_memstat_show, NULL);
 static DEVICE_ATTR(mapped_max, 0444, kgsl_drv_memstat_show, NULL);
+static DEVICE_ATTR(deferred_free, 0444, kgsl_drv_memstat_show, NULL);
+static DEVICE_ATTR(deferred_free_max, 0444, kgsl_drv_memstat_show, NULL);
+static DEVICE_ATTR(deferred_free_depth, 0444, kgsl_drv_memstat_show, NULL);
+static DEVICE_ATTR(deferred_free_depth_max, 0444, kgsl_drv_memstat_show, NULL);
+static DEVICE_ATTR(deferred_free_batches, 0444, kgsl_drv_memstat_show, NULL);
+static DEVICE_ATTR(deferred_free_sync, 0444, kgsl_drv_memstat_show, NULL);
+static DEVICE_ATTR(deferred_free_limit, 0644,
+		kgsl_drv_deferred_free_limit_show,
+		kgsl_drv_deferred_free_limit_store);
 static DEVICE_ATTR(full_cache_threshold, 0644,
 		kgsl_drv_full_cache_threshold_show,
 		kgsl_drv_full_cache_threshold_store);
@@ -298,6 +342,13 @@ static const struct device_attribute *drv_attr_list[] = {
 	&dev_attr_mapped,
 	&dev_attr_mapped_max,
 	&dev_attr_full_cache_threshold,
+	&dev_attr_deferred_free,
+	&dev_attr_deferred_free_max,
+	&dev_attr_deferred_free_depth,
+	&dev_attr_deferred_free_depth_max,
+	&dev_attr_deferred_free_batches,
+	&dev_attr_deferred_free_sync,
+	&dev_attr_deferred_free_limit,
 	NULL
 };
 
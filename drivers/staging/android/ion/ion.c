@@ -31,6 +31,7 @@
 #include <linux/export.h>
 #include <linux/mm.h>
 #include <linux/mm_types.h>
+#include <linux/proc_fs.h>
 #include <linux/rbtree.h>
 #include <linux/slab.h>
 #include <linux/seq_file.h>
@@ -277,14 +278,63 @@ err2:
 	return ERR_PTR(ret);
 }
 
+/*
+ * Counts the chunks of order [0, 4), [4, 8) and 8 or higher in the
+ * buffer for the ion_buffer_alloc tracepoint.
+ */
+static void ion_buffer_order_breakdown(struct ion_buffer *buffer,
+				       unsigned int *nr_small,
+				       unsigned int *nr_mid,
+				       unsigned int *nr_large)
+{
+	struct scatterlist *sg;
+	int i;
+
+	*nr_small = *nr_mid = *nr_large = 0;
+	for_each_sg(buffer->sg_table->sgl, sg, buffer->sg_table->nents, i) {
+		int order = get_order(sg->length);
+
+		if (order >= 8)
+			(*nr_large)++;
+		else if (order >= 4)
+			(*nr_mid)++;
+		else
+			(*nr_small)++;
+	}
+}
+
+static void ion_buffer_trace_alloc(struct ion_client *client,
+				   struct ion_buffer *buffer, ktime_t start)
+{
+	unsigned int nr_small, nr_mid, nr_large;
+	u64 latency_ns;
+
+	if (!trace_ion_buffer_alloc_enabled())
+		return;
+
+	latency_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	ion_buffer_order_breakdown(buffer, &nr_small, &nr_mid, &nr_large);
+	trace_ion_buffer_alloc(client->name, buffer->heap->name, buffer->size,
+			       buffer->flags, latency_ns, nr_small, nr_mid,
+			       nr_large);
+}
+
 void ion_buffer_destroy(struct ion_buffer *buffer)
 {
+	bool trace = trace_ion_buffer_free_enabled();
+	ktime_t start = ktime_set(0, 0);
+
 	if (WARN_ON(buffer->kmap_cnt > 0))
 		buffer->heap->ops->unmap_kernel(buffer->heap, buffer);
 	buffer->heap->ops->unmap_dma(buffer->heap, buffer);
 
 	atomic_sub(buffer->size, &buffer->heap->total_allocated);
+	if (trace)
+		start = ktime_get();
 	buffer->heap->ops->free(buffer);
+	if (trace)
+		trace_ion_buffer_free(buffer->heap->name, buffer->size,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
 	if (buffer->pages)
 		vfree(buffer->pages);
 	kfree(buffer);
@@ -554,6 +604,7 @@ static struct ion_handle *__ion_alloc(struct ion_client *client, size_t len,
 	struct ion_device *dev = client->dev;
 	struct ion_buffer *buffer = NULL;
 	struct ion_heap *heap;
+	ktime_t start = ktime_set(0, 0);
 	int ret;
 	const unsigned int MAX_DBG_STR_LEN = 64;
 	char dbg_str[MAX_DBG_STR_LEN];
@@ -589,11 +640,15 @@ static struct ion_handle *__ion_alloc(struct ion_client *client, size_t len,
 			continue;
 		trace_ion_alloc_buffer_start(client->name, heap->name, len,
 					     heap_id_mask, flags);
+		if (trace_ion_buffer_alloc_enabled())
+			start = ktime_get();
 		buffer = ion_buffer_create(heap, dev, len, align, flags);
 		trace_ion_alloc_buffer_end(client->name, heap->name, len,
 					   heap_id_mask, flags);
-		if (!IS_ERR(buffer))
+		if (!IS_ERR(buffer)) {
+			ion_buffer_trace_alloc(client, buffer, start);
 			break;
+		}
 
 		trace_ion_alloc_buffer_fallback(client->name, heap->name, len,
 					    heap_id_mask, flags,
@@ -735,12 +790,19 @@ EXPORT_SYMBOL(ion_phys);
 static void *ion_buffer_kmap_get(struct ion_buffer *buffer)
 {
 	void *vaddr;
+	bool trace = trace_ion_buffer_map_kernel_enabled();
+	ktime_t start = ktime_set(0, 0);
 
 	if (buffer->kmap_cnt) {
 		buffer->kmap_cnt++;
 		return buffer->vaddr;
 	}
+	if (trace)
+		start = ktime_get();
 	vaddr = buffer->heap->ops->map_kernel(buffer->heap, buffer);
+	if (trace)
+		trace_ion_buffer_map_kernel(buffer->heap->name, buffer->size,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
 	if (WARN_ONCE(vaddr == NULL,
 			"heap->ops->map_kernel should return ERR_PTR on error"))
 		return ERR_PTR(-EINVAL);
@@ -1301,6 +1363,8 @@ static struct vm_operations_struct ion_vma_ops = {
 static int ion_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
 {
 	struct ion_buffer *buffer = dmabuf->priv;
+	bool trace = trace_ion_buffer_map_user_enabled();
+	ktime_t start = ktime_set(0, 0);
 	int ret = 0;
 
 	if (!buffer->heap->ops->map_user) {
@@ -1324,7 +1388,13 @@ static int ion_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
 
 	mutex_lock(&buffer->lock);
 	/* now map it to userspace */
+	if (trace)
+		start = ktime_get();
 	ret = buffer->heap->ops->map_user(buffer->heap, buffer, vma);
+	if (trace)
+		trace_ion_buffer_map_user(buffer->heap->name,
+				vma->vm_end - vma->vm_start,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
 	mutex_unlock(&buffer->lock);
 
 	if (ret)
@@ -1902,6 +1972,107 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 	return 0;
 }
 
+struct ion_usage {
+	unsigned int nr_buffers;
+	size_t size;
+	size_t pss;
+};
+
+/*
+ * /proc/ion_usage: one line per client and heap the client holds buffers
+ * from, followed by one line per buffer no client holds a handle to any
+ * more, attributed to the task that allocated it. Fields are separated by
+ * tabs. pss_kb splits each buffer evenly between the clients holding a
+ * handle to it. The free-form comm and client columns come last; new
+ * columns will only ever be inserted before them.
+ *
+ * It exposes every process's allocations, so only root may read it; init
+ * can hand it to a system group with chown/chmod.
+ */
+static int ion_usage_show(struct seq_file *s, void *unused)
+{
+	struct ion_device *dev = s->private;
+	struct ion_usage *usage;
+	struct ion_heap *heap;
+	struct rb_node *n;
+
+	usage = kcalloc(ION_NUM_HEAP_IDS, sizeof(*usage), GFP_KERNEL);
+	if (!usage)
+		return -ENOMEM;
+
+	seq_puts(s, "pid\theap_id\theap\tbuffers\tsize_kb\tpss_kb\tcomm\tclient\n");
+
+	down_read(&dev->lock);
+	for (n = rb_first(&dev->clients); n; n = rb_next(n)) {
+		struct ion_client *client = rb_entry(n, struct ion_client,
+						     node);
+		char task_comm[TASK_COMM_LEN];
+		struct rb_node *hnode;
+
+		memset(usage, 0, ION_NUM_HEAP_IDS * sizeof(*usage));
+		mutex_lock(&client->lock);
+		for (hnode = rb_first(&client->handles); hnode;
+		     hnode = rb_next(hnode)) {
+			struct ion_handle *handle = rb_entry(hnode,
+							     struct ion_handle,
+							     node);
+			struct ion_buffer *buffer = handle->buffer;
+			struct ion_usage *u = &usage[buffer->heap->id];
+
+			u->nr_buffers++;
+			u->size += buffer->size;
+			u->pss += buffer->size / max(buffer->handle_count, 1);
+		}
+		mutex_unlock(&client->lock);
+
+		if (client->task)
+			get_task_comm(task_comm, client->task);
+		else
+			strlcpy(task_comm, client->name, TASK_COMM_LEN);
+
+		plist_for_each_entry(heap, &dev->heaps, node) {
+			struct ion_usage *u = &usage[heap->id];
+
+			if (!u->nr_buffers)
+				continue;
+			seq_printf(s, "%d\t%u\t%s\t%u\t%zu\t%zu\t%s\t%s\n",
+				   client->pid, heap->id, heap->name,
+				   u->nr_buffers, u->size >> 10, u->pss >> 10,
+				   task_comm, client->display_name);
+		}
+	}
+	up_read(&dev->lock);
+
+	mutex_lock(&dev->buffer_lock);
+	for (n = rb_first(&dev->buffers); n; n = rb_next(n)) {
+		struct ion_buffer *buffer = rb_entry(n, struct ion_buffer,
+						     node);
+
+		if (buffer->handle_count)
+			continue;
+		seq_printf(s, "%d\t%u\t%s\t1\t%zu\t%zu\t%s\t-\n",
+			   buffer->pid, buffer->heap->id, buffer->heap->name,
+			   buffer->size >> 10, buffer->size >> 10,
+			   buffer->task_comm);
+	}
+	mutex_unlock(&dev->buffer_lock);
+
+	kfree(usage);
+	return 0;
+}
+
+static int ion_usage_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ion_usage_show, PDE_DATA(inode));
+}
+
+static const struct file_operations ion_usage_fops = {
+	.open = ion_usage_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int ion_debug_heap_open(struct inode *inode, struct file *file)
 {
 	return single_open(file, ion_debug_heap_show, inode->i_private);
@@ -2101,12 +2272,18 @@ debugfs_done:
 	plist_head_init(&idev->heaps);
 	idev->clients = RB_ROOT;
 	ion_dev = idev;
+
+	if (!proc_create_data("ion_usage", S_IRUSR, NULL, &ion_usage_fops,
+			      idev))
+		pr_err("ion: failed to create /proc/ion_usage.\n");
+
 	return idev;
 }
 
 void ion_device_destroy(struct ion_device *dev)
 {
 	misc_deregister(&dev->dev);
+	remove_proc_entry("ion_usage", NULL);
 	debugfs_remove_recursive(dev->debug_root);
 	/* XXX need to free the heaps and clients ? */
 	kfree(dev);
@@ -18,13 +18,103 @@
 #include <linux/dma-mapping.h>
 #include <linux/err.h>
 #include <linux/fs.h>
+#include <linux/jiffies.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/vmalloc.h>
+#include <linux/vmstat.h>
 #include "ion_priv.h"
 
+/*
+ * Pools that opted in with ion_page_pool_enable_refill() are kept above
+ * refill_low_kb worth of zeroed, cache clean pages by a background
+ * worker, so allocations do not have to zero pages in line. The worker
+ * only runs when there are spare CPUs and plenty of free memory, and
+ * stays away for refill_backoff_ms after the shrinker took pages back.
+ */
+static unsigned int refill_low_kb = 4096;
+module_param(refill_low_kb, uint, 0644);
+
+static unsigned int refill_backoff_ms = 5000;
+module_param(refill_backoff_ms, uint, 0644);
+
+#define ION_POOL_REFILL_DELAY	(HZ / 10)
+
+static struct workqueue_struct *ion_page_pool_wq;
+/* jiffies of the last shrink that freed pool pages, 0 if none yet */
+static unsigned long ion_page_pool_shrunk;
+
+/*
+ * Per-cpu magazines of up to ION_POOL_CACHE_PAGES pages worth of items
+ * sit in front of the shared lists, so that a free followed by an alloc
+ * on the same cpu never takes pool->mutex. Items move between a magazine
+ * and the shared lists half a magazine at a time. Only the shrinker ever
+ * takes a magazine lock from another cpu.
+ */
+#define ION_POOL_CACHE_PAGES	64
+
+int ion_lat_hist_bucket(ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+
+	if (us <= 0)
+		return 0;
+	return min(fls64(us), ION_LAT_HIST_BUCKETS - 1);
+}
+
+void ion_lat_hist_show(struct seq_file *s, unsigned long *hist)
+{
+	int i;
+
+	for (i = 0; i < ION_LAT_HIST_BUCKETS; i++)
+		seq_printf(s, " %lu", hist[i]);
+	seq_puts(s, "\n");
+}
+
+static int ion_page_pool_count(struct ion_page_pool *pool)
+{
+	return pool->high_count + pool->low_count;
+}
+
+unsigned int ion_page_pool_low_mark(struct ion_page_pool *pool)
+{
+	unsigned int size_kb = (PAGE_SIZE << pool->order) >> 10;
+
+	if (!pool->refill)
+		return 0;
+	return DIV_ROUND_UP(refill_low_kb, size_kb);
+}
+
+static bool ion_page_pool_backed_off(void)
+{
+	unsigned long shrunk = ACCESS_ONCE(ion_page_pool_shrunk);
+
+	return shrunk && time_in_range(jiffies, shrunk,
+			shrunk + msecs_to_jiffies(refill_backoff_ms));
+}
+
+static bool ion_page_pool_can_refill(struct ion_page_pool *pool)
+{
+	unsigned long want = (unsigned long)ion_page_pool_low_mark(pool) <<
+				pool->order;
+
+	if (ion_page_pool_backed_off())
+		return false;
+
+	/* keep well clear of the watermarks, never reclaim for a refill */
+	return global_page_state(NR_FREE_PAGES) >
+		2 * totalreserve_pages + want;
+}
+
+static void ion_page_pool_kick_refill(struct ion_page_pool *pool)
+{
+	if (ion_page_pool_count(pool) < ion_page_pool_low_mark(pool) &&
+	    !ion_page_pool_backed_off())
+		queue_delayed_work(ion_page_pool_wq, &pool->refill_work, 0);
+}
+
 static void *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
 {
 	struct page *page;
@@ -53,10 +143,9 @@ static void ion_page_pool_free_pages(struct ion_page_pool *pool,
 	__free_pages(page, pool->order);
 }
 
-static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page,
+static void __ion_page_pool_add(struct ion_page_pool *pool, struct page *page,
 				bool prefetch)
 {
-	mutex_lock(&pool->mutex);
 	if (PageHighMem(page)) {
 		list_add_tail(&page->lru, &pool->high_items);
 		pool->high_count++;
@@ -66,11 +155,66 @@ static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page,
 	}
 	if (!prefetch)
 		pool->nr_unreserved++;
+}
 
+static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page,
+				bool prefetch)
+{
+	mutex_lock(&pool->mutex);
+	__ion_page_pool_add(pool, page, prefetch);
 	mutex_unlock(&pool->mutex);
 	return 0;
 }
 
+static void ion_page_pool_add_list(struct ion_page_pool *pool,
+				   struct list_head *pages)
+{
+	struct page *page, *tmp;
+
+	mutex_lock(&pool->mutex);
+	list_for_each_entry_safe(page, tmp, pages, lru) {
+		list_del(&page->lru);
+		__ion_page_pool_add(pool, page, false);
+	}
+	mutex_unlock(&pool->mutex);
+}
+
+static void ion_page_pool_refill_fn(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(to_delayed_work(work),
+						  struct ion_page_pool,
+						  refill_work);
+	gfp_t gfp_mask = (pool->gfp_mask | __GFP_NORETRY | __GFP_NO_KSWAPD |
+			  __GFP_NOWARN) & ~(__GFP_WAIT | __GFP_ZERO);
+	struct page *page;
+
+	while (ion_page_pool_count(pool) < ion_page_pool_low_mark(pool)) {
+		if (!ion_page_pool_can_refill(pool))
+			return;
+
+		/* only soak up idle CPU time, try again a bit later */
+		if (nr_running() > num_online_cpus()) {
+			queue_delayed_work(ion_page_pool_wq, &pool->refill_work,
+					   ION_POOL_REFILL_DELAY);
+			return;
+		}
+
+		page = alloc_pages(gfp_mask, pool->order);
+		if (!page)
+			return;
+
+		/* zeroes and cleans the page to the point of coherency */
+		if (msm_ion_heap_high_order_page_zero(page, pool->order)) {
+			__free_pages(page, pool->order);
+			return;
+		}
+		ion_page_pool_alloc_set_cache_policy(pool, page);
+		ion_page_pool_add(pool, page, false);
+		atomic_long_inc(&pool->nr_refilled);
+		cond_resched();
+	}
+}
+
 static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high,
 					bool prefetch)
 {
@@ -97,15 +241,178 @@ static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high,
 	return page;
 }
 
+/* Moves up to @nr of the least recently freed items of @pcp to @pages */
+static int ion_page_pool_cache_take(struct ion_page_pool_cpu *pcp,
+				    struct list_head *pages, int nr)
+{
+	struct page *page;
+	int taken = 0;
+
+	while (taken < nr && pcp->count) {
+		page = list_last_entry(&pcp->items, struct page, lru);
+		list_move(&page->lru, pages);
+		pcp->count--;
+		taken++;
+	}
+	return taken;
+}
+
+static struct page *ion_page_pool_cache_get(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_cpu *pcp;
+	struct page *page = NULL;
+
+	pcp = get_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	if (pcp->count) {
+		page = list_first_entry(&pcp->items, struct page, lru);
+		list_del(&page->lru);
+		pcp->count--;
+	}
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->pcp);
+
+	return page;
+}
+
+/*
+ * The magazine of this cpu is empty: take half a magazine from the
+ * shared lists, return one item and cache the rest.
+ */
+static struct page *ion_page_pool_cache_fill(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_cpu *pcp;
+	struct page *page = NULL;
+	LIST_HEAD(pages);
+	int nr = max(pool->cache_size / 2, 1);
+
+	if (!mutex_trylock(&pool->mutex))
+		return NULL;
+	while (nr--) {
+		if (pool->high_count)
+			page = ion_page_pool_remove(pool, true, false);
+		else if (pool->low_count)
+			page = ion_page_pool_remove(pool, false, false);
+		else
+			break;
+		list_add(&page->lru, &pages);
+	}
+	mutex_unlock(&pool->mutex);
+
+	if (list_empty(&pages))
+		return NULL;
+
+	page = list_first_entry(&pages, struct page, lru);
+	list_del(&page->lru);
+	if (list_empty(&pages))
+		return page;
+
+	pcp = get_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	while (!list_empty(&pages)) {
+		list_move_tail(pages.next, &pcp->items);
+		pcp->count++;
+	}
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->pcp);
+
+	return page;
+}
+
+static void ion_page_pool_cache_put(struct ion_page_pool *pool,
+				    struct page *page)
+{
+	struct ion_page_pool_cpu *pcp;
+	LIST_HEAD(spill);
+
+	pcp = get_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	if (pcp->count >= pool->cache_size)
+		ion_page_pool_cache_take(pcp, &spill,
+					 max(pool->cache_size / 2, 1));
+	list_add(&page->lru, &pcp->items);
+	pcp->count++;
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->pcp);
+
+	if (!list_empty(&spill))
+		ion_page_pool_add_list(pool, &spill);
+}
+
+static void ion_page_pool_cache_drain(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_cpu *pcp;
+	LIST_HEAD(pages);
+	int cpu;
+
+	if (!pool->cache_size)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->pcp, cpu);
+		spin_lock(&pcp->lock);
+		ion_page_pool_cache_take(pcp, &pages, pcp->count);
+		spin_unlock(&pcp->lock);
+	}
+	if (!list_empty(&pages))
+		ion_page_pool_add_list(pool, &pages);
+}
+
+int ion_page_pool_cache_count(struct ion_page_pool *pool)
+{
+	int cpu, count = 0;
+
+	if (!pool->cache_size)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		count += per_cpu_ptr(pool->pcp, cpu)->count;
+	return count;
+}
+
+void ion_page_pool_stats(struct ion_page_pool *pool, unsigned long *nr_hit,
+			 unsigned long *nr_miss, unsigned long *lat_hist)
+{
+	struct ion_page_pool_cpu *pcp;
+	int cpu, i;
+
+	*nr_hit = *nr_miss = 0;
+	memset(lat_hist, 0, sizeof(*lat_hist) * ION_LAT_HIST_BUCKETS);
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->pcp, cpu);
+		*nr_hit += pcp->nr_hit;
+		*nr_miss += pcp->nr_miss;
+		for (i = 0; i < ION_LAT_HIST_BUCKETS; i++)
+			lat_hist[i] += pcp->lat_hist[i];
+	}
+}
+
+static void ion_page_pool_account(struct ion_page_pool *pool, bool hit,
+				  ktime_t start)
+{
+	if (hit)
+		this_cpu_inc(pool->pcp->nr_hit);
+	else
+		this_cpu_inc(pool->pcp->nr_miss);
+	this_cpu_inc(pool->pcp->lat_hist[ion_lat_hist_bucket(start)]);
+	ion_page_pool_kick_refill(pool);
+}
+
 void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
 {
 	struct page *page = NULL;
+	ktime_t start = ktime_get();
 
 	BUG_ON(!pool);
 
 	*from_pool = true;
 
-	if (mutex_trylock(&pool->mutex)) {
+	if (pool->cache_size) {
+		page = ion_page_pool_cache_get(pool);
+		if (!page)
+			page = ion_page_pool_cache_fill(pool);
+	} else if (mutex_trylock(&pool->mutex)) {
 		if (pool->high_count)
 			page = ion_page_pool_remove(pool, true, false);
 		else if (pool->low_count)
@@ -116,12 +423,14 @@ void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
 		page = ion_page_pool_alloc_pages(pool);
 		*from_pool = false;
 	}
+	ion_page_pool_account(pool, *from_pool, start);
 	return page;
 }
 
 void *ion_page_pool_prefetch(struct ion_page_pool *pool, bool *from_pool)
 {
 	struct page *page = NULL;
+	ktime_t start = ktime_get();
 
 	BUG_ON(!pool);
 
@@ -138,6 +447,7 @@ void *ion_page_pool_prefetch(struct ion_page_pool *pool, bool *from_pool)
 		page = ion_page_pool_alloc_pages(pool);
 		*from_pool = false;
 	}
+	ion_page_pool_account(pool, *from_pool, start);
 	return page;
 }
 /*
@@ -167,6 +477,11 @@ void ion_page_pool_free(struct ion_page_pool *pool, struct page *page,
 
 	BUG_ON(pool->order != compound_order(page));
 
+	if (pool->cache_size && !prefetch) {
+		ion_page_pool_cache_put(pool, page);
+		return;
+	}
+
 	ret = ion_page_pool_add(pool, page, prefetch);
 	/* FIXME? For a secure page, not hyp unassigned in this err path */
 	if (ret)
@@ -180,7 +495,8 @@ void ion_page_pool_free_immediate(struct ion_page_pool *pool, struct page *page)
 
 int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 {
-	int count = pool->low_count;
+	/* magazines do not tell highmem from lowmem, count them all */
+	int count = pool->low_count + ion_page_pool_cache_count(pool);
 
 	if (high)
 		count += pool->high_count;
@@ -202,6 +518,10 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	if (nr_to_scan == 0)
 		return ion_page_pool_total(pool, high);
 
+	/* memory is tight, stop refilling any pool for a while */
+	ion_page_pool_shrunk = jiffies | 1;
+	ion_page_pool_cache_drain(pool);
+
 	while (freed < nr_to_scan) {
 		struct page *page;
 
@@ -226,8 +546,22 @@ struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
 {
 	struct ion_page_pool *pool = kmalloc(sizeof(struct ion_page_pool),
 					     GFP_KERNEL);
+	int cpu;
+
 	if (!pool)
 		return NULL;
+	pool->pcp = alloc_percpu(struct ion_page_pool_cpu);
+	if (!pool->pcp) {
+		kfree(pool);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu) {
+		struct ion_page_pool_cpu *pcp = per_cpu_ptr(pool->pcp, cpu);
+
+		spin_lock_init(&pcp->lock);
+		INIT_LIST_HEAD(&pcp->items);
+	}
+	pool->cache_size = 0;
 	pool->high_count = 0;
 	pool->low_count = 0;
 	pool->nr_unreserved = 0;
@@ -237,17 +571,49 @@ struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
 	pool->order = order;
 	mutex_init(&pool->mutex);
 	plist_node_init(&pool->list, order);
+	pool->refill = false;
+	INIT_DELAYED_WORK(&pool->refill_work, ion_page_pool_refill_fn);
+	atomic_long_set(&pool->nr_refilled, 0);
 
 	return pool;
 }
 
+/*
+ * Let the refill worker keep the pool above refill_low_kb. Only for
+ * pools whose pages need nothing but zeroing and a cache clean before
+ * they can be handed out, i.e. not for secure pools.
+ */
+void ion_page_pool_enable_refill(struct ion_page_pool *pool)
+{
+	pool->refill = true;
+	ion_page_pool_kick_refill(pool);
+}
+
+/*
+ * Put per-cpu magazines in front of the pool. Only for pools whose items
+ * are not individually tracked outside of ion_page_pool_alloc_pool_only(),
+ * which only looks at the shared lists, i.e. not for secure pools.
+ */
+void ion_page_pool_enable_cache(struct ion_page_pool *pool)
+{
+	pool->cache_size = ION_POOL_CACHE_PAGES >> pool->order;
+}
+
 void ion_page_pool_destroy(struct ion_page_pool *pool)
 {
+	pool->refill = false;
+	cancel_delayed_work_sync(&pool->refill_work);
+	ion_page_pool_cache_drain(pool);
+	free_percpu(pool->pcp);
 	kfree(pool);
 }
 
 static int __init ion_page_pool_init(void)
 {
+	ion_page_pool_wq = alloc_workqueue("ion_pool_refill",
+					   WQ_UNBOUND | WQ_FREEZABLE, 0);
+	if (!ion_page_pool_wq)
+		return -ENOMEM;
 	return 0;
 }
 
@@ -255,5 +621,6 @@ static void __exit ion_page_pool_exit(void)
 {
 }
 
-module_init(ion_page_pool_init);
+/* heaps, and with them their pools, are created at subsys_initcall time */
+core_initcall(ion_page_pool_init);
 module_exit(ion_page_pool_exit);
@@ -31,6 +31,10 @@
 #include <linux/shrinker.h>
 #include <linux/types.h>
 #include <linux/device.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #ifdef CONFIG_ION_POOL_CACHE_POLICY
 #include <asm/cacheflush.h>
 #endif
@@ -408,6 +412,34 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * invalidated from the cache, provides a significant performance benefit on
  * many systems */
 
+/*
+ * Allocation latency histograms: bucket 0 counts allocations that took
+ * less than 1us, bucket n those that took [2^(n-1), 2^n) usecs and the
+ * last bucket everything slower.
+ */
+#define ION_LAT_HIST_BUCKETS	16
+
+int ion_lat_hist_bucket(ktime_t start);
+void ion_lat_hist_show(struct seq_file *s, unsigned long *hist);
+
+/**
+ * struct ion_page_pool_cpu - per-cpu magazine and statistics of a pool
+ * @lock:		protects @items against the shrinker draining them
+ * @count:		number of items in @items
+ * @items:		items cached on this cpu, most recently freed first
+ * @nr_hit:		allocations served from the pool
+ * @nr_miss:		allocations that fell back to the page allocator
+ * @lat_hist:		log2 histogram of allocation latency in usecs
+ */
+struct ion_page_pool_cpu {
+	spinlock_t lock;
+	int count;
+	struct list_head items;
+	unsigned long nr_hit;
+	unsigned long nr_miss;
+	unsigned long lat_hist[ION_LAT_HIST_BUCKETS];
+};
+
 /**
  * struct ion_page_pool - pagepool struct
  * @high_count:		number of highmem items in the pool
@@ -421,6 +453,11 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
  * @list:		plist node for list of pools
+ * @refill:		pool is kept above its low mark by @refill_work
+ * @refill_work:	background refill with zeroed pages
+ * @nr_refilled:	items added to the pool by the refill worker
+ * @cache_size:		capacity of each per-cpu magazine, 0 if none are used
+ * @pcp:		per-cpu magazines and statistics
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
@@ -437,6 +474,11 @@ struct ion_page_pool {
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct plist_node list;
+	bool refill;
+	struct delayed_work refill_work;
+	atomic_long_t nr_refilled;
+	int cache_size;
+	struct ion_page_pool_cpu __percpu *pcp;
 };
 
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
@@ -447,6 +489,12 @@ void ion_page_pool_free(struct ion_page_pool *, struct page *, bool prefetch);
 void ion_page_pool_free_immediate(struct ion_page_pool *, struct page *);
 int ion_page_pool_total(struct ion_page_pool *pool, bool high);
 void *ion_page_pool_prefetch(struct ion_page_pool *pool, bool *from_pool);
+void ion_page_pool_enable_refill(struct ion_page_pool *pool);
+unsigned int ion_page_pool_low_mark(struct ion_page_pool *pool);
+void ion_page_pool_enable_cache(struct ion_page_pool *pool);
+int ion_page_pool_cache_count(struct ion_page_pool *pool);
+void ion_page_pool_stats(struct ion_page_pool *pool, unsigned long *nr_hit,
+			 unsigned long *nr_miss, unsigned long *lat_hist);
 
 #ifdef CONFIG_ION_POOL_CACHE_POLICY
 static inline void ion_page_pool_alloc_set_cache_policy
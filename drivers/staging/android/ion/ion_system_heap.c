@@ -63,6 +63,7 @@ struct ion_system_heap {
 	struct ion_page_pool **uncached_pools;
 	struct ion_page_pool **cached_pools;
 	struct ion_page_pool **secure_pools[VMID_LAST];
+	atomic_long_t alloc_lat_hist[ION_LAT_HIST_BUCKETS];
 };
 
 struct page_info {
@@ -222,6 +223,7 @@ static int ion_system_heap_allocate(struct ion_heap *heap,
 	struct pages_mem data;
 	unsigned int sz;
 	int vmid = get_secure_vmid(buffer->flags);
+	ktime_t start = ktime_get();
 
 	if (align > PAGE_SIZE)
 		return -EINVAL;
@@ -325,6 +327,7 @@ static int ion_system_heap_allocate(struct ion_heap *heap,
 	if (nents_sync)
 		sg_free_table(&table_sync);
 	msm_ion_heap_free_pages_mem(&data);
+	atomic_long_inc(&sys_heap->alloc_lat_hist[ion_lat_hist_bucket(start)]);
 	return 0;
 
 err_free_sg2:
@@ -512,6 +515,63 @@ static struct ion_heap_ops system_heap_ops = {
 	.shrink = ion_system_heap_shrink,
 };
 
+static void ion_system_heap_debug_show_pool(struct ion_page_pool *pool,
+					    const char *name,
+					    struct seq_file *s)
+{
+	unsigned long nr_hit, nr_miss;
+	unsigned long lat_hist[ION_LAT_HIST_BUCKETS];
+
+	ion_page_pool_stats(pool, &nr_hit, &nr_miss, lat_hist);
+	seq_printf(s, "%-8s %5u %8u %8d %8d %10lu %10lu %10ld\n",
+		   name, pool->order, ion_page_pool_low_mark(pool),
+		   pool->high_count + pool->low_count,
+		   ion_page_pool_cache_count(pool), nr_hit, nr_miss,
+		   atomic_long_read(&pool->nr_refilled));
+}
+
+static void ion_system_heap_debug_show_pool_lat(struct ion_page_pool *pool,
+						const char *name,
+						struct seq_file *s)
+{
+	unsigned long nr_hit, nr_miss;
+	unsigned long lat_hist[ION_LAT_HIST_BUCKETS];
+
+	ion_page_pool_stats(pool, &nr_hit, &nr_miss, lat_hist);
+	seq_printf(s, "%s order %u:", name, pool->order);
+	ion_lat_hist_show(s, lat_hist);
+}
+
+static void ion_system_heap_debug_show_lat(struct ion_system_heap *sys_heap,
+					   struct seq_file *s)
+{
+	unsigned long lat_hist[ION_LAT_HIST_BUCKETS];
+	int i;
+
+	seq_printf(s, "%-8s %5s %8s %8s %8s %10s %10s %10s\n", "pool",
+		   "order", "low_mark", "count", "percpu", "hit", "miss",
+		   "refilled");
+	for (i = 0; i < num_orders; i++) {
+		ion_system_heap_debug_show_pool(sys_heap->uncached_pools[i],
+						"uncached", s);
+		ion_system_heap_debug_show_pool(sys_heap->cached_pools[i],
+						"cached", s);
+	}
+
+	seq_puts(s, "allocation latency, usecs in log2 buckets from <1:\n");
+	for (i = 0; i < ION_LAT_HIST_BUCKETS; i++)
+		lat_hist[i] = atomic_long_read(&sys_heap->alloc_lat_hist[i]);
+	seq_puts(s, "buffer:");
+	ion_lat_hist_show(s, lat_hist);
+	for (i = 0; i < num_orders; i++) {
+		ion_system_heap_debug_show_pool_lat(sys_heap->uncached_pools[i],
+						    "uncached", s);
+		ion_system_heap_debug_show_pool_lat(sys_heap->cached_pools[i],
+						    "cached", s);
+	}
+	seq_puts(s, "--------------------------------------------\n");
+}
+
 static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 				      void *unused)
 {
@@ -602,6 +662,7 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 		seq_printf(s, "pool total (uncached + cached + secure) = %lu\n",
 				uncached_total + cached_total + secure_total);
 		seq_puts(s, "--------------------------------------------\n");
+		ion_system_heap_debug_show_lat(sys_heap, s);
 	} else {
 		pr_info("-------------------------------------------------\n");
 		pr_info("uncached pool = %lu cached pool = %lu secure pool = %lu\n",
@@ -687,6 +748,13 @@ struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 	if (ion_system_heap_create_pools(heap->cached_pools))
 		goto err_create_cached_pools;
 
+	for (i = 0; i < num_orders; i++) {
+		ion_page_pool_enable_cache(heap->uncached_pools[i]);
+		ion_page_pool_enable_cache(heap->cached_pools[i]);
+		ion_page_pool_enable_refill(heap->uncached_pools[i]);
+		ion_page_pool_enable_refill(heap->cached_pools[i]);
+	}
+
 	heap->heap.debug_show = ion_system_heap_debug_show;
 	return &heap->heap;
 
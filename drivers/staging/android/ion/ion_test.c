@@ -17,10 +17,13 @@
 
 #include <linux/dma-buf.h>
 #include <linux/dma-direction.h>
+#include <linux/completion.h>
 #include <linux/fs.h>
+#include <linux/kthread.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/msm_ion.h>
 #include <linux/platform_device.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
@@ -143,6 +146,91 @@ err:
 	return ret;
 }
 
+#define ION_TEST_BENCH_MAX_THREADS	64
+
+struct ion_test_bench {
+	struct ion_test_alloc_bench *args;
+	atomic_t nr_running;
+	struct completion done;
+	int ret;
+};
+
+static int ion_test_bench_thread(void *data)
+{
+	struct ion_test_bench *bench = data;
+	struct ion_test_alloc_bench *args = bench->args;
+	struct ion_client *client;
+	struct ion_handle *handle;
+	unsigned int i;
+	int ret = 0;
+
+	client = msm_ion_client_create("ion-test-bench");
+	if (IS_ERR_OR_NULL(client)) {
+		ret = client ? PTR_ERR(client) : -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < args->nr_iterations; i++) {
+		handle = ion_alloc(client, args->size, 0, args->heap_id_mask,
+				   args->flags);
+		if (IS_ERR_OR_NULL(handle)) {
+			ret = handle ? PTR_ERR(handle) : -ENOMEM;
+			break;
+		}
+		ion_free(client, handle);
+	}
+	ion_client_destroy(client);
+out:
+	if (ret)
+		cmpxchg(&bench->ret, 0, ret);
+	if (atomic_dec_and_test(&bench->nr_running))
+		complete(&bench->done);
+	return 0;
+}
+
+static int ion_handle_test_alloc_bench(struct ion_test_alloc_bench *args)
+{
+	struct ion_test_bench bench;
+	struct task_struct **tasks;
+	ktime_t start;
+	unsigned int i;
+
+	if (!args->nr_threads || args->nr_threads > ION_TEST_BENCH_MAX_THREADS ||
+	    !args->size)
+		return -EINVAL;
+
+	tasks = kcalloc(args->nr_threads, sizeof(*tasks), GFP_KERNEL);
+	if (!tasks)
+		return -ENOMEM;
+
+	bench.args = args;
+	bench.ret = 0;
+	atomic_set(&bench.nr_running, args->nr_threads);
+	init_completion(&bench.done);
+
+	for (i = 0; i < args->nr_threads; i++) {
+		tasks[i] = kthread_create(ion_test_bench_thread, &bench,
+					  "ion_test_bench/%u", i);
+		if (IS_ERR(tasks[i])) {
+			int ret = PTR_ERR(tasks[i]);
+
+			while (i--)
+				kthread_stop(tasks[i]);
+			kfree(tasks);
+			return ret;
+		}
+	}
+
+	start = ktime_get();
+	for (i = 0; i < args->nr_threads; i++)
+		wake_up_process(tasks[i]);
+	wait_for_completion(&bench.done);
+	args->elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	kfree(tasks);
+	return bench.ret;
+}
+
 static long ion_test_ioctl(struct file *filp, unsigned int cmd,
 						unsigned long arg)
 {
@@ -151,6 +239,7 @@ static long ion_test_ioctl(struct file *filp, unsigned int cmd,
 
 	union {
 		struct ion_test_rw_data test_rw;
+		struct ion_test_alloc_bench alloc_bench;
 	} data;
 
 	if (_IOC_SIZE(cmd) > sizeof(data))
@@ -192,12 +281,17 @@ static long ion_test_ioctl(struct file *filp, unsigned int cmd,
 					data.test_rw.write);
 		break;
 	}
+	case ION_IOC_TEST_ALLOC_BENCH:
+	{
+		ret = ion_handle_test_alloc_bench(&data.alloc_bench);
+		break;
+	}
 	default:
 		return -ENOTTY;
 	}
 
 	if (_IOC_DIR(cmd) & _IOC_READ) {
-		if (copy_to_user((void __user *)arg, &data, sizeof(data)))
+		if (copy_to_user((void __user *)arg, &data, _IOC_SIZE(cmd)))
 			return -EFAULT;
 	}
 	return ret;
@@ -35,6 +35,24 @@ struct ion_test_rw_data {
 	int __padding;
 };
 
+/**
+ * struct ion_test_alloc_bench - parameters and result of an alloc/free run
+ * @size:		size of each buffer
+ * @elapsed_ns:		time for all threads to finish, filled in by the kernel
+ * @heap_id_mask:	heaps to allocate from
+ * @flags:		flags passed to the allocation
+ * @nr_threads:		number of threads allocating concurrently
+ * @nr_iterations:	number of alloc/free pairs done by each thread
+ */
+struct ion_test_alloc_bench {
+	__u64 size;
+	__u64 elapsed_ns;
+	__u32 heap_id_mask;
+	__u32 flags;
+	__u32 nr_threads;
+	__u32 nr_iterations;
+};
+
 #define ION_IOC_MAGIC		'I'
 
 /**
@@ -66,5 +84,16 @@ struct ion_test_rw_data {
 #define ION_IOC_TEST_KERNEL_MAPPING \
 			_IOW(ION_IOC_MAGIC, 0xf2, struct ion_test_rw_data)
 
+/**
+ * DOC: ION_IOC_TEST_ALLOC_BENCH - time concurrent in-kernel alloc/free pairs
+ *
+ * Starts nr_threads kernel threads, each with its own client, that allocate
+ * and free a buffer nr_iterations times, and returns the time it took all of
+ * them to finish.  Used to check that heap allocation throughput scales with
+ * the number of threads.  Only expected to be used for debugging and testing.
+ */
+#define ION_IOC_TEST_ALLOC_BENCH \
+			_IOWR(ION_IOC_MAGIC, 0xf3, struct ion_test_alloc_bench)
+
 
 #endif /* _UAPI_LINUX_ION_H */
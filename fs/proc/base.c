@@ -1369,6 +1369,81 @@ static const struct file_operations proc_pid_set_comm_operations = {
 	.release	= single_release,
 };
 
+#ifdef CONFIG_SCHED_WALT
+/*
+ * Related thread group of the task, 0 for none. Tasks sharing a group are
+ * placed on the same cluster and their combined demand drives its
+ * frequency.
+ */
+static ssize_t sched_group_id_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *offset)
+{
+	struct inode *inode = file_inode(file);
+	struct task_struct *p;
+	char buffer[PROC_NUMBUF];
+	unsigned int group_id;
+	int err;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+
+	err = kstrtouint(strstrip(buffer), 0, &group_id);
+	if (err)
+		return err;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+
+	/*
+	 * Groups are global and have no owner, joining one raises the
+	 * frequency and steers the placement of every other member, so only
+	 * privileged tasks may do that. A task may still leave its group.
+	 */
+	if (capable(CAP_SYS_NICE) ||
+	    (!group_id && same_thread_group(current, p)))
+		err = sched_set_group_id(p, group_id);
+	else
+		err = -EPERM;
+
+	put_task_struct(p);
+
+	return err < 0 ? err : count;
+}
+
+static int sched_group_id_show(struct seq_file *m, void *v)
+{
+	struct inode *inode = m->private;
+	struct task_struct *p;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+
+	seq_printf(m, "%u\n", sched_get_group_id(p));
+
+	put_task_struct(p);
+
+	return 0;
+}
+
+static int sched_group_id_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, sched_group_id_show, inode);
+}
+
+static const struct file_operations proc_pid_sched_group_id_operations = {
+	.open		= sched_group_id_open,
+	.read		= seq_read,
+	.write		= sched_group_id_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif /* CONFIG_SCHED_WALT */
+
 static int proc_exe_link(struct dentry *dentry, struct path *exe_path)
 {
 	struct task_struct *task;
@@ -2575,6 +2650,25 @@ static int proc_pid_personality(struct seq_file *m, struct pid_namespace *ns,
 	return err;
 }
 
+#ifdef CONFIG_KSM
+static int proc_pid_ksm_stat(struct seq_file *m, struct pid_namespace *ns,
+				struct pid *pid, struct task_struct *task)
+{
+	struct mm_struct *mm = get_task_mm(task);
+
+	if (!mm)
+		return 0;
+
+	seq_printf(m, "ksm_rmap_items %lu\n", mm->ksm_rmap_items);
+	seq_printf(m, "ksm_merging_pages %lu\n", mm->ksm_merging_pages);
+	seq_printf(m, "ksm_merge_any %s\n",
+		   test_bit(MMF_VM_MERGE_ANY, &mm->flags) ? "yes" : "no");
+	mmput(mm);
+
+	return 0;
+}
+#endif
+
 /*
  * Thread groups
  */
@@ -2604,6 +2698,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 	REG("autogroup",  S_IRUGO|S_IWUSR, proc_pid_sched_autogroup_operations),
 #endif
 	REG("comm",      S_IRUGO|S_IWUSR, proc_pid_set_comm_operations),
+#ifdef CONFIG_SCHED_WALT
+	REG("sched_group_id", S_IRUGO|S_IWUSR, proc_pid_sched_group_id_operations),
+#endif
 #ifdef CONFIG_HAVE_ARCH_TRACEHOOK
 	ONE("syscall",    S_IRUSR, proc_pid_syscall),
 #endif
@@ -2623,6 +2720,10 @@ static const struct pid_entry tgid_base_stuff[] = {
 	REG("mountstats", S_IRUSR, proc_mountstats_operations),
 #ifdef CONFIG_PROCESS_RECLAIM
 	REG("reclaim", S_IWUSR, proc_reclaim_operations),
+	ONE("reclaim_stat", S_IRUGO, proc_pid_reclaim_stat),
+#endif
+#ifdef CONFIG_KSM
+	ONE("ksm_stat",   S_IRUSR, proc_pid_ksm_stat),
 #endif
 #ifdef CONFIG_PROC_PAGE_MONITOR
 	REG("clear_refs", S_IWUSR, proc_clear_refs_operations),
@@ -2990,6 +3091,9 @@ static const struct pid_entry tid_base_stuff[] = {
 	NOD("comm",      S_IFREG|S_IRUGO|S_IWUSR,
 			 &proc_tid_comm_inode_operations,
 			 &proc_pid_set_comm_operations, {}),
+#ifdef CONFIG_SCHED_WALT
+	REG("sched_group_id", S_IRUGO|S_IWUSR, proc_pid_sched_group_id_operations),
+#endif
 #ifdef CONFIG_HAVE_ARCH_TRACEHOOK
 	ONE("syscall",   S_IRUSR, proc_pid_syscall),
 #endif
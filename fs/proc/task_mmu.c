@@ -1450,7 +1450,10 @@ static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
 	int reclaimed;
 
 	split_huge_page_pmd(vma, addr, pmd);
-	if (pmd_trans_unstable(pmd) || !rp->nr_to_reclaim)
+	if (pmd_trans_unstable(pmd))
+		return 0;
+	/* a cold_only walk keeps going to complete its estimate */
+	if (!rp->nr_to_reclaim && !rp->cold_only)
 		return 0;
 cont:
 	isolated = 0;
@@ -1464,6 +1467,24 @@ cont:
 		if (!page)
 			continue;
 
+		if (rp->cold_only) {
+			/*
+			 * Referenced since the last walk, so it's part of
+			 * the working set. Clearing the bit starts the next
+			 * estimation window, hand the reference over to the
+			 * page so that page_referenced() in vmscan still
+			 * sees it.
+			 */
+			if (ptep_test_and_clear_young(vma, addr, pte)) {
+				SetPageReferenced(page);
+				rp->nr_hot++;
+				continue;
+			}
+			rp->nr_cold++;
+			if (!rp->nr_to_reclaim)
+				continue;
+		}
+
 		if (isolate_lru_page(page))
 			continue;
 
@@ -1472,8 +1493,12 @@ cont:
 				page_is_file_cache(page));
 		isolated++;
 		rp->nr_scanned++;
-		if ((isolated >= SWAP_CLUSTER_MAX) || !rp->nr_to_reclaim)
+		if ((isolated >= SWAP_CLUSTER_MAX) || !rp->nr_to_reclaim) {
+			/* don't look at this pte again when we come back */
+			pte++;
+			addr += PAGE_SIZE;
 			break;
+		}
 	}
 	pte_unmap_unlock(pte - 1, ptl);
 	reclaimed = reclaim_pages_from_list(&page_list, vma);
@@ -1482,7 +1507,8 @@ cont:
 	if (rp->nr_to_reclaim < 0)
 		rp->nr_to_reclaim = 0;
 
-	if (rp->nr_to_reclaim && (addr != end))
+	/* once the quota is met, a cold_only walk still counts the rest */
+	if ((rp->nr_to_reclaim || rp->cold_only) && (addr != end))
 		goto cont;
 
 	cond_resched();
@@ -1506,6 +1532,9 @@ struct reclaim_param reclaim_task_anon(struct task_struct *task,
 
 	rp.nr_reclaimed = 0;
 	rp.nr_scanned = 0;
+	rp.cold_only = true;
+	rp.nr_hot = 0;
+	rp.nr_cold = 0;
 	get_task_struct(task);
 	mm = get_task_mm(task);
 	if (!mm)
@@ -1528,9 +1557,6 @@ struct reclaim_param reclaim_task_anon(struct task_struct *task,
 		if (vma->vm_flags & VM_LOCKED)
 			continue;
 
-		if (!rp.nr_to_reclaim)
-			break;
-
 		rp.vma = vma;
 		walk_page_range(vma->vm_start, vma->vm_end,
 			&reclaim_walk);
@@ -1538,6 +1564,11 @@ struct reclaim_param reclaim_task_anon(struct task_struct *task,
 
 	flush_tlb_mm(mm);
 	up_read(&mm->mmap_sem);
+
+	mm->reclaim_hot = rp.nr_hot;
+	mm->reclaim_cold = rp.nr_cold > rp.nr_reclaimed ?
+				rp.nr_cold - rp.nr_reclaimed : 0;
+	atomic_long_add(rp.nr_reclaimed, &mm->reclaim_reclaimed);
 	mmput(mm);
 out:
 	put_task_struct(task);
@@ -1620,6 +1651,7 @@ static ssize_t reclaim_write(struct file *file, const char __user *buf,
 
 	rp.nr_to_reclaim = ~0;
 	rp.nr_reclaimed = 0;
+	rp.cold_only = false;
 	reclaim_walk.private = &rp;
 
 	down_read(&mm->mmap_sem);
@@ -1669,6 +1701,30 @@ const struct file_operations proc_reclaim_operations = {
 	.write		= reclaim_write,
 	.llseek		= noop_llseek,
 };
+
+int proc_pid_reclaim_stat(struct seq_file *m, struct pid_namespace *ns,
+			struct pid *pid, struct task_struct *task)
+{
+	struct mm_struct *mm = get_task_mm(task);
+	unsigned long reclaimed, refaults;
+
+	if (!mm)
+		return 0;
+
+	reclaimed = atomic_long_read(&mm->reclaim_reclaimed);
+	refaults = atomic_long_read(&mm->reclaim_refaults);
+
+	seq_printf(m, "hot_pages %lu\n", mm->reclaim_hot);
+	seq_printf(m, "cold_pages %lu\n", mm->reclaim_cold);
+	seq_printf(m, "reclaimed %lu\n", reclaimed);
+	seq_printf(m, "refaults %lu\n", refaults);
+	/* refaults per thousand reclaimed pages */
+	seq_printf(m, "refault_permille %lu\n",
+			reclaimed ? refaults * 1000 / reclaimed : 0);
+	mmput(mm);
+
+	return 0;
+}
 #endif
 
 #ifdef CONFIG_NUMA
@@ -1628,6 +1628,12 @@ struct block_device_operations {
 	int (*getgeo)(struct block_device *, struct hd_geometry *);
 	/* this callback is with swap_lock and sometimes page table lock held */
 	void (*swap_slot_free_notify) (struct block_device *, unsigned long);
+	/*
+	 * size of the data stored on a compressing swap device relative to
+	 * its compressed size, in percent, or 0 if unknown. Called with
+	 * swap spinlocks held.
+	 */
+	unsigned int (*swap_compr_ratio) (struct block_device *);
 	struct module *owner;
 };
 
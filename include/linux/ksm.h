@@ -21,6 +21,21 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags);
 int __ksm_enter(struct mm_struct *mm);
 void __ksm_exit(struct mm_struct *mm);
+int ksm_enable_merge_any(struct mm_struct *mm);
+int ksm_disable_merge_any(struct mm_struct *mm);
+vm_flags_t __ksm_vma_flags(struct mm_struct *mm, vm_flags_t vm_flags);
+
+/*
+ * Flags for a new anonymous vma: VM_MERGEABLE is added when the mm asked
+ * for all its anonymous memory to be merged with PR_SET_MEMORY_MERGE.
+ */
+static inline vm_flags_t ksm_vma_flags(struct mm_struct *mm,
+				       struct file *file, vm_flags_t vm_flags)
+{
+	if (!file && test_bit(MMF_VM_MERGE_ANY, &mm->flags))
+		return __ksm_vma_flags(mm, vm_flags);
+	return vm_flags;
+}
 
 static inline int ksm_fork(struct mm_struct *mm, struct mm_struct *oldmm)
 {
@@ -87,6 +102,22 @@ static inline void ksm_exit(struct mm_struct *mm)
 {
 }
 
+static inline int ksm_enable_merge_any(struct mm_struct *mm)
+{
+	return -EINVAL;
+}
+
+static inline int ksm_disable_merge_any(struct mm_struct *mm)
+{
+	return -EINVAL;
+}
+
+static inline vm_flags_t ksm_vma_flags(struct mm_struct *mm,
+				       struct file *file, vm_flags_t vm_flags)
+{
+	return vm_flags;
+}
+
 static inline int PageKsm(struct page *page)
 {
 	return 0;
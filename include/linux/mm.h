@@ -2198,6 +2198,11 @@ struct reclaim_param {
 	int nr_to_reclaim;
 	/* pages reclaimed */
 	int nr_reclaimed;
+	/* only reclaim pages not referenced since the last walk */
+	bool cold_only;
+	/* referenced and unreferenced pages seen by a cold_only walk */
+	int nr_hot;
+	int nr_cold;
 };
 extern struct reclaim_param reclaim_task_anon(struct task_struct *task,
 		int nr_to_reclaim);
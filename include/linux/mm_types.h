@@ -474,6 +474,23 @@ struct mm_struct {
 #ifdef CONFIG_MSM_APP_SETTINGS
 	int app_setting;
 #endif
+#ifdef CONFIG_PROCESS_RECLAIM
+	/*
+	 * Working-set estimate from the last process reclaim walk: anon
+	 * pages referenced since the walk before it, and those that were
+	 * not and are still resident.
+	 */
+	unsigned long reclaim_hot;
+	unsigned long reclaim_cold;
+	atomic_long_t reclaim_reclaimed;
+	/* anon pages process reclaim swapped out and that were read back */
+	atomic_long_t reclaim_refaults;
+#endif
+#ifdef CONFIG_KSM
+	/* Updated by ksmd: pages of this mm it tracks and has merged */
+	unsigned long ksm_rmap_items;
+	unsigned long ksm_merging_pages;
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
@@ -487,7 +487,11 @@ static inline int get_dumpable(struct mm_struct *mm)
 #define MMF_HAS_UPROBES		19	/* has uprobes */
 #define MMF_RECALC_UPROBES	20	/* MMF_HAS_UPROBES can be wrong */
 
-#define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK)
+#define MMF_VM_MERGE_ANY	21	/* KSM may merge any anonymous vma */
+#define MMF_VM_MERGE_ANY_MASK	(1 << MMF_VM_MERGE_ANY)
+
+#define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK |\
+				 MMF_VM_MERGE_ANY_MASK)
 
 struct sighand_struct {
 	atomic_t		count;
@@ -1012,11 +1016,24 @@ struct idle_state {
 	unsigned long power;	 /* power consumption in this idle state */
 };
 
+/*
+ * Utilization buckets of the capacity state lookup table, each one covering
+ * (1 << SGE_CAP_LUT_SHIFT) units of capacity.
+ */
+#define SGE_CAP_LUT_SHIFT	4
+#define SGE_CAP_LUT_SIZE	((SCHED_CAPACITY_SCALE >> SGE_CAP_LUT_SHIFT) + 1)
+
 struct sched_group_energy {
 	unsigned int nr_idle_states;	/* number of idle states */
 	struct idle_state *idle_states;	/* ptr to idle state array */
 	unsigned int nr_cap_states;	/* number of capacity states */
 	struct capacity_state *cap_states; /* ptr to capacity state array */
+	/*
+	 * Index of the first capacity state able to serve the lower bound of
+	 * each utilization bucket, rebuilt by sched_energy_build_cap_lut()
+	 * whenever cap_states changes.
+	 */
+	u8 cap_lut[SGE_CAP_LUT_SIZE];
 };
 
 unsigned long capacity_curr_of(int cpu);
@@ -1310,6 +1327,9 @@ struct sched_statistics {
 
 #ifdef CONFIG_SCHED_WALT
 #define RAVG_HIST_SIZE_MAX  5
+#define WALT_NR_TOP_BUCKETS 64
+
+struct related_thread_group;
 
 /* ravg represents frequency scaled cpu-demand of tasks */
 struct ravg {
@@ -1329,6 +1349,9 @@ struct ravg {
 	 * sysctl_sched_ravg_hist_size windows. 'demand' could drive frequency
 	 * demand for tasks.
 	 *
+	 * 'pred_demand' is the forecast of 'sum' for the next window, derived
+	 * from the trend of 'sum_history'. It never falls below 'demand'.
+	 *
 	 * 'curr_window' represents task's contribution to cpu busy time
 	 * statistics (rq->curr_runnable_sum) in current window
 	 *
@@ -1337,6 +1360,7 @@ struct ravg {
 	 */
 	u64 mark_start;
 	u32 sum, demand;
+	u32 pred_demand;
 	u32 sum_history[RAVG_HIST_SIZE_MAX];
 	u32 curr_window, prev_window;
 	u16 active_windows;
@@ -1499,6 +1523,12 @@ struct task_struct {
 	 */
 	u32 init_load_pct;
 	u64 last_sleep_ts;
+	/*
+	 * 'grp' is the related thread group the task was placed in through
+	 * /proc/<pid>/sched_group_id, linked on its list by 'grp_list'.
+	 */
+	struct related_thread_group *grp;
+	struct list_head grp_list;
 #endif
 
 #ifdef CONFIG_CGROUP_SCHED
@@ -1568,6 +1598,11 @@ struct task_struct {
 	unsigned sched_reset_on_fork:1;
 	unsigned sched_contributes_to_load:1;
 	unsigned sched_migrated:1;
+#ifdef CONFIG_PSI
+	unsigned sched_psi_wake_requeue:1;
+	/* Stalled due to lack of memory */
+	unsigned in_memstall:1;
+#endif
 
 #ifdef CONFIG_COMPAT_BRK
 	unsigned brk_randomized:1;
@@ -1765,6 +1800,10 @@ struct task_struct {
 	u64 acct_vm_mem1;	/* accumulated virtual memory usage */
 	cputime_t acct_timexpd;	/* stime + utime since last update */
 #endif
+#ifdef CONFIG_PSI
+	/* Pressure stall state */
+	unsigned int psi_flags;
+#endif
 #ifdef CONFIG_CPUSETS
 	nodemask_t mems_allowed;	/* Protected by alloc_lock */
 	seqcount_t mems_allowed_seq;	/* Seqence no to catch updates */
@@ -3269,6 +3308,22 @@ static inline void set_task_cpu(struct task_struct *p, unsigned int cpu)
 extern long sched_setaffinity(pid_t pid, const struct cpumask *new_mask);
 extern long sched_getaffinity(pid_t pid, struct cpumask *mask);
 
+#ifdef CONFIG_SCHED_WALT
+extern int sched_set_group_id(struct task_struct *p, unsigned int group_id);
+extern unsigned int sched_get_group_id(struct task_struct *p);
+#else
+static inline int sched_set_group_id(struct task_struct *p,
+				     unsigned int group_id)
+{
+	return group_id ? -EINVAL : 0;
+}
+
+static inline unsigned int sched_get_group_id(struct task_struct *p)
+{
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_CGROUP_SCHED
 extern struct task_group root_task_group;
 #endif /* CONFIG_CGROUP_SCHED */
@@ -239,6 +239,9 @@ struct swap_info_struct {
 #ifdef CONFIG_FRONTSWAP
 	unsigned long *frontswap_map;	/* frontswap in-use, one bit per page */
 	atomic_t frontswap_pages;	/* frontswap pages in-use counter */
+#endif
+#ifdef CONFIG_PROCESS_RECLAIM
+	unsigned long *reclaim_map;	/* swapped out by process reclaim */
 #endif
 	spinlock_t lock;		/*
 					 * protect map scan related fields like
@@ -258,6 +261,9 @@ struct swap_info_struct {
 	struct swap_cluster_info discard_cluster_tail; /* list tail of discard clusters */
 	unsigned int write_pending;
 	unsigned int max_writes;
+	unsigned long write_lat;	/* write latency average, in ns */
+	unsigned long nr_writes;	/* writes sampled into write_lat */
+	unsigned int compr_ratio;	/* stored/compressed size, percent */
 };
 
 /* linux/mm/workingset.c */
@@ -343,6 +349,7 @@ extern unsigned long shrink_all_memory(unsigned long nr_pages);
 extern int vm_swappiness;
 extern int sysctl_swap_ratio;
 extern int sysctl_swap_ratio_enable;
+extern int sysctl_swap_ratio_adaptive;
 extern int remove_mapping(struct address_space *mapping, struct page *page);
 extern unsigned long vm_total_pages;
 
@@ -458,6 +465,10 @@ extern int swp_swapcount(swp_entry_t entry);
 extern struct swap_info_struct *page_swap_info(struct page *);
 extern int reuse_swap_page(struct page *);
 extern int try_to_free_swap(struct page *);
+#ifdef CONFIG_PROCESS_RECLAIM
+extern void swap_mark_reclaimed(swp_entry_t entry);
+extern bool swap_test_clear_reclaimed(swp_entry_t entry);
+#endif
 struct backing_dev_info;
 
 #ifdef CONFIG_MEMCG
@@ -568,6 +579,17 @@ static inline int try_to_free_swap(struct page *page)
 	return 0;
 }
 
+#ifdef CONFIG_PROCESS_RECLAIM
+static inline void swap_mark_reclaimed(swp_entry_t entry)
+{
+}
+
+static inline bool swap_test_clear_reclaimed(swp_entry_t entry)
+{
+	return false;
+}
+#endif
+
 static inline swp_entry_t get_swap_page(void)
 {
 	swp_entry_t entry;
@@ -14,5 +14,7 @@ extern int try_to_unuse(unsigned int, bool, unsigned long);
 extern int swap_ratio(struct swap_info_struct **si);
 extern void setup_swap_ratio(struct swap_info_struct *p, int prio);
 extern bool is_swap_ratio_group(int prio);
+extern bool swap_ratio_sample(struct swap_info_struct *si);
+extern void swap_ratio_account_write(struct swap_info_struct *si, u64 lat_ns);
 
 #endif /* _LINUX_SWAPFILE_H */
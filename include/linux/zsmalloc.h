@@ -47,6 +47,7 @@ void *zs_map_object(struct zs_pool *pool, unsigned long handle,
 void zs_unmap_object(struct zs_pool *pool, unsigned long handle);
 
 unsigned long zs_get_total_pages(struct zs_pool *pool);
+size_t zs_huge_class_size(struct zs_pool *pool);
 unsigned long zs_compact(struct zs_pool *pool);
 
 #endif
@@ -220,6 +220,48 @@ TRACE_EVENT(mm_page_alloc,
 		show_gfp_flags(__entry->gfp_flags))
 );
 
+TRACE_EVENT(mm_page_alloc_slowpath,
+
+	TP_PROTO(unsigned int order, gfp_t gfp_flags, u64 total_ns,
+		u64 reclaim_ns, u64 compact_ns, u64 retry_ns,
+		unsigned int retries, bool success),
+
+	TP_ARGS(order, gfp_flags, total_ns, reclaim_ns, compact_ns, retry_ns,
+		retries, success),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	order		)
+		__field(	gfp_t,		gfp_flags	)
+		__field(	u64,		total_ns	)
+		__field(	u64,		reclaim_ns	)
+		__field(	u64,		compact_ns	)
+		__field(	u64,		retry_ns	)
+		__field(	unsigned int,	retries		)
+		__field(	bool,		success		)
+	),
+
+	TP_fast_assign(
+		__entry->order		= order;
+		__entry->gfp_flags	= gfp_flags;
+		__entry->total_ns	= total_ns;
+		__entry->reclaim_ns	= reclaim_ns;
+		__entry->compact_ns	= compact_ns;
+		__entry->retry_ns	= retry_ns;
+		__entry->retries	= retries;
+		__entry->success	= success;
+	),
+
+	TP_printk("order=%u total_ns=%llu reclaim_ns=%llu compact_ns=%llu retry_ns=%llu retries=%u success=%d gfp_flags=%s",
+		__entry->order,
+		__entry->total_ns,
+		__entry->reclaim_ns,
+		__entry->compact_ns,
+		__entry->retry_ns,
+		__entry->retries,
+		__entry->success,
+		show_gfp_flags(__entry->gfp_flags))
+);
+
 DECLARE_EVENT_CLASS(mm_page,
 
 	TP_PROTO(struct page *page, unsigned int order, int migratetype),
@@ -426,6 +468,110 @@ DEFINE_EVENT(ion_alloc_error, ion_alloc_buffer_fail,
 	TP_ARGS(client_name, heap_name, len, mask, flags, error)
 );
 
+/*
+ * nr_small, nr_mid and nr_large count the chunks of order [0, 4),
+ * [4, 8) and 8 or higher that make up the buffer.
+ */
+TRACE_EVENT(ion_buffer_alloc,
+
+	TP_PROTO(const char *client_name,
+		 const char *heap_name,
+		 size_t len,
+		 unsigned int flags,
+		 u64 latency_ns,
+		 unsigned int nr_small,
+		 unsigned int nr_mid,
+		 unsigned int nr_large),
+
+	TP_ARGS(client_name, heap_name, len, flags, latency_ns,
+		nr_small, nr_mid, nr_large),
+
+	TP_STRUCT__entry(
+		__array(char,		client_name, 64)
+		__field(const char *,	heap_name)
+		__field(size_t,		len)
+		__field(unsigned int,	flags)
+		__field(u64,		latency_ns)
+		__field(unsigned int,	nr_small)
+		__field(unsigned int,	nr_mid)
+		__field(unsigned int,	nr_large)
+	),
+
+	TP_fast_assign(
+		strlcpy(__entry->client_name, client_name, 64);
+		__entry->heap_name	= heap_name;
+		__entry->len		= len;
+		__entry->flags		= flags;
+		__entry->latency_ns	= latency_ns;
+		__entry->nr_small	= nr_small;
+		__entry->nr_mid		= nr_mid;
+		__entry->nr_large	= nr_large;
+	),
+
+	TP_printk("client_name=%s heap_name=%s len=%zu flags=0x%x latency_ns=%llu nr_small=%u nr_mid=%u nr_large=%u",
+		__entry->client_name,
+		__entry->heap_name,
+		__entry->len,
+		__entry->flags,
+		__entry->latency_ns,
+		__entry->nr_small,
+		__entry->nr_mid,
+		__entry->nr_large)
+);
+
+DECLARE_EVENT_CLASS(ion_buffer_op,
+
+	TP_PROTO(const char *heap_name,
+		 size_t len,
+		 u64 latency_ns),
+
+	TP_ARGS(heap_name, len, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(const char *,	heap_name)
+		__field(size_t,		len)
+		__field(u64,		latency_ns)
+	),
+
+	TP_fast_assign(
+		__entry->heap_name	= heap_name;
+		__entry->len		= len;
+		__entry->latency_ns	= latency_ns;
+	),
+
+	TP_printk("heap_name=%s len=%zu latency_ns=%llu",
+		__entry->heap_name,
+		__entry->len,
+		__entry->latency_ns)
+);
+
+DEFINE_EVENT(ion_buffer_op, ion_buffer_free,
+
+	TP_PROTO(const char *heap_name,
+		 size_t len,
+		 u64 latency_ns),
+
+	TP_ARGS(heap_name, len, latency_ns)
+);
+
+DEFINE_EVENT(ion_buffer_op, ion_buffer_map_kernel,
+
+	TP_PROTO(const char *heap_name,
+		 size_t len,
+		 u64 latency_ns),
+
+	TP_ARGS(heap_name, len, latency_ns)
+);
+
+DEFINE_EVENT(ion_buffer_op, ion_buffer_map_user,
+
+	TP_PROTO(const char *heap_name,
+		 size_t len,
+		 u64 latency_ns),
+
+	TP_ARGS(heap_name, len, latency_ns)
+);
+
 
 DECLARE_EVENT_CLASS(alloc_retry,
 
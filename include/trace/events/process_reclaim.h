@@ -59,6 +59,35 @@ TRACE_EVENT(process_reclaim,
 			__entry->nr_to_reclaim)
 );
 
+TRACE_EVENT(process_reclaim_ws,
+
+	TP_PROTO(pid_t pid, int cold_estimate, int nr_hot, int nr_cold,
+		int nr_reclaimed),
+
+	TP_ARGS(pid, cold_estimate, nr_hot, nr_cold, nr_reclaimed),
+
+	TP_STRUCT__entry(
+		__field(pid_t, pid)
+		__field(int, cold_estimate)
+		__field(int, nr_hot)
+		__field(int, nr_cold)
+		__field(int, nr_reclaimed)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= pid;
+		__entry->cold_estimate	= cold_estimate;
+		__entry->nr_hot		= nr_hot;
+		__entry->nr_cold	= nr_cold;
+		__entry->nr_reclaimed	= nr_reclaimed;
+	),
+
+	TP_printk("pid=%d cold_estimate=%d hot=%d cold=%d reclaimed=%d",
+			__entry->pid, __entry->cold_estimate,
+			__entry->nr_hot, __entry->nr_cold,
+			__entry->nr_reclaimed)
+);
+
 TRACE_EVENT(process_reclaim_eff,
 
 	TP_PROTO(int efficiency, int reclaim_avg_efficiency),
@@ -826,6 +826,31 @@ TRACE_EVENT(sched_tune_boostgroup_update,
 		__entry->cpu, __entry->variation, __entry->max_boost)
 );
 
+/*
+ * Tracepoint for schedtune_cpu_update_clamp
+ */
+TRACE_EVENT(sched_tune_clamp_update,
+
+	TP_PROTO(int cpu, unsigned long util_min, unsigned long util_max),
+
+	TP_ARGS(cpu, util_min, util_max),
+
+	TP_STRUCT__entry(
+		__field( int,		cpu		)
+		__field( unsigned long,	util_min	)
+		__field( unsigned long,	util_max	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->util_min	= util_min;
+		__entry->util_max	= util_max;
+	),
+
+	TP_printk("cpu=%d util_min=%lu util_max=%lu",
+		__entry->cpu, __entry->util_min, __entry->util_max)
+);
+
 /*
  * Tracepoint for accounting task boosted utilization
  */
@@ -1072,6 +1097,78 @@ TRACE_EVENT(walt_update_history,
 		__entry->hist[4], __entry->cpu)
 );
 
+/*
+ * Tracepoint for comparing the demand WALT predicted for a task with the
+ * runtime it actually accumulated once that window is over. 'demand' is
+ * the estimate the non-predictive path used for the same window.
+ */
+TRACE_EVENT(walt_pred_demand,
+
+	TP_PROTO(struct rq *rq, struct task_struct *p, u32 predicted,
+		 u32 actual),
+
+	TP_ARGS(rq, p, predicted, actual),
+
+	TP_STRUCT__entry(
+		__array(	char,	comm,   TASK_COMM_LEN	)
+		__field(	pid_t,	pid			)
+		__field(	 int,	cpu			)
+		__field(unsigned int,	predicted		)
+		__field(unsigned int,	actual			)
+		__field(unsigned int,	demand			)
+		__field(	 s64,	error			)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, p->comm, TASK_COMM_LEN);
+		__entry->pid		= p->pid;
+		__entry->cpu		= rq->cpu;
+		__entry->predicted	= predicted;
+		__entry->actual		= actual;
+		__entry->demand		= p->ravg.demand;
+		__entry->error		= (s64)predicted - actual;
+	),
+
+	TP_printk("%d (%s): cpu %d predicted %u actual %u demand %u error %lld",
+		__entry->pid, __entry->comm, __entry->cpu,
+		__entry->predicted, __entry->actual, __entry->demand,
+		__entry->error)
+);
+
+/*
+ * Tracepoint for the top task histogram of a CPU at the end of a window.
+ * hist[i] counts the tasks whose busy time in the window fell in bucket i.
+ */
+TRACE_EVENT(walt_top_tasks,
+
+	TP_PROTO(struct rq *rq, u16 *hist, u32 top_load),
+
+	TP_ARGS(rq, hist, top_load),
+
+	TP_STRUCT__entry(
+		__field(	 int,	cpu			)
+		__field(	 u64,	win_start		)
+		__field(	 u64,	cs			)
+		__field(	 u32,	top_load		)
+		__array(	 u16,	hist, WALT_NR_TOP_BUCKETS)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= rq->cpu;
+		__entry->win_start	= rq->window_start;
+		__entry->cs		= rq->curr_runnable_sum;
+		__entry->top_load	= top_load;
+		memcpy(__entry->hist, hist,
+		       WALT_NR_TOP_BUCKETS * sizeof(u16));
+	),
+
+	TP_printk("cpu %d ws %llu cs %llu top_load %u hist %s",
+		__entry->cpu, __entry->win_start, __entry->cs,
+		__entry->top_load,
+		__print_array(__entry->hist, WALT_NR_TOP_BUCKETS,
+			      sizeof(u16)))
+);
+
 TRACE_EVENT(walt_migration_update_sum,
 
 	TP_PROTO(struct rq *rq, struct task_struct *p),
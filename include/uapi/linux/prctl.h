@@ -195,4 +195,11 @@ struct prctl_mm_map {
 # define PR_CAP_AMBIENT_LOWER		3
 # define PR_CAP_AMBIENT_CLEAR_ALL	4
 
+/*
+ * Let KSM merge all anonymous memory of the process, inherited across
+ * fork and exec
+ */
+#define PR_SET_MEMORY_MERGE		67
+#define PR_GET_MEMORY_MERGE		68
+
 #endif /* _LINUX_PRCTL_H */
@@ -733,6 +733,7 @@ void do_exit(long code)
 	exit_signals(tsk);  /* sets PF_EXITING */
 
 	schedtune_exit_task(tsk);
+	sched_set_group_id(tsk, 0);
 
 	if (tsk->flags & PF_SU) {
 		su_exit();
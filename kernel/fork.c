@@ -595,6 +595,16 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 #if defined(CONFIG_TRANSPARENT_HUGEPAGE) && !USE_SPLIT_PMD_PTLOCKS
 	mm->pmd_huge_pte = NULL;
 #endif
+#ifdef CONFIG_PROCESS_RECLAIM
+	mm->reclaim_hot = 0;
+	mm->reclaim_cold = 0;
+	atomic_long_set(&mm->reclaim_reclaimed, 0);
+	atomic_long_set(&mm->reclaim_refaults, 0);
+#endif
+#ifdef CONFIG_KSM
+	mm->ksm_rmap_items = 0;
+	mm->ksm_merging_pages = 0;
+#endif
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
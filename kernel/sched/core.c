@@ -74,6 +74,7 @@
 #include <linux/binfmts.h>
 #include <linux/context_tracking.h>
 #include <linux/compiler.h>
+#include <linux/sched_energy.h>
 
 #include <asm/switch_to.h>
 #include <asm/tlb.h>
@@ -951,16 +952,20 @@ static void set_load_weight(struct task_struct *p)
 static inline void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_rq_clock(rq);
-	if (!(flags & ENQUEUE_RESTORE))
+	if (!(flags & ENQUEUE_RESTORE)) {
 		sched_info_queued(rq, p);
+		psi_enqueue(p, flags & ENQUEUE_WAKEUP);
+	}
 	p->sched_class->enqueue_task(rq, p, flags);
 }
 
 static inline void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_rq_clock(rq);
-	if (!(flags & DEQUEUE_SAVE))
+	if (!(flags & DEQUEUE_SAVE)) {
 		sched_info_dequeued(rq, p);
+		psi_dequeue(p, flags & DEQUEUE_SLEEP);
+	}
 	p->sched_class->dequeue_task(rq, p, flags);
 }
 
@@ -2054,6 +2059,7 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags,
 			     sibling_count_hint);
 	if (task_cpu(p) != cpu) {
 		wake_flags |= WF_MIGRATED;
+		psi_ttwu_dequeue(p);
 		set_task_cpu(p, cpu);
 	}
 
@@ -2166,6 +2172,15 @@ static void __sched_fork(unsigned long clone_flags, struct task_struct *p)
 	p->se.vruntime			= 0;
 #ifdef CONFIG_SCHED_WALT
 	p->last_sleep_ts		= 0;
+	/* Related thread groups are not inherited */
+	p->grp				= NULL;
+	INIT_LIST_HEAD(&p->grp_list);
+#endif
+#ifdef CONFIG_PSI
+	/* the parent's pressure state isn't inherited */
+	p->psi_flags			= 0;
+	p->sched_psi_wake_requeue	= 0;
+	p->in_memstall			= 0;
 #endif
 
 	INIT_LIST_HEAD(&p->se.group_node);
@@ -5400,6 +5415,28 @@ set_table_entry(struct ctl_table *entry,
 	}
 }
 
+/*
+ * Writes to the capacity states invalidate the lookup table used by
+ * find_new_capacity(), rebuild it from the new values.
+ */
+static int sd_energy_cap_handler(struct ctl_table *table, int write,
+				 void __user *buffer, size_t *lenp,
+				 loff_t *ppos)
+{
+	struct sched_group_energy *sge = table->extra1;
+	int ret;
+
+	if (table->maxlen == sizeof(int))
+		ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	else
+		ret = proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
+
+	if (!ret && write)
+		sched_energy_build_cap_lut(sge);
+
+	return ret;
+}
+
 static struct ctl_table *
 sd_alloc_ctl_energy_table(struct sched_group_energy *sge)
 {
@@ -5414,10 +5451,12 @@ sd_alloc_ctl_energy_table(struct sched_group_energy *sge)
 			sge->nr_idle_states*sizeof(struct idle_state), 0644,
 			proc_doulongvec_minmax, false);
 	set_table_entry(&table[2], "nr_cap_states", &sge->nr_cap_states,
-			sizeof(int), 0644, proc_dointvec_minmax, false);
+			sizeof(int), 0644, sd_energy_cap_handler, false);
+	table[2].extra1 = sge;
 	set_table_entry(&table[3], "cap_states", &sge->cap_states[0].cap,
 			sge->nr_cap_states*sizeof(struct capacity_state), 0644,
-			proc_doulongvec_minmax, false);
+			sd_energy_cap_handler, false);
+	table[3].extra1 = sge;
 
 	return table;
 }
@@ -6502,6 +6541,7 @@ static void init_sched_energy(int cpu, struct sched_domain *sd,
 	check_sched_energy_data(cpu, fn, sched_group_cpus(sd->groups));
 
 	sd->groups->sge = fn(cpu);
+	sched_energy_build_cap_lut((struct sched_group_energy *)sd->groups->sge);
 }
 
 /*
@@ -7714,6 +7754,8 @@ void __init sched_init(void)
 #endif
 	init_sched_fair_class();
 
+	psi_init();
+
 	scheduler_running = 1;
 }
 
@@ -34,6 +34,7 @@ struct sugov_tunables {
 	unsigned int up_rate_limit_us;
 	unsigned int down_rate_limit_us;
 	bool iowait_boost_enable;
+	bool predictive;
 };
 
 struct sugov_policy {
@@ -218,6 +219,30 @@ static void sugov_get_util(unsigned long *util, unsigned long *max, u64 time)
 	*max = max_cap;
 }
 
+/*
+ * In predictive mode, request the capacity WALT forecasts the runnable
+ * tasks will need in the next window when that exceeds the current
+ * utilization, so that frequency ramps ahead of a burst instead of one
+ * window behind it.
+ */
+static void sugov_walt_predict(struct sugov_cpu *sg_cpu, unsigned long *util,
+			       unsigned long max)
+{
+#ifdef CONFIG_SCHED_WALT
+	unsigned long pred;
+
+	if (!sg_cpu->sg_policy->tunables->predictive || use_pelt())
+		return;
+
+	pred = min(cpu_pred_util(smp_processor_id()), max);
+	/* The forecast must not lift the CPU above its schedtune cap */
+	pred = min_t(unsigned long, pred,
+		     schedtune_cpu_util_max(smp_processor_id()));
+	if (pred > *util)
+		*util = pred;
+#endif
+}
+
 static void sugov_set_iowait_boost(struct sugov_cpu *sg_cpu, u64 time,
 				   unsigned int flags)
 {
@@ -321,6 +346,7 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 		next_f = policy->cpuinfo.max_freq;
 	} else {
 		sugov_get_util(&util, &max, time);
+		sugov_walt_predict(sg_cpu, &util, max);
 		sugov_iowait_boost(sg_cpu, &util, &max);
 		next_f = get_next_freq(sg_policy, util, max);
 		/*
@@ -387,6 +413,7 @@ static void sugov_update_shared(struct update_util_data *hook, u64 time,
 	unsigned int next_f;
 
 	sugov_get_util(&util, &max, time);
+	sugov_walt_predict(sg_cpu, &util, max);
 
 	raw_spin_lock(&sg_policy->update_lock);
 
@@ -553,14 +580,37 @@ static ssize_t iowait_boost_enable_store(struct gov_attr_set *attr_set,
 	return count;
 }
 
+static ssize_t predictive_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return sprintf(buf, "%u\n", tunables->predictive);
+}
+
+static ssize_t predictive_store(struct gov_attr_set *attr_set,
+				const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	tunables->predictive = enable;
+
+	return count;
+}
+
 static struct governor_attr up_rate_limit_us = __ATTR_RW(up_rate_limit_us);
 static struct governor_attr down_rate_limit_us = __ATTR_RW(down_rate_limit_us);
 static struct governor_attr iowait_boost_enable = __ATTR_RW(iowait_boost_enable);
+static struct governor_attr predictive = __ATTR_RW(predictive);
 
 static struct attribute *sugov_attributes[] = {
 	&up_rate_limit_us.attr,
 	&down_rate_limit_us.attr,
 	&iowait_boost_enable.attr,
+	&predictive.attr,
 	NULL
 };
 
@@ -46,6 +46,33 @@ static void free_resources(void)
 	}
 }
 
+/*
+ * Precompute, for every utilization bucket, the first capacity state whose
+ * capacity covers the bucket's lower bound. find_new_capacity() starts its
+ * search from there instead of from the lowest OPP, which on wakeup heavy
+ * workloads avoids walking the whole table for each candidate CPU.
+ *
+ * cap_states are expected in ascending capacity order. The search is only
+ * exact while no entry exceeds the first index fitting its bucket: entries
+ * saturated at U8_MAX merely cost extra iterations, but a stale entry left
+ * over from larger capacities skips states that now fit and selects a
+ * higher OPP. The table must therefore be rebuilt whenever cap_states
+ * changes, unless capacities only grew.
+ */
+void sched_energy_build_cap_lut(struct sched_group_energy *sge)
+{
+	int max_idx = sge->nr_cap_states - 1;
+	unsigned long util;
+	int bucket, idx = 0;
+
+	for (bucket = 0; bucket < SGE_CAP_LUT_SIZE; bucket++) {
+		util = (unsigned long)bucket << SGE_CAP_LUT_SHIFT;
+		while (idx < max_idx && sge->cap_states[idx].cap < util)
+			idx++;
+		sge->cap_lut[bucket] = min_t(int, idx, U8_MAX);
+	}
+}
+
 void init_sched_energy_costs(void)
 {
 	struct device_node *cn, *cp;
@@ -94,6 +121,7 @@ void init_sched_energy_costs(void)
 
 			sge->nr_cap_states = nstates;
 			sge->cap_states = cap_states;
+			sched_energy_build_cap_lut(sge);
 
 			prop = of_find_property(cp, "idle-cost-data", NULL);
 			if (!prop || !prop->value) {
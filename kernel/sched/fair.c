@@ -5283,14 +5283,22 @@ long group_norm_util(struct energy_env *eenv, int cpu_idx)
 static int find_new_capacity(struct energy_env *eenv, int cpu_idx)
 {
 	const struct sched_group_energy *sge = eenv->sg->sge;
-	int idx, max_idx = sge->nr_cap_states - 1;
+	int idx = 0, max_idx = sge->nr_cap_states - 1;
 	unsigned long util = group_max_util(eenv, cpu_idx);
+	unsigned long bucket;
 
 	/* default is max_cap if we don't find a match */
 	eenv->cpu[cpu_idx].cap_idx = max_idx;
 	eenv->cpu[cpu_idx].cap = sge->cap_states[max_idx].cap;
 
-	for (idx = 0; idx < sge->nr_cap_states; idx++) {
+	/* Skip the capacity states which cannot fit util's bucket */
+	if (sched_feat(ENERGY_CAP_LUT)) {
+		bucket = min_t(unsigned long, util >> SGE_CAP_LUT_SHIFT,
+			       SGE_CAP_LUT_SIZE - 1);
+		idx = min_t(int, sge->cap_lut[bucket], max_idx);
+	}
+
+	for (; idx < sge->nr_cap_states; idx++) {
 		if (sge->cap_states[idx].cap >= util) {
 			/* Keep track of SG's capacity */
 			eenv->cpu[cpu_idx].cap_idx = idx;
@@ -5834,7 +5842,10 @@ boosted_cpu_util(int cpu)
 
 	trace_sched_boost_cpu(cpu, util, margin);
 
-	return util + margin;
+	/* Clamp to the util_min/util_max of the groups RUNNABLE on the CPU */
+	return clamp_t(unsigned long, util + margin,
+		       schedtune_cpu_util_min(cpu),
+		       schedtune_cpu_util_max(cpu));
 }
 
 static inline unsigned long
@@ -5845,7 +5856,9 @@ boosted_task_util(struct task_struct *p)
 
 	trace_sched_boost_task(p, util, margin);
 
-	return util + margin;
+	return clamp_t(unsigned long, util + margin,
+		       schedtune_task_util_min(p),
+		       schedtune_task_util_max(p));
 }
 
 static unsigned long capacity_spare_wake(int cpu, struct task_struct *p)
@@ -6200,10 +6213,76 @@ static int start_cpu(bool boosted)
 	return boosted ? rd->max_cap_orig_cpu : rd->min_cap_orig_cpu;
 }
 
+#ifdef CONFIG_SCHED_WALT
+/*
+ * Pick the cluster a related thread group should run on: the one with the
+ * smallest capacity that fits the combined demand of the group, or the
+ * biggest one if none does. Returns the CPUs of that cluster, or NULL if
+ * @p is not in a group. Must be called under rcu_read_lock().
+ */
+static const struct cpumask *related_thread_group_cpus(struct task_struct *p)
+{
+	struct related_thread_group *grp = READ_ONCE(p->grp);
+	const struct cpumask *best = NULL, *biggest = NULL;
+	unsigned long best_cap = ULONG_MAX, biggest_cap = 0;
+	unsigned long util;
+	int cpu;
+
+	if (!grp || walt_disabled)
+		return NULL;
+
+	util = walt_group_util(grp);
+
+	for_each_cpu(cpu, tsk_cpus_allowed(p)) {
+		struct sched_domain *sd = rcu_dereference(per_cpu(sd_llc, cpu));
+		const struct cpumask *span;
+		unsigned long cap;
+
+		if (!sd)
+			continue;
+
+		/* Look at each cluster once, through its first allowed CPU */
+		span = sched_domain_span(sd);
+		if (cpu != cpumask_first_and(span, tsk_cpus_allowed(p)))
+			continue;
+		if (!cpumask_intersects(span, cpu_online_mask))
+			continue;
+
+		cap = capacity_orig_of(cpu);
+		if (cap > biggest_cap) {
+			biggest_cap = cap;
+			biggest = span;
+		}
+		if (util * capacity_margin > cap * SCHED_CAPACITY_SCALE)
+			continue;
+		if (cap < best_cap) {
+			best_cap = cap;
+			best = span;
+		}
+	}
+
+	if (!best)
+		best = biggest;
+	if (best)
+		WRITE_ONCE(grp->preferred_cpu, cpumask_first(best));
+
+	return best;
+}
+#else
+static inline const struct cpumask *
+related_thread_group_cpus(struct task_struct *p)
+{
+	return NULL;
+}
+#endif
+
 static inline int find_best_target(struct task_struct *p, int *backup_cpu,
-				   bool boosted, bool prefer_idle)
+				   bool boosted, bool prefer_idle,
+				   const struct cpumask *grp_cpus)
 {
 	unsigned long min_util = boosted_task_util(p);
+	unsigned long task_util_capped = min_t(unsigned long, task_util(p),
+					       schedtune_task_util_max(p));
 	unsigned long target_capacity = ULONG_MAX;
 	unsigned long min_wake_util = ULONG_MAX;
 	unsigned long target_max_spare_cap = 0;
@@ -6248,6 +6327,10 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 			if (!cpu_online(i))
 				continue;
 
+			/* Keep related threads on the cluster of their group */
+			if (grp_cpus && !cpumask_test_cpu(i, grp_cpus))
+				continue;
+
 			if (walt_cpu_high_irqload(i))
 				continue;
 
@@ -6257,7 +6340,7 @@ static inline int find_best_target(struct task_struct *p, int *backup_cpu,
 			 * accounting. However, the blocked utilization may be zero.
 			 */
 			wake_util = cpu_util_wake(i, p);
-			new_util = wake_util + task_util(p);
+			new_util = wake_util + task_util_capped;
 
 			/*
 			 * Ensure minimum capacity to grant the required boost.
@@ -6505,6 +6588,7 @@ static int wake_cap(struct task_struct *p, int cpu, int prev_cpu)
 static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync)
 {
 	bool boosted, prefer_idle;
+	const struct cpumask *grp_cpus;
 	struct sched_domain *sd;
 	int target_cpu;
 	int backup_cpu;
@@ -6541,8 +6625,17 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 
 	sync_entity_load_avg(&p->se);
 
+	grp_cpus = related_thread_group_cpus(p);
+
 	/* Find a cpu with sufficient capacity */
-	next_cpu = find_best_target(p, &backup_cpu, boosted, prefer_idle);
+	next_cpu = find_best_target(p, &backup_cpu, boosted, prefer_idle,
+				    grp_cpus);
+	if (next_cpu == -1 && grp_cpus) {
+		/* Nothing fits on the group's cluster, look everywhere */
+		grp_cpus = NULL;
+		next_cpu = find_best_target(p, &backup_cpu, boosted,
+					    prefer_idle, NULL);
+	}
 	if (next_cpu == -1) {
 		target_cpu = prev_cpu;
 		goto unlock;
@@ -6556,6 +6649,12 @@ static int select_energy_cpu_brute(struct task_struct *p, int prev_cpu, int sync
 		goto unlock;
 	}
 
+	/* Join the rest of the group whatever the energy cost */
+	if (grp_cpus && !cpumask_test_cpu(prev_cpu, grp_cpus)) {
+		target_cpu = next_cpu;
+		goto unlock;
+	}
+
 	target_cpu = prev_cpu;
 	if (next_cpu != prev_cpu) {
 		int delta = 0;
@@ -112,6 +112,12 @@ SCHED_FEAT(ENERGY_AWARE, false)
  */
 SCHED_FEAT(MIN_CAPACITY_CAPPING, false)
 
+/*
+ * Seed the capacity state search of energy_diff computations from the
+ * per-group lookup table instead of scanning from the lowest OPP.
+ */
+SCHED_FEAT(ENERGY_CAP_LUT, true)
+
 /*
  * Enforce the priority of candidates selected by find_best_target()
  * ON: If the target CPU saves any energy, use that.
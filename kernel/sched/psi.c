@@ -0,0 +1,921 @@
+/*
+ * Pressure stall information for CPU, memory and IO
+ *
+ * When CPU, memory and IO are contended, tasks experience delays that
+ * reduce throughput and introduce latencies into the workload. Memory
+ * and IO contention, in addition, can cause a full loss of forward
+ * progress in which the CPU goes idle.
+ *
+ * This code aggregates individual task delays into resource pressure
+ * metrics that indicate problems with both workload health and
+ * resource utilization.
+ *
+ *			Model
+ *
+ * The time in which a task can execute on a CPU is our baseline for
+ * productivity. Pressure expresses the amount of time in which this
+ * potential cannot be realized due to resource contention.
+ *
+ * This concept of productivity has two components: the workload and
+ * the CPU. To measure the impact of pressure on both, we define two
+ * contention states for a resource: SOME and FULL.
+ *
+ * In the SOME state of a given resource, one or more tasks are
+ * delayed on that resource. This affects the workload's ability to
+ * perform work, but the CPU may still be executing other tasks.
+ *
+ * In the FULL state of a given resource, all non-idle tasks are
+ * delayed on that resource such that nobody is advancing and the CPU
+ * goes idle. This leaves both workload and CPU unproductive.
+ *
+ * (Naturally, the FULL state doesn't exist for the CPU resource.)
+ *
+ *	SOME = nr_delayed_tasks != 0
+ *	FULL = nr_delayed_tasks != 0 && nr_running_tasks == 0
+ *
+ * The states are tracked per CPU, as the ratio of the time a CPU spent
+ * in them, and the per-CPU ratios are combined weighted by the non-idle
+ * time of each CPU.
+ *
+ * Tasks are stalled on memory while they are in direct reclaim or
+ * direct compaction, or while they wait for a page that
+ * workingset_refault() found to be thrashing. They are stalled on IO
+ * while they sleep in io_schedule(), and on the CPU while they are
+ * runnable but another task is running.
+ *
+ * The totals and 10s/60s/300s running averages of each state are
+ * reported in /proc/pressure/{cpu,memory,io}. Writing
+ * "<some|full> <threshold us> <window us>" to one of those files arms a
+ * trigger that makes poll() on the file return POLLPRI whenever the
+ * stall time within the window exceeds the threshold.
+ */
+
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/seqlock.h>
+#include <linux/uaccess.h>
+#include <linux/ctype.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+#include <linux/psi.h>
+#include "sched.h"
+
+static int psi_bug __read_mostly;
+
+bool psi_disabled __read_mostly;
+
+static int __init setup_psi(char *str)
+{
+	bool enable;
+
+	if (kstrtobool(str, &enable))
+		return 0;
+
+	psi_disabled = !enable;
+	return 1;
+}
+__setup("psi=", setup_psi);
+
+/* Running averages - we need to be higher-res than loadavg */
+#define PSI_FREQ	(2*HZ+1)	/* 2 sec intervals */
+#define EXP_10s		1677		/* 1/exp(2s/10s) as fixed-point */
+#define EXP_60s		1981		/* 1/exp(2s/60s) */
+#define EXP_300s	2034		/* 1/exp(2s/300s) */
+
+#define LOAD_INT(x) ((x) >> FSHIFT)
+#define LOAD_FRAC(x) LOAD_INT(((x) & (FIXED_1-1)) * 100)
+
+/* After this many missed periods the averages have all decayed to 0 */
+#define PSI_MAX_MISSED	(300 * 10 / 2)
+
+/* Trigger windows, and how often triggers are checked per window */
+#define WINDOW_MIN_US		500000		/* Min window size is 500ms */
+#define WINDOW_MAX_US		10000000	/* Max window size is 10s */
+#define UPDATES_PER_WINDOW	10
+
+/* Sampling frequency in nanoseconds */
+static u64 psi_period __read_mostly;
+
+/* Workqueues are up, the aggregation works may be queued */
+static bool psi_ready __read_mostly;
+
+/* System-level pressure and stall tracking */
+static DEFINE_PER_CPU(struct psi_group_cpu, system_group_pcpu);
+static struct psi_group psi_system = {
+	.pcpu = &system_group_pcpu,
+};
+
+struct psi_window {
+	/* Window size in ns */
+	u64 size;
+
+	/* Start time of the current window in ns */
+	u64 start_time;
+
+	/* Value at the start of the window */
+	u64 start_value;
+
+	/* Value growth in the previous window */
+	u64 prev_growth;
+};
+
+struct psi_trigger {
+	/* PSI state being monitored by the trigger */
+	enum psi_states state;
+
+	/* User-specified threshold in ns */
+	u64 threshold;
+
+	/* List node inside the group's triggers list */
+	struct list_head node;
+
+	/* Tracking window */
+	struct psi_window win;
+
+	/* Event pending for poll(), and its waiters */
+	int event;
+	wait_queue_head_t event_wait;
+
+	/* Events are limited to one per window */
+	u64 last_event_time;
+};
+
+static void psi_avgs_work(struct work_struct *work);
+static void psi_poll_work(struct work_struct *work);
+
+static void group_init(struct psi_group *group)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		seqcount_init(&per_cpu_ptr(group->pcpu, cpu)->seq);
+	mutex_init(&group->avgs_lock);
+	group->avg_next_update = sched_clock() + psi_period;
+	INIT_DELAYED_WORK(&group->avgs_work, psi_avgs_work);
+	mutex_init(&group->trigger_lock);
+	INIT_LIST_HEAD(&group->triggers);
+	INIT_DELAYED_WORK(&group->poll_work, psi_poll_work);
+}
+
+void __init psi_init(void)
+{
+	if (psi_disabled)
+		return;
+
+	psi_period = jiffies_to_nsecs(PSI_FREQ);
+	group_init(&psi_system);
+}
+
+static bool test_state(unsigned int *tasks, enum psi_states state)
+{
+	switch (state) {
+	case PSI_IO_SOME:
+		return tasks[NR_IOWAIT];
+	case PSI_IO_FULL:
+		return tasks[NR_IOWAIT] && !tasks[NR_RUNNING];
+	case PSI_MEM_SOME:
+		return tasks[NR_MEMSTALL];
+	case PSI_MEM_FULL:
+		return tasks[NR_MEMSTALL] && !tasks[NR_RUNNING];
+	case PSI_CPU_SOME:
+		return tasks[NR_RUNNING] > 1;
+	case PSI_NONIDLE:
+		return tasks[NR_IOWAIT] || tasks[NR_MEMSTALL] ||
+			tasks[NR_RUNNING];
+	default:
+		return false;
+	}
+}
+
+/*
+ * Read the time each state spent on @cpu since the last call, including
+ * the state the CPU is in right now. Called with group->avgs_lock held.
+ */
+static void get_recent_times(struct psi_group *group, int cpu, u64 *times)
+{
+	struct psi_group_cpu *groupc = per_cpu_ptr(group->pcpu, cpu);
+	u64 now, state_start;
+	unsigned int seq;
+	u32 state_mask;
+	int s;
+
+	/* Snapshot a coherent view of the CPU state */
+	do {
+		seq = read_seqcount_begin(&groupc->seq);
+		now = cpu_clock(cpu);
+		memcpy(times, groupc->times, sizeof(groupc->times));
+		state_mask = groupc->state_mask;
+		state_start = groupc->state_start;
+	} while (read_seqcount_retry(&groupc->seq, seq));
+
+	/* Calculate state time deltas against the previous snapshot */
+	for (s = 0; s < NR_PSI_STATES; s++) {
+		u64 delta = 0;
+
+		/*
+		 * In addition to already concluded states, we also
+		 * incorporate currently active states on the CPU, since
+		 * states may last for many sampling periods.
+		 *
+		 * This way our reported pressure stays close to what's
+		 * actually happening.
+		 */
+		if ((state_mask & (1 << s)) && now > state_start)
+			times[s] += now - state_start;
+
+		if (times[s] > groupc->times_prev[s]) {
+			delta = times[s] - groupc->times_prev[s];
+			groupc->times_prev[s] = times[s];
+		}
+
+		times[s] = delta;
+	}
+}
+
+/*
+ * Fold the per-CPU state times into group->total. Returns false if all
+ * CPUs were idle. Called with group->avgs_lock held.
+ */
+static bool collect_percpu_times(struct psi_group *group)
+{
+	u64 deltas[NR_PSI_STATES - 1] = { 0, };
+	u64 nonidle_total = 0;
+	int cpu;
+	int s;
+
+	/*
+	 * Collect the per-cpu time buckets and average them into a
+	 * single time sample that is normalized to wallclock time.
+	 *
+	 * For averaging, each CPU is weighted by its non-idle time in
+	 * the sampling period. This eliminates artifacts from uneven
+	 * loading, or even entirely idle CPUs.
+	 */
+	for_each_possible_cpu(cpu) {
+		u64 times[NR_PSI_STATES];
+		u64 nonidle;
+
+		get_recent_times(group, cpu, times);
+
+		nonidle = div_u64(times[PSI_NONIDLE], NSEC_PER_USEC);
+		nonidle_total += nonidle;
+
+		for (s = 0; s < PSI_NONIDLE; s++)
+			deltas[s] += times[s] * nonidle;
+	}
+
+	/*
+	 * Integrate the sample into the running statistics that are
+	 * reported to userspace: the cumulative stall times and the
+	 * decaying averages.
+	 *
+	 * Pressure percentages are sampled at PSI_FREQ. We might be
+	 * called more often when the user polls more frequently than
+	 * that; we might be called less often when there is no task
+	 * activity, thus no data, and clock ticks are sporadic. The
+	 * below handles both.
+	 */
+	for (s = 0; s < NR_PSI_STATES - 1; s++)
+		group->total[s] += div64_u64(deltas[s],
+					max(nonidle_total, 1ULL));
+
+	return nonidle_total > 0;
+}
+
+static unsigned long calc_load(unsigned long load, unsigned long exp,
+			unsigned long active)
+{
+	load *= exp;
+	load += active * (FIXED_1 - exp);
+	load += 1UL << (FSHIFT - 1);
+	return load >> FSHIFT;
+}
+
+static void calc_avgs(unsigned long avg[3], int missed_periods,
+			u64 time, u64 period)
+{
+	unsigned long pct;
+
+	/* Fill in zeroes for periods of no activity */
+	if (missed_periods >= PSI_MAX_MISSED) {
+		avg[0] = avg[1] = avg[2] = 0;
+	} else {
+		while (missed_periods--) {
+			avg[0] = calc_load(avg[0], EXP_10s, 0);
+			avg[1] = calc_load(avg[1], EXP_60s, 0);
+			avg[2] = calc_load(avg[2], EXP_300s, 0);
+		}
+	}
+
+	/* Sample the most recent active period */
+	pct = div64_u64(time * 100, period);
+	pct *= FIXED_1;
+	avg[0] = calc_load(avg[0], EXP_10s, pct);
+	avg[1] = calc_load(avg[1], EXP_60s, pct);
+	avg[2] = calc_load(avg[2], EXP_300s, pct);
+}
+
+/* Returns the time of the next averages update. */
+static u64 update_averages(struct psi_group *group, u64 now)
+{
+	unsigned long missed_periods = 0;
+	u64 expires, period;
+	u64 avg_next_update;
+	int s;
+
+	/* avgX= */
+	expires = group->avg_next_update;
+	if (now - expires >= psi_period)
+		missed_periods = div64_u64(now - expires, psi_period);
+
+	/*
+	 * The periodic clock tick can get delayed for various
+	 * reasons, especially on loaded systems. To avoid clock
+	 * drift, we schedule the clock in fixed psi_period intervals.
+	 * But the deltas we sample out of the per-cpu buckets above
+	 * are based on the actual time elapsing between clock ticks.
+	 */
+	avg_next_update = expires + ((1 + missed_periods) * psi_period);
+	period = now - (group->avg_last_update + (missed_periods * psi_period));
+	group->avg_last_update = now;
+
+	for (s = 0; s < NR_PSI_STATES - 1; s++) {
+		u64 sample;
+
+		sample = group->total[s] - group->avg_total[s];
+		/*
+		 * Due to the lockless sampling of the time buckets,
+		 * recorded time deltas can slip into the next period,
+		 * which under full pressure can result in samples in
+		 * excess of the period length.
+		 *
+		 * We don't want to report non-sensical pressures in
+		 * excess of 100%, nor do we want to drop such events
+		 * on the floor. Instead we punt any overage into the
+		 * future until pressure subsides. By doing this we
+		 * don't underreport the occurring pressure curve, we
+		 * just report it delayed by one period length.
+		 *
+		 * The error isn't cumulative. As soon as another
+		 * delta slips from a period P to P+1, by definition
+		 * it frees up its time T in P.
+		 */
+		if (sample > period)
+			sample = period;
+		group->avg_total[s] += sample;
+		calc_avgs(group->avg[s], missed_periods, sample, period);
+	}
+
+	return avg_next_update;
+}
+
+static void psi_avgs_work(struct work_struct *work)
+{
+	struct delayed_work *dwork;
+	struct psi_group *group;
+	bool nonidle;
+	u64 now;
+
+	dwork = to_delayed_work(work);
+	group = container_of(dwork, struct psi_group, avgs_work);
+
+	mutex_lock(&group->avgs_lock);
+
+	now = sched_clock();
+
+	nonidle = collect_percpu_times(group);
+	if (now >= group->avg_next_update)
+		group->avg_next_update = update_averages(group, now);
+
+	/*
+	 * If there is task activity, periodically fold the per-cpu
+	 * times and feed samples into the running averages. If things
+	 * are idle and there is no data to process, stop the clock.
+	 * Once restarted, we'll catch up the running averages in one
+	 * go - see calc_avgs() and missed_periods.
+	 */
+	if (nonidle) {
+		schedule_delayed_work(dwork, nsecs_to_jiffies(
+				group->avg_next_update - now) + 1);
+	}
+
+	mutex_unlock(&group->avgs_lock);
+}
+
+static void window_reset(struct psi_window *win, u64 now, u64 value,
+			u64 prev_growth)
+{
+	win->start_time = now;
+	win->start_value = value;
+	win->prev_growth = prev_growth;
+}
+
+/*
+ * PSI growth tracking window update and growth calculation routine.
+ *
+ * This approximates a sliding tracking window by interpolating
+ * partially elapsed windows using historical growth data from the
+ * previous intervals. This minimizes memory requirements (by not storing
+ * all the intermediate values in the previous window) and simplifies
+ * the calculations. It works well because PSI signal changes only in
+ * positive direction and over relatively small window sizes the growth
+ * is close to linear.
+ */
+static u64 window_update(struct psi_window *win, u64 now, u64 value)
+{
+	u64 elapsed;
+	u64 growth;
+
+	elapsed = now - win->start_time;
+	growth = value - win->start_value;
+	/*
+	 * After each tracking window passes win->start_value and
+	 * win->start_time get reset and win->prev_growth stores
+	 * the average per-window growth of the previous window.
+	 * win->prev_growth is then used to interpolate additional
+	 * growth from the previous window assuming it was linear.
+	 */
+	if (elapsed > win->size) {
+		window_reset(win, now, value, growth);
+	} else {
+		u64 remaining;
+
+		/* in usecs, so that the product can't overflow */
+		remaining = div_u64(win->size - elapsed, NSEC_PER_USEC);
+		growth += div64_u64(win->prev_growth * remaining,
+				div_u64(win->size, NSEC_PER_USEC));
+	}
+
+	return growth;
+}
+
+static void psi_poll_work(struct work_struct *work)
+{
+	struct delayed_work *dwork;
+	struct psi_group *group;
+	struct psi_trigger *t;
+	u64 total[NR_PSI_STATES - 1];
+	u64 now;
+
+	dwork = to_delayed_work(work);
+	group = container_of(dwork, struct psi_group, poll_work);
+
+	mutex_lock(&group->trigger_lock);
+
+	mutex_lock(&group->avgs_lock);
+	now = sched_clock();
+	collect_percpu_times(group);
+	memcpy(total, group->total, sizeof(total));
+	mutex_unlock(&group->avgs_lock);
+
+	list_for_each_entry(t, &group->triggers, node) {
+		u64 growth;
+
+		growth = window_update(&t->win, now, total[t->state]);
+		if (growth < t->threshold)
+			continue;
+
+		/* Limit event signaling to once per window */
+		if (now < t->last_event_time + t->win.size)
+			continue;
+
+		/* Generate an event */
+		if (cmpxchg(&t->event, 0, 1) == 0)
+			wake_up_interruptible(&t->event_wait);
+		t->last_event_time = now;
+	}
+
+	if (!list_empty(&group->triggers))
+		schedule_delayed_work(dwork,
+			max(nsecs_to_jiffies(group->poll_min_period), 1UL));
+
+	mutex_unlock(&group->trigger_lock);
+}
+
+static void psi_group_change(struct psi_group *group, int cpu,
+			     unsigned int clear, unsigned int set)
+{
+	struct psi_group_cpu *groupc;
+	unsigned int t, m;
+	u32 state_mask = 0;
+	u64 now, delta;
+	int s;
+
+	groupc = per_cpu_ptr(group->pcpu, cpu);
+
+	/*
+	 * First we assess the aggregate resource states this CPU's
+	 * tasks have been in since the last change, and account any
+	 * SOME and FULL time these may have resulted in.
+	 *
+	 * Then we update the task counts according to the state
+	 * change requested through the @clear and @set bits.
+	 */
+	write_seqcount_begin(&groupc->seq);
+
+	now = cpu_clock(cpu);
+	delta = now - groupc->state_start;
+	groupc->state_start = now;
+
+	for (s = 0; s < NR_PSI_STATES; s++) {
+		if (groupc->state_mask & (1 << s))
+			groupc->times[s] += delta;
+	}
+
+	for (t = 0, m = clear; m; m &= ~(1 << t), t++) {
+		if (!(m & (1 << t)))
+			continue;
+		if (groupc->tasks[t] == 0 && !psi_bug) {
+			printk_deferred(KERN_ERR "psi: task underflow! cpu=%d t=%d tasks=[%u %u %u] clear=%x set=%x\n",
+					cpu, t, groupc->tasks[0],
+					groupc->tasks[1], groupc->tasks[2],
+					clear, set);
+			psi_bug = 1;
+		}
+		if (groupc->tasks[t])
+			groupc->tasks[t]--;
+	}
+
+	for (t = 0; set; set &= ~(1 << t), t++)
+		if (set & (1 << t))
+			groupc->tasks[t]++;
+
+	/* Calculate state mask representing active states */
+	for (s = 0; s < NR_PSI_STATES; s++) {
+		if (test_state(groupc->tasks, s))
+			state_mask |= (1 << s);
+	}
+	groupc->state_mask = state_mask;
+
+	write_seqcount_end(&groupc->seq);
+}
+
+/*
+ * Called with the runqueue of the task's CPU locked, whenever the task
+ * starts or stops running, waiting for IO or stalling on memory.
+ */
+void psi_task_change(struct task_struct *task, int clear, int set)
+{
+	int cpu = task_cpu(task);
+
+	if (!task->pid)
+		return;
+
+	if (((task->psi_flags & set) ||
+	     (task->psi_flags & clear) != clear) &&
+	    !psi_bug) {
+		printk_deferred(KERN_ERR "psi: inconsistent task state! task=%d:%s cpu=%d psi_flags=%x clear=%x set=%x\n",
+				task->pid, task->comm, cpu,
+				task->psi_flags, clear, set);
+		psi_bug = 1;
+	}
+
+	task->psi_flags &= ~clear;
+	task->psi_flags |= set;
+
+	psi_group_change(&psi_system, cpu, clear, set);
+
+	/*
+	 * Only a timer is armed here, which is safe under the runqueue
+	 * lock. The averages work stops itself once all CPUs are idle.
+	 */
+	if (psi_ready && !delayed_work_pending(&psi_system.avgs_work))
+		schedule_delayed_work(&psi_system.avgs_work, PSI_FREQ);
+}
+
+/**
+ * psi_memstall_enter - mark the beginning of a memory stall section
+ * @flags: flags to handle nested sections
+ *
+ * Marks the calling task as being stalled due to a lack of memory,
+ * such as waiting for a refault or performing reclaim.
+ */
+void psi_memstall_enter(unsigned long *flags)
+{
+	unsigned long irqflags;
+	struct rq *rq;
+
+	if (psi_disabled)
+		return;
+
+	*flags = current->in_memstall;
+	if (*flags)
+		return;
+	/*
+	 * in_memstall setting & accounting needs to be atomic wrt
+	 * changes to the task's scheduling state, otherwise we can
+	 * race with CPU migration.
+	 */
+	local_irq_save(irqflags);
+	rq = this_rq();
+	raw_spin_lock(&rq->lock);
+
+	current->in_memstall = 1;
+	psi_task_change(current, 0, TSK_MEMSTALL);
+
+	raw_spin_unlock(&rq->lock);
+	local_irq_restore(irqflags);
+}
+
+/**
+ * psi_memstall_leave - mark the end of a memory stall section
+ * @flags: flags to handle nested memdelay sections
+ *
+ * Marks the calling task as no longer stalled due to lack of memory.
+ */
+void psi_memstall_leave(unsigned long *flags)
+{
+	unsigned long irqflags;
+	struct rq *rq;
+
+	if (psi_disabled)
+		return;
+
+	if (*flags)
+		return;
+	/*
+	 * in_memstall clearing & accounting needs to be atomic wrt
+	 * changes to the task's scheduling state, otherwise we could
+	 * race with CPU migration.
+	 */
+	local_irq_save(irqflags);
+	rq = this_rq();
+	raw_spin_lock(&rq->lock);
+
+	current->in_memstall = 0;
+	psi_task_change(current, TSK_MEMSTALL, 0);
+
+	raw_spin_unlock(&rq->lock);
+	local_irq_restore(irqflags);
+}
+
+static int psi_show(struct seq_file *m, struct psi_group *group,
+		    enum psi_res res)
+{
+	int full;
+	u64 now;
+
+	if (psi_disabled)
+		return -EOPNOTSUPP;
+
+	/* Update averages before reporting them */
+	mutex_lock(&group->avgs_lock);
+	now = sched_clock();
+	collect_percpu_times(group);
+	if (now >= group->avg_next_update)
+		group->avg_next_update = update_averages(group, now);
+	mutex_unlock(&group->avgs_lock);
+
+	for (full = 0; full < 2 - (res == PSI_CPU); full++) {
+		unsigned long avg[3];
+		u64 total;
+		int w;
+
+		for (w = 0; w < 3; w++)
+			avg[w] = group->avg[res * 2 + full][w];
+		total = div_u64(group->total[res * 2 + full], NSEC_PER_USEC);
+
+		seq_printf(m, "%s avg10=%lu.%02lu avg60=%lu.%02lu avg300=%lu.%02lu total=%llu\n",
+			   full ? "full" : "some",
+			   LOAD_INT(avg[0]), LOAD_FRAC(avg[0]),
+			   LOAD_INT(avg[1]), LOAD_FRAC(avg[1]),
+			   LOAD_INT(avg[2]), LOAD_FRAC(avg[2]),
+			   total);
+	}
+
+	return 0;
+}
+
+static struct psi_trigger *psi_trigger_create(struct psi_group *group,
+			char *buf, enum psi_res res)
+{
+	struct psi_trigger *t;
+	enum psi_states state;
+	u32 threshold_us;
+	u32 window_us;
+	u64 period;
+
+	if (sscanf(buf, "some %u %u", &threshold_us, &window_us) == 2)
+		state = PSI_IO_SOME + res * 2;
+	else if (sscanf(buf, "full %u %u", &threshold_us, &window_us) == 2)
+		state = PSI_IO_FULL + res * 2;
+	else
+		return ERR_PTR(-EINVAL);
+
+	if (state >= PSI_NONIDLE)
+		return ERR_PTR(-EINVAL);
+
+	if (window_us < WINDOW_MIN_US || window_us > WINDOW_MAX_US)
+		return ERR_PTR(-EINVAL);
+
+	/* Check threshold */
+	if (threshold_us == 0 || threshold_us > window_us)
+		return ERR_PTR(-EINVAL);
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return ERR_PTR(-ENOMEM);
+
+	t->state = state;
+	t->threshold = threshold_us * NSEC_PER_USEC;
+	t->win.size = window_us * NSEC_PER_USEC;
+	init_waitqueue_head(&t->event_wait);
+
+	mutex_lock(&group->trigger_lock);
+
+	mutex_lock(&group->avgs_lock);
+	collect_percpu_times(group);
+	window_reset(&t->win, sched_clock(), group->total[state], 0);
+	mutex_unlock(&group->avgs_lock);
+
+	period = div_u64(t->win.size, UPDATES_PER_WINDOW);
+	if (list_empty(&group->triggers) || period < group->poll_min_period)
+		group->poll_min_period = period;
+
+	if (list_empty(&group->triggers))
+		schedule_delayed_work(&group->poll_work,
+			max(nsecs_to_jiffies(group->poll_min_period), 1UL));
+	list_add(&t->node, &group->triggers);
+
+	mutex_unlock(&group->trigger_lock);
+
+	return t;
+}
+
+static void psi_trigger_destroy(struct psi_group *group, struct psi_trigger *t)
+{
+	struct psi_trigger *tmp;
+	u64 period = ULLONG_MAX;
+
+	if (!t)
+		return;
+
+	mutex_lock(&group->trigger_lock);
+	list_del(&t->node);
+	/* The poll work stops by itself once the list is empty */
+	list_for_each_entry(tmp, &group->triggers, node)
+		period = min(period, div_u64(tmp->win.size,
+					UPDATES_PER_WINDOW));
+	group->poll_min_period = period;
+	mutex_unlock(&group->trigger_lock);
+
+	kfree(t);
+}
+
+static int psi_io_show(struct seq_file *m, void *v)
+{
+	return psi_show(m, &psi_system, PSI_IO);
+}
+
+static int psi_memory_show(struct seq_file *m, void *v)
+{
+	return psi_show(m, &psi_system, PSI_MEM);
+}
+
+static int psi_cpu_show(struct seq_file *m, void *v)
+{
+	return psi_show(m, &psi_system, PSI_CPU);
+}
+
+static int psi_io_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, psi_io_show, NULL);
+}
+
+static int psi_memory_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, psi_memory_show, NULL);
+}
+
+static int psi_cpu_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, psi_cpu_show, NULL);
+}
+
+static ssize_t psi_write(struct file *file, const char __user *user_buf,
+			 size_t nbytes, enum psi_res res)
+{
+	char buf[32];
+	size_t buf_size;
+	struct seq_file *seq;
+	struct psi_trigger *new;
+
+	if (psi_disabled)
+		return -EOPNOTSUPP;
+
+	if (!nbytes)
+		return -EINVAL;
+
+	buf_size = min(nbytes, sizeof(buf) - 1);
+	if (copy_from_user(buf, user_buf, buf_size))
+		return -EFAULT;
+	buf[buf_size] = '\0';
+
+	new = psi_trigger_create(&psi_system, buf, res);
+	if (IS_ERR(new))
+		return PTR_ERR(new);
+
+	seq = file->private_data;
+	/* Take seq->lock to protect seq->private from concurrent writes */
+	mutex_lock(&seq->lock);
+	if (seq->private) {
+		/* one trigger per open file */
+		mutex_unlock(&seq->lock);
+		psi_trigger_destroy(&psi_system, new);
+		return -EBUSY;
+	}
+	seq->private = new;
+	mutex_unlock(&seq->lock);
+
+	return nbytes;
+}
+
+static ssize_t psi_io_write(struct file *file, const char __user *user_buf,
+			    size_t nbytes, loff_t *ppos)
+{
+	return psi_write(file, user_buf, nbytes, PSI_IO);
+}
+
+static ssize_t psi_memory_write(struct file *file,
+				const char __user *user_buf,
+				size_t nbytes, loff_t *ppos)
+{
+	return psi_write(file, user_buf, nbytes, PSI_MEM);
+}
+
+static ssize_t psi_cpu_write(struct file *file, const char __user *user_buf,
+			     size_t nbytes, loff_t *ppos)
+{
+	return psi_write(file, user_buf, nbytes, PSI_CPU);
+}
+
+static unsigned int psi_fop_poll(struct file *file, poll_table *wait)
+{
+	struct seq_file *seq = file->private_data;
+	struct psi_trigger *t;
+
+	mutex_lock(&seq->lock);
+	t = seq->private;
+	mutex_unlock(&seq->lock);
+
+	if (!t)
+		return DEFAULT_POLLMASK | POLLERR | POLLPRI;
+
+	poll_wait(file, &t->event_wait, wait);
+
+	if (cmpxchg(&t->event, 1, 0) == 1)
+		return POLLPRI;
+
+	return 0;
+}
+
+static int psi_fop_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq = file->private_data;
+
+	psi_trigger_destroy(&psi_system, seq->private);
+	return single_release(inode, file);
+}
+
+static const struct file_operations psi_io_fops = {
+	.open           = psi_io_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.write          = psi_io_write,
+	.poll           = psi_fop_poll,
+	.release        = psi_fop_release,
+};
+
+static const struct file_operations psi_memory_fops = {
+	.open           = psi_memory_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.write          = psi_memory_write,
+	.poll           = psi_fop_poll,
+	.release        = psi_fop_release,
+};
+
+static const struct file_operations psi_cpu_fops = {
+	.open           = psi_cpu_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.write          = psi_cpu_write,
+	.poll           = psi_fop_poll,
+	.release        = psi_fop_release,
+};
+
+static int __init psi_proc_init(void)
+{
+	if (psi_disabled)
+		return 0;
+
+	psi_ready = true;
+
+	proc_mkdir("pressure", NULL);
+	proc_create("pressure/io", S_IRUGO | S_IWUSR, NULL, &psi_io_fops);
+	proc_create("pressure/memory", S_IRUGO | S_IWUSR, NULL,
+			&psi_memory_fops);
+	proc_create("pressure/cpu", S_IRUGO | S_IWUSR, NULL, &psi_cpu_fops);
+	return 0;
+}
+module_init(psi_proc_init);
@@ -9,6 +9,7 @@
 #include <linux/irq_work.h>
 #include <linux/tick.h>
 #include <linux/slab.h>
+#include <linux/psi.h>
 
 #include "cpupri.h"
 #include "cpudeadline.h"
@@ -711,6 +712,15 @@ struct rq {
 	u64 avg_irqload;
 	u64 irqload_ts;
 	u64 cum_window_demand;
+	u64 cum_pred_demand;
+
+	/*
+	 * Number of tasks per bucket of busy time in the current and the
+	 * previous window, indexed by curr_table / 1 - curr_table.
+	 */
+	u16 top_tasks[2][WALT_NR_TOP_BUCKETS];
+	DECLARE_BITMAP(top_tasks_bitmap[2], WALT_NR_TOP_BUCKETS);
+	u8 curr_table;
 #endif /* CONFIG_SCHED_WALT */
 
 
@@ -1608,6 +1618,7 @@ static inline unsigned long capacity_orig_of(int cpu)
 extern unsigned int sysctl_sched_use_walt_cpu_util;
 extern unsigned int walt_ravg_window;
 extern bool walt_disabled;
+extern u64 walt_cpu_freq_load(struct rq *rq);
 
 static inline unsigned long task_util(struct task_struct *p)
 {
@@ -1677,12 +1688,27 @@ static inline unsigned long cpu_util_freq(int cpu)
 
 #ifdef CONFIG_SCHED_WALT
 	if (!walt_disabled && sysctl_sched_use_walt_cpu_util)
-		util = div64_u64(cpu_rq(cpu)->prev_runnable_sum,
+		util = div64_u64(walt_cpu_freq_load(cpu_rq(cpu)),
 				 walt_ravg_window >> SCHED_LOAD_SHIFT);
 #endif
 	return (util >= capacity) ? capacity : util;
 }
 
+#ifdef CONFIG_SCHED_WALT
+/*
+ * Utilization @cpu is expected to need in the next window: the sum of the
+ * predicted demand of the tasks currently runnable on it.
+ */
+static inline unsigned long cpu_pred_util(int cpu)
+{
+	unsigned long util = div64_u64(cpu_rq(cpu)->cum_pred_demand,
+				       walt_ravg_window >> SCHED_LOAD_SHIFT);
+	unsigned long capacity = capacity_orig_of(cpu);
+
+	return (util >= capacity) ? capacity : util;
+}
+#endif
+
 #endif
 
 static inline void sched_rt_avg_update(struct rq *rq, u64 rt_delta)
@@ -2011,6 +2037,33 @@ walt_task_in_cum_window_demand(struct rq *rq, struct task_struct *p)
 	       (p->on_rq || p->last_sleep_ts >= rq->window_start);
 }
 
+#define WALT_NR_GROUPS	20
+
+/*
+ * Related thread groups: tasks that work as a pipeline are kept on one
+ * cluster and the frequency of that cluster is sized for their combined
+ * demand. Group 0 means no group.
+ */
+struct related_thread_group {
+	int id;
+	raw_spinlock_t lock;
+	struct list_head tasks;
+	unsigned int nr_tasks;
+	/* First CPU of the cluster the group was last placed on, or -1 */
+	int preferred_cpu;
+	/* Sum of ravg.demand of all members and of the runnable ones */
+	atomic64_t demand;
+	atomic64_t runnable_demand;
+	atomic_long_t nr_migrations;
+	atomic_long_t nr_cluster_migrations;
+};
+
+static inline unsigned long walt_group_util(struct related_thread_group *grp)
+{
+	return div64_u64(atomic64_read(&grp->demand),
+			 walt_ravg_window >> SCHED_LOAD_SHIFT);
+}
+
 #endif /* CONFIG_SCHED_WALT */
 
 #ifdef arch_scale_freq_capacity
@@ -198,6 +198,10 @@ struct schedtune {
 	 * towards idle CPUs */
 	int prefer_idle;
 
+	/* Utilization clamps for tasks on that SchedTune CGroup [%] */
+	int util_min;
+	int util_max;
+
 #ifdef CONFIG_DYNAMIC_STUNE_BOOST
 	/*
 	 * This tracks the default boost value and is used to restore
@@ -237,6 +241,8 @@ root_schedtune = {
 	.perf_boost_idx = 0,
 	.perf_constrain_idx = 0,
 	.prefer_idle = 0,
+	.util_min = 0,
+	.util_max = 100,
 #ifdef CONFIG_DYNAMIC_STUNE_BOOST
 	.boost_default = 0,
 #endif /* CONFIG_DYNAMIC_STUNE_BOOST */
@@ -304,11 +310,20 @@ struct boost_groups {
 	/* Maximum boost value for all RUNNABLE tasks on a CPU */
 	int boost_max;
 	u64 boost_ts;
+	/*
+	 * Utilization clamps for all RUNNABLE tasks on a CPU, i.e. the
+	 * maximum of the clamps of the groups they belong to
+	 */
+	unsigned long util_min;
+	unsigned long util_max;
 	struct {
 		/* True when this boost group maps an actual cgroup */
 		bool valid;
 		/* The boost for tasks on that boost group */
 		int boost;
+		/* The utilization clamps for tasks on that boost group */
+		unsigned long util_min;
+		unsigned long util_max;
 		/* Count of RUNNABLE tasks on that boost group */
 		unsigned tasks;
 		/* Timestamp of boost activation */
@@ -375,6 +390,71 @@ schedtune_cpu_update(int cpu, u64 now)
 	bg->boost_ts = boost_ts;
 }
 
+/*
+ * Utilization clamps apply only while the group has RUNNABLE tasks on the
+ * CPU: unlike boost there is no hold, so that the cap of a background group
+ * stops throttling the CPU as soon as its tasks are gone.
+ * Called with bg->lock held.
+ */
+static void
+schedtune_cpu_update_clamp(int cpu)
+{
+	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
+	unsigned long util_min = 0;
+	unsigned long util_max = 0;
+	bool active = false;
+	int idx;
+
+	for (idx = 0; idx < BOOSTGROUPS_COUNT; ++idx) {
+		if (!bg->group[idx].valid || !bg->group[idx].tasks)
+			continue;
+
+		active = true;
+		util_min = max(util_min, bg->group[idx].util_min);
+		util_max = max(util_max, bg->group[idx].util_max);
+	}
+
+	/* An idle CPU is not capped */
+	if (!active)
+		util_max = SCHED_CAPACITY_SCALE;
+
+	if (bg->util_min == util_min && bg->util_max == util_max)
+		return;
+
+	bg->util_min = util_min;
+	bg->util_max = util_max;
+
+	trace_sched_tune_clamp_update(cpu, util_min, util_max);
+}
+
+static inline unsigned long schedtune_pct_to_util(int pct)
+{
+	return DIV_ROUND_UP(pct * SCHED_CAPACITY_SCALE, 100);
+}
+
+/* Serializes util_min/util_max updates, keeping util_min <= util_max */
+static DEFINE_MUTEX(stune_clamp_mutex);
+
+static void
+schedtune_clampgroup_update(struct schedtune *st)
+{
+	struct boost_groups *bg;
+	unsigned long irq_flags;
+	int cpu;
+
+	lockdep_assert_held(&stune_clamp_mutex);
+
+	for_each_possible_cpu(cpu) {
+		bg = &per_cpu(cpu_boost_groups, cpu);
+
+		raw_spin_lock_irqsave(&bg->lock, irq_flags);
+		bg->group[st->idx].util_min = schedtune_pct_to_util(st->util_min);
+		bg->group[st->idx].util_max = schedtune_pct_to_util(st->util_max);
+		schedtune_cpu_update_clamp(cpu);
+		raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
+	}
+}
+
 static int
 schedtune_boostgroup_update(int idx, int boost)
 {
@@ -445,10 +525,16 @@ schedtune_tasks_update(struct task_struct *p, int cpu, int idx, int task_count)
 {
 	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
 	int tasks = bg->group[idx].tasks + task_count;
+	bool was_active = bg->group[idx].tasks;
 	u64 now;
 
 	/* Update boosted tasks count while avoiding to make it negative */
 	bg->group[idx].tasks = max(0, tasks);
+
+	/* Clamp group activation or deactivation on that RQ */
+	if (was_active != !!bg->group[idx].tasks)
+		schedtune_cpu_update_clamp(cpu);
+
 	/* Update timeout on enqueue */
 	if (task_count > 0) {
 		now = sched_clock_cpu(cpu);
@@ -579,6 +665,8 @@ int schedtune_can_attach(struct cgroup_subsys_state *css,
 		/* update next time someone asks */
 		bg->boost_ts = now - SCHEDTUNE_BOOST_HOLD_NS;
 
+		schedtune_cpu_update_clamp(cpu);
+
 		raw_spin_unlock(&bg->lock);
 		unlock_rq_of(rq, task, &irq_flags);
 	}
@@ -691,6 +779,50 @@ int schedtune_task_boost(struct task_struct *p)
 	return task_boost;
 }
 
+unsigned long schedtune_cpu_util_min(int cpu)
+{
+	if (!unlikely(schedtune_initialized))
+		return 0;
+
+	return per_cpu(cpu_boost_groups, cpu).util_min;
+}
+
+unsigned long schedtune_cpu_util_max(int cpu)
+{
+	if (!unlikely(schedtune_initialized))
+		return SCHED_CAPACITY_SCALE;
+
+	return per_cpu(cpu_boost_groups, cpu).util_max;
+}
+
+unsigned long schedtune_task_util_min(struct task_struct *p)
+{
+	int util_min;
+
+	if (!unlikely(schedtune_initialized))
+		return 0;
+
+	rcu_read_lock();
+	util_min = task_schedtune(p)->util_min;
+	rcu_read_unlock();
+
+	return schedtune_pct_to_util(util_min);
+}
+
+unsigned long schedtune_task_util_max(struct task_struct *p)
+{
+	int util_max;
+
+	if (!unlikely(schedtune_initialized))
+		return SCHED_CAPACITY_SCALE;
+
+	rcu_read_lock();
+	util_max = task_schedtune(p)->util_max;
+	rcu_read_unlock();
+
+	return schedtune_pct_to_util(util_max);
+}
+
 int schedtune_prefer_idle(struct task_struct *p)
 {
 	struct schedtune *st;
@@ -726,6 +858,67 @@ prefer_idle_write(struct cgroup_subsys_state *css, struct cftype *cft,
 	return 0;
 }
 
+static u64
+util_min_read(struct cgroup_subsys_state *css, struct cftype *cft)
+{
+	struct schedtune *st = css_st(css);
+
+	return st->util_min;
+}
+
+static int
+util_min_write(struct cgroup_subsys_state *css, struct cftype *cft,
+	       u64 util_min)
+{
+	struct schedtune *st = css_st(css);
+	int ret = 0;
+
+	mutex_lock(&stune_clamp_mutex);
+	if (util_min > st->util_max) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	st->util_min = util_min;
+	schedtune_clampgroup_update(st);
+out:
+	mutex_unlock(&stune_clamp_mutex);
+
+	return ret;
+}
+
+static u64
+util_max_read(struct cgroup_subsys_state *css, struct cftype *cft)
+{
+	struct schedtune *st = css_st(css);
+
+	return st->util_max;
+}
+
+static int
+util_max_write(struct cgroup_subsys_state *css, struct cftype *cft,
+	       u64 util_max)
+{
+	struct schedtune *st = css_st(css);
+	int ret = 0;
+
+	if (util_max > 100)
+		return -EINVAL;
+
+	mutex_lock(&stune_clamp_mutex);
+	if (util_max < st->util_min) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	st->util_max = util_max;
+	schedtune_clampgroup_update(st);
+out:
+	mutex_unlock(&stune_clamp_mutex);
+
+	return ret;
+}
+
 static s64
 boost_read(struct cgroup_subsys_state *css, struct cftype *cft)
 {
@@ -785,6 +978,16 @@ static struct cftype files[] = {
 		.read_u64 = prefer_idle_read,
 		.write_u64 = prefer_idle_write,
 	},
+	{
+		.name = "util_min",
+		.read_u64 = util_min_read,
+		.write_u64 = util_min_write,
+	},
+	{
+		.name = "util_max",
+		.read_u64 = util_max_read,
+		.write_u64 = util_max_write,
+	},
 	{ }	/* terminate */
 };
 
@@ -798,6 +1001,8 @@ schedtune_boostgroup_init(struct schedtune *st, int idx)
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
 		bg->group[idx].boost = 0;
+		bg->group[idx].util_min = 0;
+		bg->group[idx].util_max = SCHED_CAPACITY_SCALE;
 		bg->group[idx].valid = true;
 		bg->group[idx].ts = 0;
 	}
@@ -805,6 +1010,7 @@ schedtune_boostgroup_init(struct schedtune *st, int idx)
 	/* Keep track of allocated boost groups */
 	allocated_group[idx] = st;
 	st->idx = idx;
+	st->util_max = 100;
 }
 
 static struct cgroup_subsys_state *
@@ -849,13 +1055,17 @@ static void
 schedtune_boostgroup_release(struct schedtune *st)
 {
 	struct boost_groups *bg;
+	unsigned long irq_flags;
 	int cpu;
 
 	/* Reset per CPUs boost group support */
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
+		raw_spin_lock_irqsave(&bg->lock, irq_flags);
 		bg->group[st->idx].valid = false;
 		bg->group[st->idx].boost = 0;
+		schedtune_cpu_update_clamp(cpu);
+		raw_spin_unlock_irqrestore(&bg->lock, irq_flags);
 	}
 
 	/* Keep track of allocated boost groups */
@@ -892,7 +1102,9 @@ schedtune_init_cgroups(void)
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
 		memset(bg, 0, sizeof(struct boost_groups));
+		bg->util_max = SCHED_CAPACITY_SCALE;
 		bg->group[0].valid = true;
+		bg->group[0].util_max = SCHED_CAPACITY_SCALE;
 		raw_spin_lock_init(&bg->lock);
 	}
 
@@ -19,6 +19,11 @@ int schedtune_task_boost(struct task_struct *tsk);
 
 int schedtune_prefer_idle(struct task_struct *tsk);
 
+unsigned long schedtune_cpu_util_min(int cpu);
+unsigned long schedtune_cpu_util_max(int cpu);
+unsigned long schedtune_task_util_min(struct task_struct *tsk);
+unsigned long schedtune_task_util_max(struct task_struct *tsk);
+
 void schedtune_exit_task(struct task_struct *tsk);
 
 void schedtune_enqueue_task(struct task_struct *p, int cpu);
@@ -31,6 +36,11 @@ void schedtune_dequeue_task(struct task_struct *p, int cpu);
 
 #define schedtune_prefer_idle(task) 0
 
+#define schedtune_cpu_util_min(cpu)  0UL
+#define schedtune_cpu_util_max(cpu)  SCHED_CAPACITY_SCALE
+#define schedtune_task_util_min(tsk) 0UL
+#define schedtune_task_util_max(tsk) SCHED_CAPACITY_SCALE
+
 #define schedtune_exit_task(task) do { } while (0)
 
 #define schedtune_enqueue_task(task, cpu) do { } while (0)
@@ -49,6 +59,11 @@ int schedtune_accept_deltas(int nrg_delta, int cap_delta,
 
 #define schedtune_prefer_idle(task) 0
 
+#define schedtune_cpu_util_min(cpu)  0UL
+#define schedtune_cpu_util_max(cpu)  SCHED_CAPACITY_SCALE
+#define schedtune_task_util_min(tsk) 0UL
+#define schedtune_task_util_max(tsk) SCHED_CAPACITY_SCALE
+
 #define schedtune_exit_task(task) do { } while (0)
 
 #define schedtune_enqueue_task(task, cpu) do { } while (0)
@@ -19,6 +19,8 @@
  *             and Todd Kjos
  */
 
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/syscore_ops.h>
 #include <trace/events/sched.h>
 #include "sched.h"
@@ -32,6 +34,10 @@
 
 #define EXITING_TASK_MARKER	0xdeaddead
 
+#define FREQ_REPORT_CPU_LOAD			0
+#define FREQ_REPORT_MAX_CPU_LOAD_TOP_TASK	1
+#define FREQ_REPORT_TOP_TASK			2
+
 static __read_mostly unsigned int walt_ravg_hist_size = 5;
 static __read_mostly unsigned int walt_window_stats_policy =
 	WINDOW_STATS_MAX_RECENT_AVG;
@@ -41,6 +47,13 @@ static __read_mostly unsigned int walt_io_is_busy = 0;
 
 unsigned int sysctl_sched_walt_init_task_load_pct = 15;
 
+/*
+ * Load reported for frequency selection: the CPU's busy time in the last
+ * window, the busy time of the biggest task that ran on it, or the larger
+ * of the two.
+ */
+unsigned int sysctl_sched_walt_freq_report_policy = FREQ_REPORT_CPU_LOAD;
+
 /* true -> use PELT based load stats, false -> use window-based load stats */
 bool __read_mostly walt_disabled = false;
 
@@ -69,11 +82,21 @@ static inline void fixup_cum_window_demand(struct rq *rq, s64 delta)
 		rq->cum_window_demand = 0;
 }
 
+static inline void fixup_cum_pred_demand(struct rq *rq, s64 delta)
+{
+	rq->cum_pred_demand += delta;
+	if (unlikely((s64)rq->cum_pred_demand < 0))
+		rq->cum_pred_demand = 0;
+}
+
 void
 walt_inc_cumulative_runnable_avg(struct rq *rq,
 				 struct task_struct *p)
 {
 	rq->cumulative_runnable_avg += p->ravg.demand;
+	fixup_cum_pred_demand(rq, p->ravg.pred_demand);
+	if (p->grp)
+		atomic64_add(p->ravg.demand, &p->grp->runnable_demand);
 
 	/*
 	 * Add a task's contribution to the cumulative window demand when
@@ -92,6 +115,9 @@ walt_dec_cumulative_runnable_avg(struct rq *rq,
 {
 	rq->cumulative_runnable_avg -= p->ravg.demand;
 	BUG_ON((s64)rq->cumulative_runnable_avg < 0);
+	fixup_cum_pred_demand(rq, -(s64)p->ravg.pred_demand);
+	if (p->grp)
+		atomic64_sub(p->ravg.demand, &p->grp->runnable_demand);
 
 	/*
 	 * on_rq will be 1 for sleeping tasks. So check if the task
@@ -199,6 +225,183 @@ static int __init set_walt_ravg_window(char *str)
 
 early_param("walt_ravg_window", set_walt_ravg_window);
 
+static struct related_thread_group related_thread_groups[WALT_NR_GROUPS];
+static DECLARE_BITMAP(active_groups, WALT_NR_GROUPS);
+
+/*
+ * Combined demand of the runnable members of the groups placed on the
+ * cluster of @cpu, so that the cluster runs fast enough for the whole
+ * pipeline rather than for its busiest CPU.
+ */
+static u64 group_freq_load(int cpu)
+{
+	u64 load = 0;
+	int id;
+
+	for_each_set_bit(id, active_groups, WALT_NR_GROUPS) {
+		struct related_thread_group *grp = &related_thread_groups[id];
+		int pref = READ_ONCE(grp->preferred_cpu);
+		s64 demand;
+
+		if (pref < 0 || !cpus_share_cache(pref, cpu))
+			continue;
+
+		demand = atomic64_read(&grp->runnable_demand);
+		if (demand > 0)
+			load = max_t(u64, load, demand);
+	}
+
+	return load;
+}
+
+static inline void group_fixup_demand(struct task_struct *p, s64 delta,
+				      bool runnable)
+{
+	struct related_thread_group *grp = p->grp;
+
+	if (!grp)
+		return;
+
+	atomic64_add(delta, &grp->demand);
+	if (runnable)
+		atomic64_add(delta, &grp->runnable_demand);
+}
+
+/*
+ * Top task tracking. Each runqueue keeps, for the current and the previous
+ * window, a histogram of how much busy time the tasks that ran on it have
+ * accumulated in that window. The highest populated bucket of the previous
+ * window gives the load of the biggest task, which can be much smaller
+ * than the CPU's busy time when several tasks shared the CPU.
+ */
+static inline u32 top_task_granule(void)
+{
+	return walt_ravg_window / WALT_NR_TOP_BUCKETS;
+}
+
+static inline int load_to_index(u32 load)
+{
+	return min_t(u32, load / top_task_granule(), WALT_NR_TOP_BUCKETS - 1);
+}
+
+static void top_tasks_add(struct rq *rq, int table, u32 load)
+{
+	int index;
+
+	if (!load)
+		return;
+
+	index = load_to_index(load);
+	if (!rq->top_tasks[table][index]++)
+		__set_bit(index, rq->top_tasks_bitmap[table]);
+}
+
+static void top_tasks_del(struct rq *rq, int table, u32 load)
+{
+	int index;
+
+	if (!load)
+		return;
+
+	index = load_to_index(load);
+	if (!rq->top_tasks[table][index])
+		return;
+
+	if (!--rq->top_tasks[table][index])
+		__clear_bit(index, rq->top_tasks_bitmap[table]);
+}
+
+static u32 top_task_load_of(struct rq *rq, int table)
+{
+	unsigned long index;
+
+	index = find_last_bit(rq->top_tasks_bitmap[table], WALT_NR_TOP_BUCKETS);
+	if (index >= WALT_NR_TOP_BUCKETS)
+		return 0;
+
+	return min_t(u32, (index + 1) * top_task_granule(), walt_ravg_window);
+}
+
+/* Busy time of the biggest task that ran on @rq in the previous window */
+static inline u32 top_task_load(struct rq *rq)
+{
+	return top_task_load_of(rq, 1 - rq->curr_table);
+}
+
+u64 walt_cpu_freq_load(struct rq *rq)
+{
+	u64 load;
+
+	switch (sysctl_sched_walt_freq_report_policy) {
+	case FREQ_REPORT_MAX_CPU_LOAD_TOP_TASK:
+		load = max_t(u64, rq->prev_runnable_sum, top_task_load(rq));
+		break;
+	case FREQ_REPORT_TOP_TASK:
+		load = top_task_load(rq);
+		break;
+	default:
+		load = rq->prev_runnable_sum;
+		break;
+	}
+
+	return max(load, group_freq_load(cpu_of(rq)));
+}
+
+/*
+ * The current window becomes the previous one. When more than one window
+ * has elapsed, nothing that was recorded is part of the previous window.
+ */
+static void rollover_top_tasks(struct rq *rq, bool full_window)
+{
+	u8 curr = rq->curr_table;
+	u8 prev = 1 - curr;
+
+	trace_walt_top_tasks(rq, rq->top_tasks[curr], top_task_load_of(rq, curr));
+
+	memset(rq->top_tasks[prev], 0, sizeof(rq->top_tasks[prev]));
+	bitmap_zero(rq->top_tasks_bitmap[prev], WALT_NR_TOP_BUCKETS);
+
+	if (full_window) {
+		memset(rq->top_tasks[curr], 0, sizeof(rq->top_tasks[curr]));
+		bitmap_zero(rq->top_tasks_bitmap[curr], WALT_NR_TOP_BUCKETS);
+	}
+
+	rq->curr_table = prev;
+}
+
+/*
+ * Move @p between buckets after its window sums have been updated.
+ * @old_curr_window and @mark_start are the values from before the update.
+ */
+static void update_top_tasks(struct task_struct *p, struct rq *rq,
+			     u32 old_curr_window, u64 mark_start)
+{
+	u8 curr = rq->curr_table;
+	u8 prev = 1 - curr;
+	u32 curr_window = p->ravg.curr_window;
+
+	if (is_idle_task(p) || exiting_task(p))
+		return;
+
+	if (mark_start >= rq->window_start) {
+		if (old_curr_window != curr_window) {
+			top_tasks_del(rq, curr, old_curr_window);
+			top_tasks_add(rq, curr, curr_window);
+		}
+		return;
+	}
+
+	/*
+	 * The task's own window rolled over. Its old contribution is in the
+	 * previous window's table unless more than a full window elapsed
+	 * since, in which case that table has been cleared already.
+	 */
+	if (rq->window_start - mark_start <= walt_ravg_window)
+		top_tasks_del(rq, prev, old_curr_window);
+	top_tasks_add(rq, prev, p->ravg.prev_window);
+	top_tasks_add(rq, curr, curr_window);
+}
+
 static void
 update_window_start(struct rq *rq, u64 wallclock)
 {
@@ -216,6 +419,7 @@ update_window_start(struct rq *rq, u64 wallclock)
 		return;
 
 	nr_windows = div64_u64(delta, walt_ravg_window);
+	rollover_top_tasks(rq, nr_windows > 1);
 	rq->window_start += (u64)nr_windows * (u64)walt_ravg_window;
 
 	rq->cum_window_demand = rq->cumulative_runnable_avg;
@@ -554,6 +758,23 @@ static int account_busy_for_task_demand(struct task_struct *p, int event)
 	return 1;
 }
 
+/*
+ * Forecast the task's demand for the next window. A task whose activity
+ * grew over the last window is assumed to keep ramping at the same rate,
+ * so that the CPU frequency can be raised before the burst has been
+ * observed in full. Otherwise the forecast is the regular demand.
+ */
+static u32 predict_demand(struct task_struct *p, u32 demand)
+{
+	u32 *hist = &p->ravg.sum_history[0];
+	u32 pred = demand;
+
+	if (walt_ravg_hist_size > 1 && hist[0] > hist[1])
+		pred = max(pred, hist[0] + (hist[0] - hist[1]));
+
+	return min_t(u32, pred, walt_ravg_window);
+}
+
 /*
  * Called when new window is starting for a task, to record cpu usage over
  * recently concluded window(s). Normally 'samples' should be 1. It can be > 1
@@ -565,13 +786,17 @@ static void update_history(struct rq *rq, struct task_struct *p,
 {
 	u32 *hist = &p->ravg.sum_history[0];
 	int ridx, widx;
-	u32 max = 0, avg, demand;
+	u32 max = 0, avg, demand, pred_demand;
 	u64 sum = 0;
+	bool runnable = false;
 
 	/* Ignore windows where task had no activity */
 	if (!runtime || is_idle_task(p) || exiting_task(p) || !samples)
 			goto done;
 
+	/* Score the forecast made for the window that just concluded */
+	trace_walt_pred_demand(rq, p, p->ravg.pred_demand, runtime);
+
 	/* Push new 'runtime' value onto stack */
 	widx = walt_ravg_hist_size - 1;
 	ridx = widx - samples;
@@ -603,6 +828,8 @@ static void update_history(struct rq *rq, struct task_struct *p,
 			demand = max(avg, runtime);
 	}
 
+	pred_demand = predict_demand(p, demand);
+
 	/*
 	 * A throttled deadline sched class task gets dequeued without
 	 * changing p->on_rq. Since the dequeue decrements hmp stats
@@ -616,13 +843,20 @@ static void update_history(struct rq *rq, struct task_struct *p,
 	 * demand.
 	 */
 	if (!task_has_dl_policy(p) || !p->dl.dl_throttled) {
-		if (task_on_rq_queued(p))
+		if (task_on_rq_queued(p)) {
+			runnable = true;
 			fixup_cumulative_runnable_avg(rq, p, demand);
-		else if (rq->curr == p)
+			fixup_cum_pred_demand(rq, (s64)pred_demand -
+					      p->ravg.pred_demand);
+		} else if (rq->curr == p) {
 			fixup_cum_window_demand(rq, demand);
+		}
 	}
 
+	group_fixup_demand(p, (s64)demand - p->ravg.demand, runnable);
+
 	p->ravg.demand = demand;
+	p->ravg.pred_demand = pred_demand;
 
 done:
 	trace_walt_update_history(rq, p, runtime, samples, event);
@@ -744,6 +978,8 @@ static void update_task_demand(struct task_struct *p, struct rq *rq,
 void walt_update_task_ravg(struct task_struct *p, struct rq *rq,
 	     int event, u64 wallclock, u64 irqtime)
 {
+	u32 old_curr_window;
+
 	if (walt_disabled || !rq->window_start)
 		return;
 
@@ -755,7 +991,9 @@ void walt_update_task_ravg(struct task_struct *p, struct rq *rq,
 		goto done;
 
 	update_task_demand(p, rq, event, wallclock);
+	old_curr_window = p->ravg.curr_window;
 	update_cpu_busy_time(p, rq, event, wallclock, irqtime);
+	update_top_tasks(p, rq, old_curr_window, p->ravg.mark_start);
 
 done:
 	trace_walt_update_task_ravg(p, rq, event, wallclock, irqtime);
@@ -822,6 +1060,12 @@ void walt_fixup_busy_time(struct task_struct *p, int new_cpu)
 	struct rq *dest_rq = cpu_rq(new_cpu);
 	u64 wallclock;
 
+	if (p->grp) {
+		atomic_long_inc(&p->grp->nr_migrations);
+		if (!cpus_share_cache(task_cpu(p), new_cpu))
+			atomic_long_inc(&p->grp->nr_cluster_migrations);
+	}
+
 	if (!p->on_rq && p->state != TASK_WAKING)
 		return;
 
@@ -852,6 +1096,11 @@ void walt_fixup_busy_time(struct task_struct *p, int new_cpu)
 		fixup_cum_window_demand(dest_rq, p->ravg.demand);
 	}
 
+	top_tasks_del(src_rq, src_rq->curr_table, p->ravg.curr_window);
+	top_tasks_del(src_rq, 1 - src_rq->curr_table, p->ravg.prev_window);
+	top_tasks_add(dest_rq, dest_rq->curr_table, p->ravg.curr_window);
+	top_tasks_add(dest_rq, 1 - dest_rq->curr_table, p->ravg.prev_window);
+
 	if (p->ravg.curr_window) {
 		src_rq->curr_runnable_sum -= p->ravg.curr_window;
 		dest_rq->curr_runnable_sum += p->ravg.curr_window;
@@ -895,6 +1144,225 @@ void walt_init_new_task_load(struct task_struct *p)
 	}
 
 	p->ravg.demand = init_load_windows;
+	p->ravg.pred_demand = init_load_windows;
 	for (i = 0; i < RAVG_HIST_SIZE_MAX; ++i)
 		p->ravg.sum_history[i] = init_load_windows;
 }
+
+static int __init walt_init_groups(void)
+{
+	int i;
+
+	for (i = 0; i < WALT_NR_GROUPS; i++) {
+		struct related_thread_group *grp = &related_thread_groups[i];
+
+		grp->id = i;
+		raw_spin_lock_init(&grp->lock);
+		INIT_LIST_HEAD(&grp->tasks);
+		grp->preferred_cpu = -1;
+	}
+
+	return 0;
+}
+early_initcall(walt_init_groups);
+
+static void add_task_to_group(struct task_struct *p,
+			      struct related_thread_group *grp)
+{
+	raw_spin_lock(&grp->lock);
+	list_add(&p->grp_list, &grp->tasks);
+	if (!grp->nr_tasks++)
+		set_bit(grp->id, active_groups);
+	raw_spin_unlock(&grp->lock);
+
+	p->grp = grp;
+	group_fixup_demand(p, p->ravg.demand, task_on_rq_queued(p));
+}
+
+static void remove_task_from_group(struct task_struct *p)
+{
+	struct related_thread_group *grp = p->grp;
+
+	group_fixup_demand(p, -(s64)p->ravg.demand, task_on_rq_queued(p));
+	p->grp = NULL;
+
+	raw_spin_lock(&grp->lock);
+	list_del_init(&p->grp_list);
+	if (!--grp->nr_tasks) {
+		clear_bit(grp->id, active_groups);
+		grp->preferred_cpu = -1;
+		atomic64_set(&grp->demand, 0);
+		atomic64_set(&grp->runnable_demand, 0);
+	}
+	raw_spin_unlock(&grp->lock);
+}
+
+/*
+ * Move @p to related thread group @group_id, or out of its group when
+ * @group_id is 0. Holding the task's rq lock keeps the group's demand sums
+ * in step with enqueue, dequeue and window rollover of the task.
+ */
+int sched_set_group_id(struct task_struct *p, unsigned int group_id)
+{
+	struct related_thread_group *grp = NULL;
+	unsigned long flags;
+	struct rq *rq;
+
+	if (group_id >= WALT_NR_GROUPS)
+		return -EINVAL;
+
+	if (group_id)
+		grp = &related_thread_groups[group_id];
+	else if (!READ_ONCE(p->grp))
+		return 0;
+
+	rq = lock_rq_of(p, &flags);
+	if (p->grp != grp) {
+		if (p->grp)
+			remove_task_from_group(p);
+		/* do_exit() took the task out, it must not rejoin */
+		if (grp && !(p->flags & PF_EXITING))
+			add_task_to_group(p, grp);
+	}
+	unlock_rq_of(rq, p, &flags);
+
+	return 0;
+}
+
+unsigned int sched_get_group_id(struct task_struct *p)
+{
+	struct related_thread_group *grp = READ_ONCE(p->grp);
+
+	return grp ? grp->id : 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+struct top_tasks_snapshot {
+	u16 hist[2][WALT_NR_TOP_BUCKETS];
+	u64 prev_runnable_sum;
+	u32 top_load;
+};
+
+static void top_tasks_show_hist(struct seq_file *m, const char *name,
+				u16 *hist)
+{
+	int i;
+
+	seq_printf(m, "  %s:", name);
+	for (i = 0; i < WALT_NR_TOP_BUCKETS; i++)
+		if (hist[i])
+			seq_printf(m, " %d:%u", i, hist[i]);
+	seq_putc(m, '\n');
+}
+
+static int top_tasks_show(struct seq_file *m, void *v)
+{
+	struct top_tasks_snapshot snap;
+	unsigned long flags;
+	int cpu;
+
+	seq_printf(m, "bucket_ns %u\n", top_task_granule());
+
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+		u8 curr;
+
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		curr = rq->curr_table;
+		memcpy(snap.hist[0], rq->top_tasks[curr], sizeof(snap.hist[0]));
+		memcpy(snap.hist[1], rq->top_tasks[1 - curr],
+		       sizeof(snap.hist[1]));
+		snap.prev_runnable_sum = rq->prev_runnable_sum;
+		snap.top_load = top_task_load(rq);
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+
+		seq_printf(m, "cpu%d top_load %u prev_runnable_sum %llu\n",
+			   cpu, snap.top_load, snap.prev_runnable_sum);
+		top_tasks_show_hist(m, "prev", snap.hist[1]);
+		top_tasks_show_hist(m, "curr", snap.hist[0]);
+	}
+
+	return 0;
+}
+
+static int top_tasks_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, top_tasks_show, NULL);
+}
+
+static const struct file_operations top_tasks_fops = {
+	.open		= top_tasks_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int groups_show(struct seq_file *m, void *v)
+{
+	unsigned long flags;
+	int id;
+
+	seq_printf(m, "%-5s %6s %8s %10s %10s %10s %10s\n", "group",
+		   "tasks", "pref_cpu", "util", "runnable",
+		   "migrations", "cross");
+
+	for (id = 1; id < WALT_NR_GROUPS; id++) {
+		struct related_thread_group *grp = &related_thread_groups[id];
+		struct task_struct *p;
+
+		raw_spin_lock_irqsave(&grp->lock, flags);
+		if (!grp->nr_tasks) {
+			raw_spin_unlock_irqrestore(&grp->lock, flags);
+			continue;
+		}
+
+		seq_printf(m, "%-5d %6u %8d %10lu %10llu %10ld %10ld\n",
+			   id, grp->nr_tasks, grp->preferred_cpu,
+			   walt_group_util(grp),
+			   div64_u64(atomic64_read(&grp->runnable_demand),
+				     walt_ravg_window >> SCHED_LOAD_SHIFT),
+			   atomic_long_read(&grp->nr_migrations),
+			   atomic_long_read(&grp->nr_cluster_migrations));
+		seq_puts(m, "  pids:");
+		list_for_each_entry(p, &grp->tasks, grp_list)
+			seq_printf(m, " %d", task_pid_nr(p));
+		seq_putc(m, '\n');
+		raw_spin_unlock_irqrestore(&grp->lock, flags);
+	}
+
+	return 0;
+}
+
+static int groups_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, groups_show, NULL);
+}
+
+static const struct file_operations groups_fops = {
+	.open		= groups_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init walt_debugfs_init(void)
+{
+	struct dentry *root;
+
+	root = debugfs_create_dir("walt", NULL);
+	if (!root)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("top_tasks", 0444, root, NULL,
+				 &top_tasks_fops))
+		goto fail;
+	if (!debugfs_create_file("groups", 0444, root, NULL, &groups_fops))
+		goto fail;
+
+	return 0;
+fail:
+	debugfs_remove_recursive(root);
+	return -ENOMEM;
+}
+late_initcall(walt_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
@@ -343,6 +343,15 @@ static struct ctl_table kern_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec,
 	},
+	{
+		.procname	= "sched_walt_freq_report_policy",
+		.data		= &sysctl_sched_walt_freq_report_policy,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &two,
+	},
 #endif
 	{
 		.procname	= "sched_cstate_aware",
@@ -1609,6 +1618,15 @@ static struct ctl_table vm_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec_minmax,
 	},
+	{
+		.procname	= "swap_ratio_adaptive",
+		.data		= &sysctl_swap_ratio_adaptive,
+		.maxlen		= sizeof(sysctl_swap_ratio_adaptive),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
 #endif
 #ifdef CONFIG_HAVE_ARCH_MMAP_RND_BITS
 	{
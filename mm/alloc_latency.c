@@ -0,0 +1,293 @@
+/*
+ * Page allocator slowpath latency histograms
+ *
+ * Every allocation that enters __alloc_pages_slowpath() is timed and
+ * accounted by order and by the class of its gfp mask, together with the
+ * time it spent in direct reclaim, direct compaction and in congestion
+ * waits before retrying. The per-cpu statistics are folded when read
+ * from debugfs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/gfp.h>
+#include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include <trace/events/kmem.h>
+
+#include "internal.h"
+
+enum alloc_lat_class {
+	ALLOC_LAT_ATOMIC,
+	ALLOC_LAT_NOIO,
+	ALLOC_LAT_NOFS,
+	ALLOC_LAT_KERNEL,
+	ALLOC_LAT_USER,
+	ALLOC_LAT_THP,
+	NR_ALLOC_LAT_CLASSES
+};
+
+static const char * const alloc_lat_class_names[NR_ALLOC_LAT_CLASSES] = {
+	"atomic",
+	"noio",
+	"nofs",
+	"kernel",
+	"user",
+	"thp",
+};
+
+static const char * const alloc_lat_phase_names[NR_ALLOC_LAT_PHASES] = {
+	"reclaim_us",
+	"compact_us",
+	"retry_us",
+};
+
+/*
+ * Bucket 0 counts allocations under 1us, bucket n those under 2^n us and
+ * the last bucket everything slower.
+ */
+#define ALLOC_LAT_BUCKETS	16
+
+struct alloc_lat_bin {
+	unsigned long hist[ALLOC_LAT_BUCKETS];
+	unsigned long failed;
+	unsigned long retries;
+	u64 total_ns;
+	u64 max_ns;
+	u64 phase_ns[NR_ALLOC_LAT_PHASES];
+};
+
+struct alloc_lat_stats {
+	struct alloc_lat_bin bins[NR_ALLOC_LAT_CLASSES][MAX_ORDER];
+};
+
+static struct alloc_lat_stats __percpu *alloc_lat_stats;
+
+static enum alloc_lat_class gfp_to_alloc_lat_class(gfp_t gfp_mask)
+{
+	if ((gfp_mask & GFP_TRANSHUGE) == GFP_TRANSHUGE)
+		return ALLOC_LAT_THP;
+	if (!(gfp_mask & __GFP_WAIT))
+		return ALLOC_LAT_ATOMIC;
+	if (!(gfp_mask & __GFP_IO))
+		return ALLOC_LAT_NOIO;
+	if (!(gfp_mask & __GFP_FS))
+		return ALLOC_LAT_NOFS;
+	if (gfp_mask & (__GFP_HARDWALL | __GFP_MOVABLE))
+		return ALLOC_LAT_USER;
+	return ALLOC_LAT_KERNEL;
+}
+
+static unsigned int alloc_lat_bucket(u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+
+	if (!us)
+		return 0;
+	return min_t(unsigned int, ilog2(us) + 1, ALLOC_LAT_BUCKETS - 1);
+}
+
+/*
+ * Called once at the end of every slowpath allocation, successful or not.
+ */
+void alloc_lat_end(struct alloc_lat *lat, gfp_t gfp_mask, unsigned int order,
+		   struct page *page)
+{
+	struct alloc_lat_bin *bin;
+	u64 delta = local_clock() - lat->start;
+	unsigned long flags;
+	int i;
+
+	trace_mm_page_alloc_slowpath(order, gfp_mask, delta,
+			lat->phase_ns[ALLOC_LAT_RECLAIM],
+			lat->phase_ns[ALLOC_LAT_COMPACT],
+			lat->phase_ns[ALLOC_LAT_RETRY],
+			lat->retries, page != NULL);
+
+	if (!alloc_lat_stats)
+		return;
+
+	/* Atomic allocations can nest from interrupts */
+	local_irq_save(flags);
+	bin = &this_cpu_ptr(alloc_lat_stats)->bins[
+			gfp_to_alloc_lat_class(gfp_mask)][order];
+	bin->hist[alloc_lat_bucket(delta)]++;
+	if (!page)
+		bin->failed++;
+	bin->retries += lat->retries;
+	bin->total_ns += delta;
+	if (delta > bin->max_ns)
+		bin->max_ns = delta;
+	for (i = 0; i < NR_ALLOC_LAT_PHASES; i++)
+		bin->phase_ns[i] += lat->phase_ns[i];
+	local_irq_restore(flags);
+}
+
+/* Fold the per-cpu bins of @class and @order into @sum */
+static void alloc_lat_fold(struct alloc_lat_bin *sum, int class, int order)
+{
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct alloc_lat_bin *bin;
+
+		bin = &per_cpu_ptr(alloc_lat_stats, cpu)->bins[class][order];
+		for (i = 0; i < ALLOC_LAT_BUCKETS; i++)
+			sum->hist[i] += bin->hist[i];
+		sum->failed += bin->failed;
+		sum->retries += bin->retries;
+		sum->total_ns += bin->total_ns;
+		sum->max_ns = max(sum->max_ns, bin->max_ns);
+		for (i = 0; i < NR_ALLOC_LAT_PHASES; i++)
+			sum->phase_ns[i] += bin->phase_ns[i];
+	}
+}
+
+static unsigned long alloc_lat_count(struct alloc_lat_bin *bin)
+{
+	unsigned long count = 0;
+	int i;
+
+	for (i = 0; i < ALLOC_LAT_BUCKETS; i++)
+		count += bin->hist[i];
+	return count;
+}
+
+static int histogram_show(struct seq_file *m, void *v)
+{
+	struct alloc_lat_bin sum;
+	int class, order, i;
+
+	seq_printf(m, "%-8s %5s", "class", "order");
+	for (i = 0; i < ALLOC_LAT_BUCKETS - 1; i++)
+		seq_printf(m, " %7lu", 1UL << i);
+	seq_printf(m, " %7s\n", "more");
+
+	for (class = 0; class < NR_ALLOC_LAT_CLASSES; class++) {
+		for (order = 0; order < MAX_ORDER; order++) {
+			alloc_lat_fold(&sum, class, order);
+			if (!alloc_lat_count(&sum))
+				continue;
+
+			seq_printf(m, "%-8s %5d", alloc_lat_class_names[class],
+				   order);
+			for (i = 0; i < ALLOC_LAT_BUCKETS; i++)
+				seq_printf(m, " %7lu", sum.hist[i]);
+			seq_putc(m, '\n');
+		}
+	}
+
+	return 0;
+}
+
+static int histogram_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, histogram_show, NULL);
+}
+
+static const struct file_operations histogram_fops = {
+	.open		= histogram_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int breakdown_show(struct seq_file *m, void *v)
+{
+	struct alloc_lat_bin sum;
+	int class, order, i;
+
+	seq_printf(m, "%-8s %5s %10s %8s %8s %12s %10s", "class", "order",
+		   "count", "failed", "retries", "total_us", "max_us");
+	for (i = 0; i < NR_ALLOC_LAT_PHASES; i++)
+		seq_printf(m, " %12s", alloc_lat_phase_names[i]);
+	seq_putc(m, '\n');
+
+	for (class = 0; class < NR_ALLOC_LAT_CLASSES; class++) {
+		for (order = 0; order < MAX_ORDER; order++) {
+			alloc_lat_fold(&sum, class, order);
+			if (!alloc_lat_count(&sum))
+				continue;
+
+			seq_printf(m, "%-8s %5d %10lu %8lu %8lu %12llu %10llu",
+				   alloc_lat_class_names[class], order,
+				   alloc_lat_count(&sum), sum.failed,
+				   sum.retries,
+				   div_u64(sum.total_ns, NSEC_PER_USEC),
+				   div_u64(sum.max_ns, NSEC_PER_USEC));
+			for (i = 0; i < NR_ALLOC_LAT_PHASES; i++)
+				seq_printf(m, " %12llu",
+					   div_u64(sum.phase_ns[i],
+						   NSEC_PER_USEC));
+			seq_putc(m, '\n');
+		}
+	}
+
+	return 0;
+}
+
+static int breakdown_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, breakdown_show, NULL);
+}
+
+static const struct file_operations breakdown_fops = {
+	.open		= breakdown_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* Any write clears the statistics, samples racing with it may survive */
+static int reset_set(void *data, u64 val)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(alloc_lat_stats, cpu), 0,
+		       sizeof(struct alloc_lat_stats));
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(reset_fops, NULL, reset_set, "%llu\n");
+
+static int __init alloc_lat_init(void)
+{
+	struct dentry *root;
+
+	alloc_lat_stats = alloc_percpu(struct alloc_lat_stats);
+	if (!alloc_lat_stats)
+		return -ENOMEM;
+
+	root = debugfs_create_dir("page_alloc_latency", NULL);
+	if (!root)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("histogram", 0444, root, NULL,
+				 &histogram_fops))
+		goto fail;
+	if (!debugfs_create_file("breakdown", 0444, root, NULL,
+				 &breakdown_fops))
+		goto fail;
+	if (!debugfs_create_file("reset", 0200, root, NULL, &reset_fops))
+		goto fail;
+
+	return 0;
+fail:
+	debugfs_remove_recursive(root);
+	return -ENOMEM;
+}
+late_initcall(alloc_lat_init);
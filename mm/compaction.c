@@ -17,6 +17,10 @@
 #include <linux/balloon_compaction.h>
 #include <linux/page-isolation.h>
 #include <linux/kasan.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include "internal.h"
 
 #ifdef CONFIG_COMPACTION
@@ -1105,6 +1109,57 @@ static isolate_migrate_t isolate_migratepages(struct zone *zone,
 	return cc->nr_migratepages ? ISOLATE_SUCCESS : ISOLATE_NONE;
 }
 
+/*
+ * Proactive compaction
+ *
+ * kcompactd wakes up every proactive_interval_ms and compacts the nodes
+ * whose fragmentation score is above the trigger until the score drops to
+ * the target. Both follow from compaction_proactiveness, 0 disables it.
+ */
+static unsigned int compaction_proactiveness = 20;
+static unsigned int proactive_interval_ms = 500;
+/* Order of the allocations to keep unfragmented, 64K ion/kgsl chunks */
+static unsigned int proactive_order = PAGE_ALLOC_COSTLY_ORDER + 1;
+/* Percentage of cpu time that must have been idle since the last wakeup */
+static unsigned int proactive_min_idle = 50;
+
+/*
+ * The score of a zone is the percentage of its free memory that is in
+ * blocks below proactive_order, weighted by the zone's share of the node.
+ */
+static unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	u64 score;
+
+	score = (u64)zone->present_pages *
+		extfrag_for_order(zone, proactive_order);
+	return div64_u64(score, zone->zone_pgdat->node_present_pages + 1);
+}
+
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned int score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (populated_zone(zone))
+			score += fragmentation_score_zone(zone);
+	}
+
+	return score;
+}
+
+/* Score to compact down to, or with @trigger the one to start at */
+static unsigned int fragmentation_score_wmark(bool trigger)
+{
+	unsigned int target;
+
+	target = max(100U - min(compaction_proactiveness, 100U), 5U);
+	return trigger ? min(target + 10, 100U) : target;
+}
+
 static int compact_finished(struct zone *zone, struct compact_control *cc,
 			    const int migratetype)
 {
@@ -1133,6 +1188,10 @@ static int compact_finished(struct zone *zone, struct compact_control *cc,
 		return COMPACT_COMPLETE;
 	}
 
+	if (cc->proactive && fragmentation_score_node(zone->zone_pgdat) <=
+			fragmentation_score_wmark(false))
+		return COMPACT_PARTIAL;
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -1552,6 +1611,329 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+static DECLARE_WAIT_QUEUE_HEAD(kcompactd_wait);
+static unsigned int proactive_defer[MAX_NUMNODES];
+static u64 proactive_prev_idle_us, proactive_prev_wall_us;
+
+/* Proactive compaction statistics */
+static unsigned long proactive_runs;
+static unsigned long proactive_complete;
+static unsigned long proactive_deferred;
+static unsigned long proactive_skipped_busy;
+
+static u64 proactive_cpu_idle_us(int cpu)
+{
+	u64 idle = get_cpu_idle_time_us(cpu, NULL);
+
+	/* Without nohz idle accounting fall back to the tick based one */
+	if (idle == -1ULL)
+		idle = cputime_to_usecs(kcpustat_cpu(cpu).cpustat[CPUTIME_IDLE]);
+
+	return idle;
+}
+
+/*
+ * Was the machine idle enough since the last call? Compaction migrates
+ * pages with the cpu, so only do it when nothing else wants to run.
+ */
+static bool proactive_cpus_idle(void)
+{
+	u64 idle = 0, wall = ktime_to_us(ktime_get());
+	u64 idle_delta, wall_delta;
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		idle += proactive_cpu_idle_us(cpu);
+
+	idle_delta = idle - proactive_prev_idle_us;
+	wall_delta = (wall - proactive_prev_wall_us) * num_online_cpus();
+	proactive_prev_idle_us = idle;
+	proactive_prev_wall_us = wall;
+
+	/* cpu hotplug moves the idle sum backwards */
+	if (!wall_delta || (s64)idle_delta < 0)
+		return false;
+
+	return idle_delta * 100 >= wall_delta * proactive_min_idle;
+}
+
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	struct compact_control cc = {
+		.order = -1,
+		.mode = MIGRATE_SYNC_LIGHT,
+		.ignore_skip_hint = true,
+		.proactive = true,
+	};
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		/* Don't push a zone that is short of memory into reclaim */
+		if (!zone_watermark_ok(zone, 0, high_wmark_pages(zone), 0, 0))
+			continue;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		compact_zone(zone, &cc);
+		proactive_runs++;
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
+static void proactive_compact_nodes(void)
+{
+	unsigned int prev_score, score;
+	int nid;
+
+	if (!proactive_cpus_idle()) {
+		proactive_skipped_busy++;
+		return;
+	}
+
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		if (proactive_defer[nid]) {
+			proactive_defer[nid]--;
+			continue;
+		}
+
+		prev_score = fragmentation_score_node(pgdat);
+		if (prev_score <= fragmentation_score_wmark(true))
+			continue;
+
+		proactive_compact_node(pgdat);
+
+		score = fragmentation_score_node(pgdat);
+		if (score <= fragmentation_score_wmark(false)) {
+			proactive_complete++;
+		} else if (score >= prev_score) {
+			/* No progress, leave the node alone for a while */
+			proactive_defer[nid] = 1 << COMPACT_MAX_DEFER_SHIFT;
+			proactive_deferred++;
+		}
+	}
+}
+
+static int kcompactd(void *p)
+{
+	set_freezable();
+	set_user_nice(current, MAX_NICE);
+	proactive_cpus_idle();
+
+	while (!kthread_should_stop()) {
+		if (!ACCESS_ONCE(compaction_proactiveness))
+			wait_event_freezable(kcompactd_wait,
+				ACCESS_ONCE(compaction_proactiveness) ||
+				kthread_should_stop());
+		else
+			wait_event_freezable_timeout(kcompactd_wait,
+				kthread_should_stop(),
+				msecs_to_jiffies(proactive_interval_ms));
+
+		if (kthread_should_stop())
+			break;
+
+		if (ACCESS_ONCE(compaction_proactiveness))
+			proactive_compact_nodes();
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+#define COMPACTION_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define COMPACTION_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t proactiveness_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", compaction_proactiveness);
+}
+
+static ssize_t proactiveness_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	err = kstrtoul(buf, 10, &val);
+	if (err || val > 100)
+		return -EINVAL;
+
+	compaction_proactiveness = val;
+	wake_up_interruptible(&kcompactd_wait);
+
+	return count;
+}
+COMPACTION_ATTR(proactiveness);
+
+static ssize_t proactive_interval_ms_show(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  char *buf)
+{
+	return sprintf(buf, "%u\n", proactive_interval_ms);
+}
+
+static ssize_t proactive_interval_ms_store(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = kstrtoul(buf, 10, &msecs);
+	if (err || !msecs || msecs > UINT_MAX)
+		return -EINVAL;
+
+	proactive_interval_ms = msecs;
+
+	return count;
+}
+COMPACTION_ATTR(proactive_interval_ms);
+
+static ssize_t proactive_order_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", proactive_order);
+}
+
+static ssize_t proactive_order_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned long order;
+	int err;
+
+	err = kstrtoul(buf, 10, &order);
+	if (err || !order || order >= MAX_ORDER)
+		return -EINVAL;
+
+	proactive_order = order;
+
+	return count;
+}
+COMPACTION_ATTR(proactive_order);
+
+static ssize_t proactive_min_idle_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", proactive_min_idle);
+}
+
+static ssize_t proactive_min_idle_store(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	err = kstrtoul(buf, 10, &val);
+	if (err || val > 100)
+		return -EINVAL;
+
+	proactive_min_idle = val;
+
+	return count;
+}
+COMPACTION_ATTR(proactive_min_idle);
+
+/* The highest node score, the one kcompactd compares to its trigger */
+static ssize_t fragmentation_score_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	unsigned int score = 0;
+	int nid;
+
+	for_each_online_node(nid)
+		score = max(score, fragmentation_score_node(NODE_DATA(nid)));
+
+	return sprintf(buf, "%u\n", score);
+}
+COMPACTION_ATTR_RO(fragmentation_score);
+
+static ssize_t proactive_runs_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", proactive_runs);
+}
+COMPACTION_ATTR_RO(proactive_runs);
+
+static ssize_t proactive_complete_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", proactive_complete);
+}
+COMPACTION_ATTR_RO(proactive_complete);
+
+static ssize_t proactive_deferred_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", proactive_deferred);
+}
+COMPACTION_ATTR_RO(proactive_deferred);
+
+static ssize_t proactive_skipped_busy_show(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   char *buf)
+{
+	return sprintf(buf, "%lu\n", proactive_skipped_busy);
+}
+COMPACTION_ATTR_RO(proactive_skipped_busy);
+
+static struct attribute *compaction_attrs[] = {
+	&proactiveness_attr.attr,
+	&proactive_interval_ms_attr.attr,
+	&proactive_order_attr.attr,
+	&proactive_min_idle_attr.attr,
+	&fragmentation_score_attr.attr,
+	&proactive_runs_attr.attr,
+	&proactive_complete_attr.attr,
+	&proactive_deferred_attr.attr,
+	&proactive_skipped_busy_attr.attr,
+	NULL,
+};
+
+static struct attribute_group compaction_attr_group = {
+	.attrs = compaction_attrs,
+	.name = "compaction",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init kcompactd_init(void)
+{
+	struct task_struct *kcompactd_thread;
+
+	kcompactd_thread = kthread_run(kcompactd, NULL, "kcompactd");
+	if (IS_ERR(kcompactd_thread)) {
+		pr_err("compaction: creating kcompactd failed\n");
+		return PTR_ERR(kcompactd_thread);
+	}
+
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &compaction_attr_group))
+		pr_err("compaction: register sysfs failed\n");
+#endif
+
+	return 0;
+}
+subsys_initcall(kcompactd_init);
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 static ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
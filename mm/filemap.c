@@ -35,6 +35,7 @@
 #include <linux/memcontrol.h>
 #include <linux/cleancache.h>
 #include <linux/rmap.h>
+#include <linux/psi.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -633,6 +634,7 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 		 */
 		if (shadow && workingset_refault(shadow)) {
 			SetPageActive(page);
+			SetPageWorkingset(page);
 			workingset_activation(page);
 		} else
 			ClearPageActive(page);
@@ -681,25 +683,56 @@ wait_queue_head_t *page_waitqueue(struct page *page)
 }
 EXPORT_SYMBOL(page_waitqueue);
 
+/*
+ * PG_workingset is set on page cache pages that workingset_refault()
+ * finds were evicted while still part of the workingset, and on every
+ * page read back from swap. Waiting for such a page to be read back in
+ * is a memory stall, not just IO.
+ */
+static inline bool page_thrashing(struct page *page, int bit_nr)
+{
+	return bit_nr == PG_locked && !PageUptodate(page) &&
+		PageWorkingset(page);
+}
+
 void wait_on_page_bit(struct page *page, int bit_nr)
 {
 	DEFINE_WAIT_BIT(wait, &page->flags, bit_nr);
+	unsigned long pflags;
+	bool thrashing;
 
-	if (test_bit(bit_nr, &page->flags))
-		__wait_on_bit(page_waitqueue(page), &wait, bit_wait_io,
-							TASK_UNINTERRUPTIBLE);
+	if (!test_bit(bit_nr, &page->flags))
+		return;
+
+	thrashing = page_thrashing(page, bit_nr);
+	if (thrashing)
+		psi_memstall_enter(&pflags);
+	__wait_on_bit(page_waitqueue(page), &wait, bit_wait_io,
+						TASK_UNINTERRUPTIBLE);
+	if (thrashing)
+		psi_memstall_leave(&pflags);
 }
 EXPORT_SYMBOL(wait_on_page_bit);
 
 int wait_on_page_bit_killable(struct page *page, int bit_nr)
 {
 	DEFINE_WAIT_BIT(wait, &page->flags, bit_nr);
+	unsigned long pflags;
+	bool thrashing;
+	int ret;
 
 	if (!test_bit(bit_nr, &page->flags))
 		return 0;
 
-	return __wait_on_bit(page_waitqueue(page), &wait,
+	thrashing = page_thrashing(page, bit_nr);
+	if (thrashing)
+		psi_memstall_enter(&pflags);
+	ret = __wait_on_bit(page_waitqueue(page), &wait,
 			     bit_wait_io, TASK_KILLABLE);
+	if (thrashing)
+		psi_memstall_leave(&pflags);
+
+	return ret;
 }
 
 int wait_on_page_bit_killable_timeout(struct page *page,
@@ -812,18 +845,33 @@ EXPORT_SYMBOL_GPL(page_endio);
 void __lock_page(struct page *page)
 {
 	DEFINE_WAIT_BIT(wait, &page->flags, PG_locked);
+	bool thrashing = page_thrashing(page, PG_locked);
+	unsigned long pflags;
 
+	if (thrashing)
+		psi_memstall_enter(&pflags);
 	__wait_on_bit_lock(page_waitqueue(page), &wait, bit_wait_io,
 							TASK_UNINTERRUPTIBLE);
+	if (thrashing)
+		psi_memstall_leave(&pflags);
 }
 EXPORT_SYMBOL(__lock_page);
 
 int __lock_page_killable(struct page *page)
 {
 	DEFINE_WAIT_BIT(wait, &page->flags, PG_locked);
+	bool thrashing = page_thrashing(page, PG_locked);
+	unsigned long pflags;
+	int ret;
 
-	return __wait_on_bit_lock(page_waitqueue(page), &wait,
+	if (thrashing)
+		psi_memstall_enter(&pflags);
+	ret = __wait_on_bit_lock(page_waitqueue(page), &wait,
 					bit_wait_io, TASK_KILLABLE);
+	if (thrashing)
+		psi_memstall_leave(&pflags);
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
@@ -1723,6 +1723,7 @@ static void __split_huge_page_refcount(struct page *page,
 				      (1L << PG_mlocked) |
 				      (1L << PG_uptodate) |
 				      (1L << PG_active) |
+				      (1L << PG_workingset) |
 				      (1L << PG_unevictable)));
 		page_tail->flags |= (1L << PG_dirty);
 
@@ -166,6 +166,7 @@ struct compact_control {
 					 * no longer being updated
 					 */
 	bool finished_update_migrate;
+	bool proactive;			/* Stop at the fragmentation target */
 
 	int order;			/* order a direct compactor needs */
 	const gfp_t gfp_mask;		/* gfp mask of a direct compactor */
@@ -411,4 +412,74 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 #define ALLOC_CMA		0x80 /* allow allocations from CMA areas */
 #define ALLOC_FAIR		0x100 /* fair zone allocation */
 
+/* Where the page allocator slowpath spends its time, see alloc_latency.c */
+enum alloc_lat_phase {
+	ALLOC_LAT_RECLAIM,	/* direct reclaim */
+	ALLOC_LAT_COMPACT,	/* direct compaction */
+	ALLOC_LAT_RETRY,	/* congestion wait before a retry */
+	NR_ALLOC_LAT_PHASES
+};
+
+#ifdef CONFIG_PAGE_ALLOC_LATENCY
+#include <linux/sched.h>
+
+struct alloc_lat {
+	u64 start;
+	u64 phase_ns[NR_ALLOC_LAT_PHASES];
+	unsigned int retries;
+};
+
+static inline u64 alloc_lat_clock(void)
+{
+	return local_clock();
+}
+
+static inline void alloc_lat_begin(struct alloc_lat *lat)
+{
+	memset(lat, 0, sizeof(*lat));
+	lat->start = local_clock();
+}
+
+/* Charge the time since @since to @phase */
+static inline void alloc_lat_account(struct alloc_lat *lat,
+				     enum alloc_lat_phase phase, u64 since)
+{
+	lat->phase_ns[phase] += local_clock() - since;
+}
+
+static inline void alloc_lat_retry(struct alloc_lat *lat)
+{
+	lat->retries++;
+}
+
+extern void alloc_lat_end(struct alloc_lat *lat, gfp_t gfp_mask,
+			  unsigned int order, struct page *page);
+#else
+struct alloc_lat {
+};
+
+static inline u64 alloc_lat_clock(void)
+{
+	return 0;
+}
+
+static inline void alloc_lat_begin(struct alloc_lat *lat)
+{
+}
+
+static inline void alloc_lat_account(struct alloc_lat *lat,
+				     enum alloc_lat_phase phase, u64 since)
+{
+}
+
+static inline void alloc_lat_retry(struct alloc_lat *lat)
+{
+}
+
+static inline void alloc_lat_end(struct alloc_lat *lat, gfp_t gfp_mask,
+				 unsigned int order, struct page *page)
+{
+}
+#endif /* CONFIG_PAGE_ALLOC_LATENCY */
+
 #endif	/* __MM_INTERNAL_H */
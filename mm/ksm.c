@@ -37,6 +37,7 @@
 #include <linux/freezer.h>
 #include <linux/oom.h>
 #include <linux/numa.h>
+#include <linux/math64.h>
 #include <linux/show_mem_notifier.h>
 
 #include <asm/tlbflush.h>
@@ -227,6 +228,27 @@ static unsigned int ksm_thread_sleep_millisecs = 20;
 /* Boolean to indicate whether to use deferred timer or not */
 static bool use_deferred_timer;
 
+/*
+ * Self-tuning of the scan rate: ksmd scans more when its batches find
+ * pages to merge and backs off, down to sleeping longer, when they don't.
+ * pages_to_scan is kept within [auto_min_pages, auto_max_pages], the
+ * sleep between sleep_millisecs and auto_max_sleep_millisecs, and ksmd's
+ * own cpu time under auto_max_cpu_percent.
+ */
+static bool ksm_auto_tune;
+static unsigned int ksm_auto_min_pages = 32;
+static unsigned int ksm_auto_max_pages = 4096;
+static unsigned int ksm_auto_max_sleep_millisecs = 1000;
+static unsigned int ksm_auto_max_cpu_percent = 10;
+static unsigned int ksm_auto_sleep_millisecs = 20;
+
+/* Merges per thousand scanned pages that speed up or slow down ksmd */
+#define KSM_AUTO_YIELD_HIGH	10
+#define KSM_AUTO_YIELD_LOW	1
+
+/* The number of pages merged into the stable tree since boot */
+static unsigned long ksm_pages_merged;
+
 #ifdef CONFIG_NUMA
 /* Zeroed when merging across nodes is not allowed */
 static unsigned int ksm_merge_across_nodes = 1;
@@ -311,6 +333,7 @@ static inline struct rmap_item *alloc_rmap_item(void)
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
 	ksm_rmap_items--;
+	rmap_item->mm->ksm_rmap_items--;
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -520,6 +543,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
@@ -648,6 +672,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 			ksm_pages_sharing--;
 		else
 			ksm_pages_shared--;
+		rmap_item->mm->ksm_merging_pages--;
 
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
@@ -1420,6 +1445,8 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	rmap_item->mm->ksm_merging_pages++;
+	ksm_pages_merged++;
 }
 
 /*
@@ -1572,6 +1599,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	if (rmap_item) {
 		/* It has already been zeroed */
 		rmap_item->mm = mm_slot->mm;
+		rmap_item->mm->ksm_rmap_items++;
 		rmap_item->address = addr;
 		rmap_item->rmap_list = *rmap_list;
 		*rmap_list = rmap_item;
@@ -1736,20 +1764,77 @@ next_mm:
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
+ *
+ * Returns the number of pages actually scanned.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static unsigned int ksm_do_scan(unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	unsigned int scanned = 0;
 
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
-			return;
+			break;
 		cmp_and_merge_page(page, rmap_item);
 		put_page(page);
+		scanned++;
 	}
+
+	return scanned;
+}
+
+/*
+ * Adjust the scan rate after a batch of @scanned pages that merged
+ * @merged of them and cost ksmd @runtime ns of cpu.
+ */
+static void ksm_auto_tune_rate(unsigned int scanned, unsigned long merged,
+			       u64 runtime)
+{
+	unsigned int pages = ksm_thread_pages_to_scan;
+	unsigned int sleep = ksm_auto_sleep_millisecs;
+	unsigned long yield;
+	unsigned int cpu;
+	u64 period;
+
+	if (!scanned)
+		return;
+
+	yield = merged * 1000 / scanned;
+	if (yield >= KSM_AUTO_YIELD_HIGH) {
+		/* Merges are coming in: first wake up sooner, then scan more */
+		if (sleep > ksm_thread_sleep_millisecs)
+			sleep /= 2;
+		else
+			pages += pages / 4 + 1;
+	} else if (yield < KSM_AUTO_YIELD_LOW) {
+		/* Nothing to merge: scan less, then sleep longer */
+		if (pages > ksm_auto_min_pages)
+			pages -= pages / 4;
+		else
+			sleep *= 2;
+	}
+
+	sleep = max(min(sleep, ksm_auto_max_sleep_millisecs),
+		    ksm_thread_sleep_millisecs);
+
+	/* Keep ksmd within its share of the cpu */
+	period = runtime + (u64)sleep * NSEC_PER_MSEC;
+	cpu = div64_u64(runtime * 100, period);
+	if (cpu > ksm_auto_max_cpu_percent)
+		pages = div_u64((u64)pages * ksm_auto_max_cpu_percent, cpu);
+
+	ksm_thread_pages_to_scan = max(min(pages, ksm_auto_max_pages),
+				       ksm_auto_min_pages);
+	ksm_auto_sleep_millisecs = sleep;
+}
+
+static unsigned int ksm_sleep_millisecs(void)
+{
+	return ksm_auto_tune ? ksm_auto_sleep_millisecs :
+			       ksm_thread_sleep_millisecs;
 }
 
 static void process_timeout(unsigned long __data)
@@ -1800,8 +1885,17 @@ static int ksm_scan_thread(void *nothing)
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
 		wait_while_offlining();
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+		if (ksmd_should_run()) {
+			unsigned long merged = ksm_pages_merged;
+			u64 runtime = task_sched_runtime(current);
+			unsigned int scanned;
+
+			scanned = ksm_do_scan(ksm_thread_pages_to_scan);
+			if (ksm_auto_tune)
+				ksm_auto_tune_rate(scanned,
+					ksm_pages_merged - merged,
+					task_sched_runtime(current) - runtime);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1809,10 +1903,10 @@ static int ksm_scan_thread(void *nothing)
 		if (ksmd_should_run()) {
 			if (use_deferred_timer)
 				deferred_schedule_timeout(
-				msecs_to_jiffies(ksm_thread_sleep_millisecs));
+				msecs_to_jiffies(ksm_sleep_millisecs()));
 			else
 				schedule_timeout_interruptible(
-				msecs_to_jiffies(ksm_thread_sleep_millisecs));
+				msecs_to_jiffies(ksm_sleep_millisecs()));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
@@ -1821,6 +1915,24 @@ static int ksm_scan_thread(void *nothing)
 	return 0;
 }
 
+/*
+ * Be somewhat over-protective for now!
+ */
+static bool vma_ksm_compatible(unsigned long vm_flags)
+{
+	if (vm_flags & (VM_SHARED  | VM_MAYSHARE   |
+			VM_PFNMAP    | VM_IO      | VM_DONTEXPAND |
+			VM_HUGETLB | VM_NONLINEAR | VM_MIXEDMAP))
+		return false;
+
+#ifdef VM_SAO
+	if (vm_flags & VM_SAO)
+		return false;
+#endif
+
+	return true;
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -1829,19 +1941,9 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 
 	switch (advice) {
 	case MADV_MERGEABLE:
-		/*
-		 * Be somewhat over-protective for now!
-		 */
-		if (*vm_flags & (VM_MERGEABLE | VM_SHARED  | VM_MAYSHARE   |
-				 VM_PFNMAP    | VM_IO      | VM_DONTEXPAND |
-				 VM_HUGETLB | VM_NONLINEAR | VM_MIXEDMAP))
+		if ((*vm_flags & VM_MERGEABLE) || !vma_ksm_compatible(*vm_flags))
 			return 0;		/* just ignore the advice */
 
-#ifdef VM_SAO
-		if (*vm_flags & VM_SAO)
-			return 0;
-#endif
-
 		if (!test_bit(MMF_VM_MERGEABLE, &mm->flags)) {
 			err = __ksm_enter(mm);
 			if (err)
@@ -1868,6 +1970,77 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 	return 0;
 }
 
+vm_flags_t __ksm_vma_flags(struct mm_struct *mm, vm_flags_t vm_flags)
+{
+	if (!vma_ksm_compatible(vm_flags))
+		return vm_flags;
+
+	if (!test_bit(MMF_VM_MERGEABLE, &mm->flags) && __ksm_enter(mm))
+		return vm_flags;
+
+	return vm_flags | VM_MERGEABLE;
+}
+
+/**
+ * ksm_enable_merge_any - let ksm merge all anonymous memory of @mm
+ * @mm: the mm_struct, its mmap_sem must be held for writing
+ *
+ * Marks the existing anonymous vmas mergeable, new ones get VM_MERGEABLE
+ * through ksm_vma_flags().
+ */
+int ksm_enable_merge_any(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	int err;
+
+	if (test_bit(MMF_VM_MERGE_ANY, &mm->flags))
+		return 0;
+
+	if (!test_bit(MMF_VM_MERGEABLE, &mm->flags)) {
+		err = __ksm_enter(mm);
+		if (err)
+			return err;
+	}
+
+	set_bit(MMF_VM_MERGE_ANY, &mm->flags);
+	for (vma = mm->mmap; vma; vma = vma->vm_next)
+		if (!vma->vm_file && vma_ksm_compatible(vma->vm_flags))
+			vma->vm_flags |= VM_MERGEABLE;
+
+	return 0;
+}
+
+/**
+ * ksm_disable_merge_any - undo ksm_enable_merge_any()
+ * @mm: the mm_struct, its mmap_sem must be held for writing
+ *
+ * Unmerges every anonymous vma, including those that were madvised.
+ */
+int ksm_disable_merge_any(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	int err;
+
+	if (!test_bit(MMF_VM_MERGE_ANY, &mm->flags))
+		return 0;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_file || !(vma->vm_flags & VM_MERGEABLE))
+			continue;
+
+		if (vma->anon_vma) {
+			err = unmerge_ksm_pages(vma, vma->vm_start,
+						vma->vm_end);
+			if (err)
+				return err;
+		}
+		vma->vm_flags &= ~VM_MERGEABLE;
+	}
+	clear_bit(MMF_VM_MERGE_ANY, &mm->flags);
+
+	return 0;
+}
+
 int __ksm_enter(struct mm_struct *mm)
 {
 	struct mm_slot *mm_slot;
@@ -2282,6 +2455,135 @@ static ssize_t deferred_timer_store(struct kobject *kobj,
 }
 KSM_ATTR(deferred_timer);
 
+static ssize_t auto_tune_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", ksm_auto_tune);
+}
+
+static ssize_t auto_tune_store(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	unsigned long enable;
+	int err;
+
+	err = kstrtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	if (enable && !ksm_auto_tune)
+		ksm_auto_sleep_millisecs = ksm_thread_sleep_millisecs;
+	ksm_auto_tune = enable;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(auto_tune);
+
+static ssize_t auto_min_pages_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_min_pages);
+}
+
+static ssize_t auto_min_pages_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	unsigned long nr_pages;
+	int err;
+
+	err = kstrtoul(buf, 10, &nr_pages);
+	if (err || !nr_pages || nr_pages > ksm_auto_max_pages)
+		return -EINVAL;
+
+	ksm_auto_min_pages = nr_pages;
+
+	return count;
+}
+KSM_ATTR(auto_min_pages);
+
+static ssize_t auto_max_pages_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_max_pages);
+}
+
+static ssize_t auto_max_pages_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	unsigned long nr_pages;
+	int err;
+
+	err = kstrtoul(buf, 10, &nr_pages);
+	if (err || nr_pages < ksm_auto_min_pages || nr_pages > UINT_MAX)
+		return -EINVAL;
+
+	ksm_auto_max_pages = nr_pages;
+
+	return count;
+}
+KSM_ATTR(auto_max_pages);
+
+static ssize_t auto_max_sleep_millisecs_show(struct kobject *kobj,
+					     struct kobj_attribute *attr,
+					     char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_max_sleep_millisecs);
+}
+
+static ssize_t auto_max_sleep_millisecs_store(struct kobject *kobj,
+					      struct kobj_attribute *attr,
+					      const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = kstrtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	ksm_auto_max_sleep_millisecs = msecs;
+
+	return count;
+}
+KSM_ATTR(auto_max_sleep_millisecs);
+
+static ssize_t auto_max_cpu_percent_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_max_cpu_percent);
+}
+
+static ssize_t auto_max_cpu_percent_store(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	unsigned long percent;
+	int err;
+
+	err = kstrtoul(buf, 10, &percent);
+	if (err || !percent || percent > 100)
+		return -EINVAL;
+
+	ksm_auto_max_cpu_percent = percent;
+
+	return count;
+}
+KSM_ATTR(auto_max_cpu_percent);
+
+static ssize_t auto_sleep_millisecs_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_sleep_millisecs());
+}
+KSM_ATTR_RO(auto_sleep_millisecs);
+
 #ifdef CONFIG_NUMA
 static ssize_t merge_across_nodes_show(struct kobject *kobj,
 				struct kobj_attribute *attr, char *buf)
@@ -2385,6 +2687,13 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -2395,6 +2704,13 @@ static struct attribute *ksm_attrs[] = {
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
 	&deferred_timer_attr.attr,
+	&auto_tune_attr.attr,
+	&auto_min_pages_attr.attr,
+	&auto_max_pages_attr.attr,
+	&auto_max_sleep_millisecs_attr.attr,
+	&auto_max_cpu_percent_attr.attr,
+	&auto_sleep_millisecs_attr.attr,
+	&pages_merged_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
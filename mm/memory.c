@@ -2441,6 +2441,11 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		ret = VM_FAULT_MAJOR;
 		count_vm_event(PGMAJFAULT);
 		mem_cgroup_count_vm_event(mm, PGMAJFAULT);
+#ifdef CONFIG_PROCESS_RECLAIM
+		/* only count the pages process reclaim pushed out */
+		if (swap_test_clear_reclaimed(entry))
+			atomic_long_inc(&mm->reclaim_refaults);
+#endif
 	} else if (PageHWPoison(page)) {
 		/*
 		 * hwpoisoned dirty swapcache pages are kept for killing
@@ -35,6 +35,7 @@
 #include <linux/perf_event.h>
 #include <linux/audit.h>
 #include <linux/khugepaged.h>
+#include <linux/ksm.h>
 #include <linux/uprobes.h>
 #include <linux/rbtree_augmented.h>
 #include <linux/sched/sysctl.h>
@@ -1653,6 +1654,8 @@ munmap_back:
 		vm_flags |= VM_ACCOUNT;
 	}
 
+	vm_flags = ksm_vma_flags(mm, file, vm_flags);
+
 	/*
 	 * Can we just expand an old mapping?
 	 */
@@ -2782,6 +2785,8 @@ static unsigned long do_brk(unsigned long addr, unsigned long len)
 	if (security_vm_enough_memory_mm(mm, len >> PAGE_SHIFT))
 		return -ENOMEM;
 
+	flags = ksm_vma_flags(mm, NULL, flags);
+
 	/* Can we just expand an old private anonymous mapping? */
 	vma = vma_merge(mm, prev, addr, addr + len, flags,
 					NULL, NULL, pgoff, NULL, NULL);
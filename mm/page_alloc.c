@@ -60,6 +60,7 @@
 #include <linux/page-debug-flags.h>
 #include <linux/hugetlb.h>
 #include <linux/sched/rt.h>
+#include <linux/psi.h>
 
 #include <asm/sections.h>
 #include <asm/tlbflush.h>
@@ -2493,11 +2494,13 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 {
 	struct zone *last_compact_zone = NULL;
 	unsigned long compact_result;
+	unsigned long pflags;
 	struct page *page;
 
 	if (!order)
 		return NULL;
 
+	psi_memstall_enter(&pflags);
 	current->flags |= PF_MEMALLOC;
 	compact_result = try_to_compact_pages(zonelist, order, gfp_mask,
 						nodemask, mode,
@@ -2505,6 +2508,7 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 						alloc_flags, classzone_idx,
 						&last_compact_zone);
 	current->flags &= ~PF_MEMALLOC;
+	psi_memstall_leave(&pflags);
 
 	switch (compact_result) {
 	case COMPACT_DEFERRED:
@@ -2577,11 +2581,13 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order, struct zonelist *zonelist,
 {
 	struct reclaim_state reclaim_state;
 	int progress;
+	unsigned long pflags;
 
 	cond_resched();
 
 	/* We now go into synchronous reclaim */
 	cpuset_memory_pressure_bump();
+	psi_memstall_enter(&pflags);
 	current->flags |= PF_MEMALLOC;
 	lockdep_set_current_reclaim_state(gfp_mask);
 	reclaim_state.reclaimed_slab = 0;
@@ -2592,6 +2598,7 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order, struct zonelist *zonelist,
 	current->reclaim_state = NULL;
 	lockdep_clear_current_reclaim_state();
 	current->flags &= ~PF_MEMALLOC;
+	psi_memstall_leave(&pflags);
 
 	cond_resched();
 
@@ -2761,6 +2768,8 @@ __alloc_pages_slowpath(gfp_t gfp_mask, unsigned int order,
 	enum migrate_mode migration_mode = MIGRATE_ASYNC;
 	bool deferred_compaction = false;
 	int contended_compaction = COMPACT_CONTENDED_NONE;
+	struct alloc_lat lat;
+	u64 phase_start;
 
 	/*
 	 * In the slowpath, we sanity check order to avoid ever trying to
@@ -2773,6 +2782,8 @@ __alloc_pages_slowpath(gfp_t gfp_mask, unsigned int order,
 		return NULL;
 	}
 
+	alloc_lat_begin(&lat);
+
 	/*
 	 * GFP_THISNODE (meaning __GFP_THISNODE, __GFP_NORETRY and
 	 * __GFP_NOWARN set) should not cause reclaim since the subsystem
@@ -2856,12 +2867,14 @@ rebalance:
 	 * Try direct compaction. The first pass is asynchronous. Subsequent
 	 * attempts after direct reclaim are synchronous
 	 */
+	phase_start = alloc_lat_clock();
 	page = __alloc_pages_direct_compact(gfp_mask, order, zonelist,
 					high_zoneidx, nodemask, alloc_flags,
 					preferred_zone,
 					classzone_idx, migratetype,
 					migration_mode, &contended_compaction,
 					&deferred_compaction);
+	alloc_lat_account(&lat, ALLOC_LAT_COMPACT, phase_start);
 	if (page)
 		goto got_pg;
 
@@ -2906,12 +2919,14 @@ rebalance:
 		migration_mode = MIGRATE_SYNC_LIGHT;
 
 	/* Try direct reclaim and then allocating */
+	phase_start = alloc_lat_clock();
 	page = __alloc_pages_direct_reclaim(gfp_mask, order,
 					zonelist, high_zoneidx,
 					nodemask,
 					alloc_flags, preferred_zone,
 					classzone_idx, migratetype,
 					&did_some_progress);
+	alloc_lat_account(&lat, ALLOC_LAT_RECLAIM, phase_start);
 	if (page)
 		goto got_pg;
 
@@ -2952,6 +2967,7 @@ rebalance:
 					goto nopage;
 			}
 
+			alloc_lat_retry(&lat);
 			goto restart;
 		}
 	}
@@ -2961,7 +2977,10 @@ rebalance:
 	if (should_alloc_retry(gfp_mask, order, did_some_progress,
 						pages_reclaimed)) {
 		/* Wait for some write requests to complete then retry */
+		phase_start = alloc_lat_clock();
 		wait_iff_congested(preferred_zone, BLK_RW_ASYNC, HZ/50);
+		alloc_lat_account(&lat, ALLOC_LAT_RETRY, phase_start);
+		alloc_lat_retry(&lat);
 		goto rebalance;
 	} else {
 		/*
@@ -2969,20 +2988,24 @@ rebalance:
 		 * direct reclaim and reclaim/compaction depends on compaction
 		 * being called after reclaim so call directly if necessary
 		 */
+		phase_start = alloc_lat_clock();
 		page = __alloc_pages_direct_compact(gfp_mask, order, zonelist,
 					high_zoneidx, nodemask, alloc_flags,
 					preferred_zone,
 					classzone_idx, migratetype,
 					migration_mode, &contended_compaction,
 					&deferred_compaction);
+		alloc_lat_account(&lat, ALLOC_LAT_COMPACT, phase_start);
 		if (page)
 			goto got_pg;
 	}
 
 nopage:
+	alloc_lat_end(&lat, gfp_mask, order, NULL);
 	warn_alloc_failed(gfp_mask, order, NULL);
 	return page;
 got_pg:
+	alloc_lat_end(&lat, gfp_mask, order, page);
 	if (kmemcheck_enabled)
 		kmemcheck_pagealloc_alloc(page, order, gfp_mask);
 
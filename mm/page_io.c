@@ -17,6 +17,7 @@
 #include <linux/swap.h>
 #include <linux/bio.h>
 #include <linux/swapops.h>
+#include <linux/swapfile.h>
 #include <linux/buffer_head.h>
 #include <linux/writeback.h>
 #include <linux/frontswap.h>
@@ -69,6 +70,12 @@ void end_swap_bio_write(struct bio *bio, int err)
 				iminor(bio->bi_bdev->bd_inode),
 				(unsigned long long)bio->bi_iter.bi_sector);
 		ClearPageReclaim(page);
+	} else if (bio->bi_private && PageSwapCache(page)) {
+		/* __swap_writepage() stashed the submit time in bi_private */
+		unsigned long start = (unsigned long)bio->bi_private;
+
+		swap_ratio_account_write(page_swap_info(page),
+				(unsigned long)ktime_get_ns() - start);
 	}
 	end_page_writeback(page);
 	bio_put(bio);
@@ -265,6 +272,8 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 	struct bio *bio;
 	int ret, rw = WRITE;
 	struct swap_info_struct *sis = page_swap_info(page);
+	bool sample = swap_ratio_sample(sis);
+	u64 start = sample ? ktime_get_ns() : 0;
 
 	if (sis->flags & SWP_FILE) {
 		struct kiocb kiocb;
@@ -294,6 +303,9 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 						kiocb.ki_pos);
 		if (ret == PAGE_SIZE) {
 			count_vm_event(PSWPOUT);
+			if (sample)
+				swap_ratio_account_write(sis,
+						ktime_get_ns() - start);
 			ret = 0;
 		} else {
 			/*
@@ -318,6 +330,8 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 	ret = bdev_write_page(sis->bdev, swap_page_sector(page), page, wbc);
 	if (!ret) {
 		count_vm_event(PSWPOUT);
+		if (sample)
+			swap_ratio_account_write(sis, ktime_get_ns() - start);
 		return 0;
 	}
 
@@ -331,6 +345,9 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 	}
 	if (wbc->sync_mode == WB_SYNC_ALL)
 		rw |= REQ_SYNC;
+	/* end_swap_bio_write() doesn't use bi_private otherwise */
+	if (sample)
+		bio->bi_private = (void *)(unsigned long)ktime_get_ns();
 	count_vm_event(PSWPOUT);
 	set_page_writeback(page);
 	unlock_page(page);
@@ -74,6 +74,8 @@ static int monitor_eff;
 struct selected_task {
 	struct task_struct *p;
 	int tasksize;
+	/* anon pages the last walk found unreferenced, see task_cold() */
+	int cold;
 	short oom_score_adj;
 };
 
@@ -107,17 +109,33 @@ static int test_task_flag(struct task_struct *p, int flag)
 	return 0;
 }
 
+/*
+ * Estimated cold anon pages of @mm. Each reclaim walk clears the young
+ * bits it finds and counts the pages that had none, so the estimate
+ * covers the period between the last two walks. A task that was never
+ * walked is assumed to be all cold, as before estimation existed.
+ */
+static int task_cold(struct mm_struct *mm, int tasksize)
+{
+	if (!mm->reclaim_hot && !mm->reclaim_cold)
+		return tasksize;
+
+	return min_t(unsigned long, mm->reclaim_cold, tasksize);
+}
+
 static void swap_fn(struct work_struct *work)
 {
 	struct task_struct *tsk;
 	struct reclaim_param rp;
 
 	/* Pick the best MAX_SWAP_TASKS tasks in terms of anon size */
-	struct selected_task selected[MAX_SWAP_TASKS] = {{0, 0, 0},};
+	struct selected_task selected[MAX_SWAP_TASKS] = {{0, 0, 0, 0},};
 	int si = 0;
 	int i;
 	int tasksize;
+	int cold;
 	int total_sz = 0;
+	int total_cold = 0;
 	int total_scan = 0;
 	int total_reclaimed = 0;
 	int nr_to_reclaim;
@@ -145,6 +163,7 @@ static void swap_fn(struct work_struct *work)
 		}
 
 		tasksize = get_mm_counter(p->mm, MM_ANONPAGES);
+		cold = task_cold(p->mm, tasksize);
 		task_unlock(p);
 
 		if (tasksize <= 0)
@@ -159,16 +178,20 @@ static void swap_fn(struct work_struct *work)
 			selected[0].p = p;
 			selected[0].oom_score_adj = oom_score_adj;
 			selected[0].tasksize = tasksize;
+			selected[0].cold = cold;
 		} else {
 			selected[si].p = p;
 			selected[si].oom_score_adj = oom_score_adj;
 			selected[si].tasksize = tasksize;
+			selected[si].cold = cold;
 			si++;
 		}
 	}
 
-	for (i = 0; i < si; i++)
+	for (i = 0; i < si; i++) {
 		total_sz += selected[i].tasksize;
+		total_cold += selected[i].cold;
+	}
 
 	/* Skip reclaim if total size is too less */
 	if (total_sz < SWAP_CLUSTER_MAX) {
@@ -182,11 +205,19 @@ static void swap_fn(struct work_struct *work)
 	rcu_read_unlock();
 
 	while (si--) {
-		nr_to_reclaim =
-			(selected[si].tasksize * per_swap_size) / total_sz;
-		/* scan atleast a page */
-		if (!nr_to_reclaim)
-			nr_to_reclaim = 1;
+		/*
+		 * Split the budget by cold pages so that tasks whose anon
+		 * memory is mostly working set aren't made to refault it.
+		 * A task with no cold pages is still walked, to refresh
+		 * its estimate.
+		 */
+		nr_to_reclaim = 0;
+		if (selected[si].cold) {
+			nr_to_reclaim = div_u64((u64)selected[si].cold *
+					per_swap_size, total_cold);
+			nr_to_reclaim = clamp(nr_to_reclaim, 1,
+					selected[si].cold);
+		}
 
 		rp = reclaim_task_anon(selected[si].p, nr_to_reclaim);
 
@@ -194,6 +225,9 @@ static void swap_fn(struct work_struct *work)
 				selected[si].oom_score_adj, rp.nr_scanned,
 				rp.nr_reclaimed, per_swap_size, total_sz,
 				nr_to_reclaim);
+		trace_process_reclaim_ws(selected[si].p->pid,
+				selected[si].cold, rp.nr_hot, rp.nr_cold,
+				rp.nr_reclaimed);
 		total_scan += rp.nr_scanned;
 		total_reclaimed += rp.nr_reclaimed;
 		put_task_struct(selected[si].p);
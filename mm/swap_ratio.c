@@ -14,12 +14,28 @@
 #include <linux/mm_types.h>
 #include <linux/swapfile.h>
 #include <linux/swap.h>
+#include <linux/blkdev.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/math64.h>
+#include <linux/init.h>
 
 #define SWAP_RATIO_GROUP_START (SWAP_FLAG_PRIO_MASK - 9) /* 32758 */
 #define SWAP_RATIO_GROUP_END (SWAP_FLAG_PRIO_MASK) /* 32767 */
 #define SWAP_FAST_WRITES (SWAPFILE_CLUSTER * (SWAP_CLUSTER_MAX / 8))
 #define SWAP_SLOW_WRITES SWAPFILE_CLUSTER
 
+/*
+ * The adaptive ratio stays within these bounds so that both devices
+ * keep receiving writes and their latency averages stay current.
+ */
+#define SWAP_RATIO_ADAPTIVE_MIN 10
+#define SWAP_RATIO_ADAPTIVE_MAX 90
+/* Writes a device must have seen before its latency is trusted */
+#define SWAP_RATIO_MIN_SAMPLES 64
+/* Weight of a new sample in the write latency average, as a shift */
+#define SWAP_LAT_EWMA_SHIFT 3
+
 /*
  * The fast/slow swap write ratio.
  * 100 indicates that all writes should
@@ -30,6 +46,15 @@ int sysctl_swap_ratio = 100;
 /* Enable the swap ratio feature */
 int sysctl_swap_ratio_enable;
 
+/*
+ * Derive the ratio from measured write latency and compression
+ * instead of using sysctl_swap_ratio.
+ */
+int sysctl_swap_ratio_adaptive;
+
+/* The ratio last used by calculate_write_pending() */
+static int swap_ratio_current = 100;
+
 static bool is_same_group(struct swap_info_struct *a,
 		struct swap_info_struct *b)
 {
@@ -45,6 +70,53 @@ static bool is_same_group(struct swap_info_struct *a,
 	return false;
 }
 
+/*
+ * Pick the fast device share from how much memory each device frees per
+ * unit of time. A page on a slow device frees a whole page per write
+ * latency. A page on a compressing fast device (zram) still costs
+ * 100/compr_ratio percent of a page, so only the difference counts.
+ * Falls back to sysctl_swap_ratio until both devices have enough samples.
+ */
+static int swap_ratio_adaptive(struct swap_info_struct *fast,
+			struct swap_info_struct *slow)
+{
+	const struct block_device_operations *fops = NULL;
+	unsigned long fast_lat = ACCESS_ONCE(fast->write_lat);
+	unsigned long slow_lat = ACCESS_ONCE(slow->write_lat);
+	unsigned int cr;
+	u64 fast_w, slow_w;
+	int ratio;
+
+	if (fast->bdev && fast->bdev->bd_disk)
+		fops = fast->bdev->bd_disk->fops;
+	if (fops && fops->swap_compr_ratio)
+		fast->compr_ratio = fops->swap_compr_ratio(fast->bdev);
+	cr = fast->compr_ratio;
+
+	if (fast->nr_writes < SWAP_RATIO_MIN_SAMPLES ||
+	    slow->nr_writes < SWAP_RATIO_MIN_SAMPLES)
+		return sysctl_swap_ratio;
+
+	slow_w = div64_u64(NSEC_PER_SEC, max(slow_lat, 1UL));
+	if (!cr)
+		fast_w = div64_u64(NSEC_PER_SEC, max(fast_lat, 1UL));
+	else if (cr > 100)
+		fast_w = div64_u64((u64)(cr - 100) * NSEC_PER_SEC,
+				(u64)cr * max(fast_lat, 1UL));
+	else
+		fast_w = 0;
+
+	if (!fast_w && !slow_w)
+		return sysctl_swap_ratio;
+
+	ratio = div64_u64(fast_w * 100, fast_w + slow_w);
+
+	/* Move a quarter of the way per cycle to damp oscillation */
+	ratio = (swap_ratio_current * 3 + ratio) / 4;
+
+	return clamp(ratio, SWAP_RATIO_ADAPTIVE_MIN, SWAP_RATIO_ADAPTIVE_MAX);
+}
+
 /* Caller must hold swap_avail_lock */
 static int calculate_write_pending(struct swap_info_struct *si,
 			struct swap_info_struct *n)
@@ -60,6 +132,10 @@ static int calculate_write_pending(struct swap_info_struct *si,
 	if ((n->flags & SWP_FAST) || !is_same_group(si, n))
 		return -ENODEV;
 
+	if (sysctl_swap_ratio_adaptive)
+		ratio = swap_ratio_adaptive(si, n);
+	swap_ratio_current = ratio;
+
 	si->max_writes = ratio ? SWAP_FAST_WRITES : 0;
 	n->max_writes  = ratio ? (SWAP_FAST_WRITES * 100) /
 			ratio - SWAP_FAST_WRITES : SWAP_SLOW_WRITES;
@@ -198,3 +274,91 @@ int swap_ratio(struct swap_info_struct **si)
 	else
 		return -ENODEV;
 }
+
+/* Only devices taking part in a swap ratio group have their writes timed */
+bool swap_ratio_sample(struct swap_info_struct *si)
+{
+	return sysctl_swap_ratio_enable && is_swap_ratio_group(si->prio);
+}
+
+/*
+ * Fold the latency of one completed swap write into the device average.
+ * May be called from interrupt context; updates are not serialised, an
+ * occasionally lost sample does not matter here.
+ */
+void swap_ratio_account_write(struct swap_info_struct *si, u64 lat_ns)
+{
+	unsigned long lat = min_t(u64, lat_ns, ULONG_MAX);
+	unsigned long avg = ACCESS_ONCE(si->write_lat);
+
+	if (!si->nr_writes)
+		avg = lat;
+	else
+		avg = avg - (avg >> SWAP_LAT_EWMA_SHIFT) +
+			(lat >> SWAP_LAT_EWMA_SHIFT);
+
+	ACCESS_ONCE(si->write_lat) = avg;
+	si->nr_writes++;
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t stats_show(struct kobject *kobj,
+			struct kobj_attribute *attr, char *buf)
+{
+	struct swap_info_struct *si;
+	char name[BDEVNAME_SIZE];
+	ssize_t len;
+
+	len = scnprintf(buf, PAGE_SIZE, "%-4s %-12s %6s %4s %12s %10s %6s %10s\n",
+			"type", "bdev", "prio", "fast", "writes",
+			"lat_us", "compr", "max_writes");
+
+	spin_lock(&swap_lock);
+	plist_for_each_entry(si, &swap_active_head, list) {
+		if (si->bdev)
+			bdevname(si->bdev, name);
+		else
+			strlcpy(name, "-", sizeof(name));
+
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+			"%-4d %-12s %6d %4d %12lu %10lu %6u %10u\n",
+			si->type, name, si->prio, !!(si->flags & SWP_FAST),
+			si->nr_writes, si->write_lat / NSEC_PER_USEC,
+			si->compr_ratio, si->max_writes);
+	}
+	spin_unlock(&swap_lock);
+
+	return len;
+}
+static struct kobj_attribute stats_attr = __ATTR_RO(stats);
+
+static ssize_t ratio_show(struct kobject *kobj,
+			struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", swap_ratio_current);
+}
+static struct kobj_attribute ratio_attr = __ATTR_RO(ratio);
+
+static struct attribute *swap_ratio_attrs[] = {
+	&stats_attr.attr,
+	&ratio_attr.attr,
+	NULL,
+};
+
+static struct attribute_group swap_ratio_attr_group = {
+	.attrs = swap_ratio_attrs,
+	.name = "swap_ratio",
+};
+
+static int __init swap_ratio_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &swap_ratio_attr_group);
+	if (err)
+		pr_err("swap_ratio: register sysfs failed\n");
+
+	return err;
+}
+module_init(swap_ratio_init);
+#endif /* CONFIG_SYSFS */
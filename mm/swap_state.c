@@ -373,7 +373,10 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			radix_tree_preload_end();
 			/*
 			 * Initiate read into locked page and return.
+			 * Anon pages carry no shadow entries, so treat
+			 * every swap-in as a workingset refault.
 			 */
+			SetPageWorkingset(new_page);
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
 			return new_page;
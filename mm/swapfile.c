@@ -838,6 +838,10 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 
 	/* free if no reference */
 	if (!usage) {
+#ifdef CONFIG_PROCESS_RECLAIM
+		if (p->reclaim_map)
+			clear_bit(offset, p->reclaim_map);
+#endif
 		dec_cluster_info_page(p, p->cluster_info, offset);
 		if (offset < p->lowest_bit)
 			p->lowest_bit = offset;
@@ -1020,6 +1024,34 @@ int try_to_free_swap(struct page *page)
 	return 1;
 }
 
+#ifdef CONFIG_PROCESS_RECLAIM
+/*
+ * Remember that process reclaim pushed the page at @entry out, so that a
+ * later swap-in of it can be accounted as a refault of the reclaim rather
+ * than as ordinary swap traffic. The mark goes away with the swap slot.
+ */
+void swap_mark_reclaimed(swp_entry_t entry)
+{
+	struct swap_info_struct *p = swap_info[swp_type(entry)];
+
+	if (p->reclaim_map)
+		set_bit(swp_offset(entry), p->reclaim_map);
+}
+
+/*
+ * The caller holds a reference on the slot (the swapcache page read from
+ * it), so swapoff can't free the map under us.
+ */
+bool swap_test_clear_reclaimed(swp_entry_t entry)
+{
+	struct swap_info_struct *p = swap_info[swp_type(entry)];
+
+	if (!p->reclaim_map)
+		return false;
+	return test_and_clear_bit(swp_offset(entry), p->reclaim_map);
+}
+#endif
+
 /*
  * Free the swap entry like above, but also try to
  * free the page cache entry if it is the last user.
@@ -1890,6 +1922,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	unsigned char *swap_map;
 	struct swap_cluster_info *cluster_info;
 	unsigned long *frontswap_map;
+	unsigned long *reclaim_map = NULL;
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -1994,6 +2027,10 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	cluster_info = p->cluster_info;
 	p->cluster_info = NULL;
 	frontswap_map = frontswap_map_get(p);
+#ifdef CONFIG_PROCESS_RECLAIM
+	reclaim_map = p->reclaim_map;
+	p->reclaim_map = NULL;
+#endif
 	spin_unlock(&p->lock);
 	spin_unlock(&swap_lock);
 	frontswap_invalidate_area(p->type);
@@ -2004,6 +2041,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	vfree(swap_map);
 	vfree(cluster_info);
 	vfree(frontswap_map);
+	vfree(reclaim_map);
 	/* Destroy swap account information */
 	swap_cgroup_swapoff(p->type);
 
@@ -2562,6 +2600,10 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	/* frontswap enabled? set up bit-per-page map for frontswap */
 	if (frontswap_enabled)
 		frontswap_map = vzalloc(BITS_TO_LONGS(maxpages) * sizeof(long));
+#ifdef CONFIG_PROCESS_RECLAIM
+	/* refault accounting only, run without it if it can't be had */
+	p->reclaim_map = vzalloc(BITS_TO_LONGS(maxpages) * sizeof(long));
+#endif
 
 	if (p->bdev &&(swap_flags & SWAP_FLAG_DISCARD) && swap_discardable(p)) {
 		/*
@@ -2638,6 +2680,10 @@ bad_swap:
 	spin_unlock(&swap_lock);
 	vfree(swap_map);
 	vfree(cluster_info);
+#ifdef CONFIG_PROCESS_RECLAIM
+	vfree(p->reclaim_map);
+	p->reclaim_map = NULL;
+#endif
 	if (swap_file) {
 		if (inode && S_ISREG(inode->i_mode)) {
 			mutex_unlock(&inode->i_mutex);
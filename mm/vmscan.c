@@ -988,6 +988,13 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 				goto keep_locked;
 			if (!add_to_swap(page, page_list))
 				goto activate_locked;
+#ifdef CONFIG_PROCESS_RECLAIM
+			if (sc->target_vma) {
+				swp_entry_t entry = { .val = page_private(page) };
+
+				swap_mark_reclaimed(entry);
+			}
+#endif
 			may_enter_fs = 1;
 
 			/* Adding to swap updated mapping */
@@ -27,17 +27,21 @@
 #include <linux/cleancache.h>
 #include <linux/cpu.h>
 #include <linux/crypto.h>
+#include <linux/fs.h>
 #include <linux/page-flags.h>
 #include <linux/pagemap.h>
 #include <linux/highmem.h>
 #include <linux/mm_types.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/radix-tree.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
 #include <linux/types.h>
-#include <linux/zbud.h>
+#include <linux/workqueue.h>
+#include <linux/zpool.h>
 
 /*
  * Enable/disable zcache (disabled by default)
@@ -46,11 +50,31 @@ static bool zcache_enabled __read_mostly;
 module_param_named(enabled, zcache_enabled, bool, 0);
 
 /*
- * Compressor to be used by zcache
+ * Compressor to be used by zcache. It can be changed at runtime, pages that
+ * are already stored keep using the compressor they were compressed with.
  */
-#define ZCACHE_COMPRESSOR_DEFAULT "lzo"
-static char *zcache_compressor = ZCACHE_COMPRESSOR_DEFAULT;
-module_param_named(compressor, zcache_compressor, charp, 0);
+#define ZCACHE_COMPRESSOR_DEFAULT "lz4"
+#define ZCACHE_COMPRESSOR_FALLBACK "lzo"
+static char zcache_compressor[CRYPTO_MAX_ALG_NAME] = ZCACHE_COMPRESSOR_DEFAULT;
+static int zcache_compressor_set(const char *val,
+				 const struct kernel_param *kp);
+static struct kernel_param_ops zcache_compressor_param_ops = {
+	.set = zcache_compressor_set,
+	.get = param_get_string,
+};
+static struct kparam_string zcache_compressor_kparam = {
+	.string = zcache_compressor,
+	.maxlen = sizeof(zcache_compressor),
+};
+module_param_cb(compressor, &zcache_compressor_param_ops,
+		&zcache_compressor_kparam, 0644);
+
+/*
+ * zpool backend for the compressed pages of each filesystem, zbud or zsmalloc
+ */
+#define ZCACHE_ZPOOL_DEFAULT "zbud"
+static char *zcache_zpool_type = ZCACHE_ZPOOL_DEFAULT;
+module_param_named(zpool, zcache_zpool_type, charp, 0444);
 
 /*
  * The maximum percentage of memory that the compressed pool can occupy.
@@ -58,6 +82,10 @@ module_param_named(compressor, zcache_compressor, charp, 0);
 static unsigned int zcache_max_pool_percent = 10;
 module_param_named(max_pool_percent, zcache_max_pool_percent, uint, 0644);
 
+/*
+ * Below this percentage of memory in file pages the whole pool is a target
+ * for the shrinker, it is still evicted oldest first.
+ */
 static unsigned int zcache_clear_percent = 4;
 module_param_named(clear_percent, zcache_clear_percent, uint, 0644);
 /*
@@ -65,7 +93,7 @@ module_param_named(clear_percent, zcache_clear_percent, uint, 0644);
  */
 static u64 zcache_pool_limit_hit;
 static u64 zcache_dup_entry;
-static u64 zcache_zbud_alloc_fail;
+static u64 zcache_zpool_alloc_fail;
 static u64 zcache_evict_zpages;
 static u64 zcache_evict_filepages;
 static u64 zcache_inactive_pages_refused;
@@ -92,23 +120,25 @@ static atomic_t zcache_stored_zero_pages = ATOMIC_INIT(0);
  * to evict pages from its own compressed pool on an LRU basis in the case that
  * the compressed pool is full.
  *
- * Zcache makes use of zbud for the managing the compressed memory pool. Each
- * allocation in zbud is not directly accessible by address.  Rather, a handle
- * (zaddr) is return by the allocation routine and that handle(zaddr must be
+ * Zcache makes use of zpool (zbud or zsmalloc) for the managing the compressed
+ * memory pool. Each allocation in zpool is not directly accessible by address.
+ * Rather, a handle is return by the allocation routine and that handle must be
  * mapped before being accessed. The compressed memory pool grows on demand and
  * shrinks as compressed pages are freed.
  *
  * When a file page is passed from cleancache to zcache, zcache maintains a
- * mapping of the <filesystem_type, inode_number, page_index> to the zbud
- * address that references that compressed file page. This mapping is achieved
- * with a red-black tree per filesystem type, plus a radix tree per red-black
- * node.
+ * mapping of the <filesystem_type, inode_number, page_index> to the
+ * zcache_entry that references that compressed file page. This mapping is
+ * achieved with a red-black tree per filesystem type, plus a radix tree per
+ * red-black node.
  *
  * A zcache pool with pool_id as the index is created when a filesystem mounted
  * Each zcache pool has a red-black tree, the inode number(rb_index) is the
  * search key. Each red-black tree node has a radix tree which use
- * page->index(ra_index) as the index. Each radix tree slot points to the zbud
- * address combining with some extra information(zcache_ra_handle).
+ * page->index(ra_index) as the index. Each radix tree slot points to a
+ * zcache_entry, which is also on a global LRU ordered by the time the page
+ * was stored, so the oldest file pages are evicted first whatever pool
+ * they are in.
  */
 #define MAX_ZCACHE_POOLS 32
 /*
@@ -117,8 +147,15 @@ static atomic_t zcache_stored_zero_pages = ATOMIC_INIT(0);
 struct zcache_pool {
 	struct rb_root rbtree;
 	rwlock_t rb_lock;		/* Protects rbtree */
-	u64 size;
-	struct zbud_pool *pool;         /* Zbud pool used */
+	u64 size;			/* Pool size in pages */
+	struct zpool *pool;		/* zpool used */
+	char name[64];			/* fstype:device, set on first use */
+	atomic_long_t nr_pages;		/* Compressed pages stored */
+	atomic_long_t stores;		/* Pages stored */
+	atomic_long_t hits;		/* Loads that found the page */
+	atomic_long_t misses;		/* Loads that did not */
+	atomic_long_t evicts;		/* Pages evicted from the LRU */
+	atomic_long_t invalidates;	/* Stored pages invalidated */
 };
 
 /*
@@ -143,16 +180,47 @@ struct zcache_rbnode {
 	struct kref refcount;
 };
 
+/*
+ * A compressor that pages can be compressed with. The current one is
+ * published through zcache_comp, every stored page holds a reference to
+ * the one it was compressed with.
+ */
+struct zcache_comp {
+	char name[CRYPTO_MAX_ALG_NAME];
+	struct crypto_comp * __percpu *tfms;
+	atomic_t refcount;
+	struct work_struct release_work;
+};
+
+static struct zcache_comp __rcu *zcache_comp;
+/* Serialises compressor switches */
+static DEFINE_MUTEX(zcache_comp_lock);
+static bool zcache_initialized;
+
 /*
  * Radix-tree leaf, indexed by page->index
  */
-struct zcache_ra_handle {
+struct zcache_entry {
+	struct list_head lru;		/* Entry in zcache_lru */
+	unsigned long handle;		/* zpool handle of the compressed data */
+	unsigned long stored;		/* jiffies when the page was stored */
 	int rb_index;			/* Redblack tree index */
 	int ra_index;			/* Radix tree index */
-	int zlen;			/* Compressed page size */
+	unsigned int zlen;		/* Compressed page size */
 	struct zcache_pool *zpool;	/* Finding zcache_pool during evict */
+	struct zcache_comp *comp;	/* Compressor used for this page */
 };
 
+/*
+ * All stored compressed pages, newest first. Lock order is
+ * zpool->rb_lock -> rbnode->ra_lock -> zcache_lru_lock.
+ */
+static LIST_HEAD(zcache_lru);
+static DEFINE_SPINLOCK(zcache_lru_lock);
+
+/* Pages evicted at a time from the store path and the shrinker */
+#define ZCACHE_EVICT_BATCH 8
+
 u64 zcache_pages(void)
 {
 	int i;
@@ -164,6 +232,11 @@ u64 zcache_pages(void)
 	return count;
 }
 
+static void zcache_pool_update_size(struct zcache_pool *zpool)
+{
+	zpool->size = zpool_get_total_size(zpool->pool) >> PAGE_SHIFT;
+}
+
 static struct kmem_cache *zcache_rbnode_cache;
 static int zcache_rbnode_cache_create(void)
 {
@@ -175,6 +248,126 @@ static void zcache_rbnode_cache_destroy(void)
 	kmem_cache_destroy(zcache_rbnode_cache);
 }
 
+static struct kmem_cache *zcache_entry_cache;
+static int zcache_entry_cache_create(void)
+{
+	zcache_entry_cache = KMEM_CACHE(zcache_entry, 0);
+	return zcache_entry_cache == NULL;
+}
+static void zcache_entry_cache_destroy(void)
+{
+	kmem_cache_destroy(zcache_entry_cache);
+}
+
+static void zcache_comp_put(struct zcache_comp *comp);
+
+/*
+ * Free the compressed data of an entry that has been removed from its radix
+ * tree and the LRU. The zcache_pool must still be alive.
+ */
+static void zcache_entry_release(struct zcache_entry *entry)
+{
+	struct zcache_pool *zpool = entry->zpool;
+
+	zpool_free(zpool->pool, entry->handle);
+	zcache_comp_put(entry->comp);
+	kmem_cache_free(zcache_entry_cache, entry);
+
+	atomic_dec(&zcache_stored_pages);
+	atomic_long_dec(&zpool->nr_pages);
+	zcache_pool_update_size(zpool);
+}
+
+/*
+ * Free an entry the caller has removed from its radix tree
+ */
+static void zcache_entry_free(struct zcache_entry *entry)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zcache_lru_lock, flags);
+	list_del(&entry->lru);
+	spin_unlock_irqrestore(&zcache_lru_lock, flags);
+
+	zcache_entry_release(entry);
+}
+
+/*
+ * The caller must hold zpool->rb_lock at least
+ */
+static struct zcache_rbnode *zcache_find_rbnode(struct rb_root *rbtree,
+	int index, struct rb_node **rb_parent, struct rb_node ***rb_link);
+static void zcache_rbnode_isolate(struct zcache_pool *zpool,
+		struct zcache_rbnode *rbnode, bool holded_rblock);
+static void zcache_rbnode_release(struct kref *kref);
+static int zcache_rbnode_empty(struct zcache_rbnode *rbnode);
+
+/*
+ * Evict up to @nr of the oldest compressed pages.
+ *
+ * The LRU lock is taken last everywhere else, so the tree locks of an entry
+ * are only trylocked here. Entries whose locks are busy, or that are being
+ * removed by somebody else, are rotated to the head of the LRU. The entry
+ * is freed with its pool's rb_lock held so that the pool can't go away
+ * underneath us.
+ */
+static unsigned long zcache_evict_entries(unsigned long nr)
+{
+	struct zcache_entry *entry;
+	struct zcache_rbnode *rbnode;
+	struct zcache_pool *zpool;
+	unsigned long evicted = 0;
+	unsigned long tries = nr * 2;
+	unsigned long flags;
+
+	spin_lock_irqsave(&zcache_lru_lock, flags);
+	while (evicted < nr && tries-- && !list_empty(&zcache_lru)) {
+		entry = list_last_entry(&zcache_lru, struct zcache_entry, lru);
+		zpool = entry->zpool;
+
+		if (!write_trylock(&zpool->rb_lock)) {
+			list_move(&entry->lru, &zcache_lru);
+			continue;
+		}
+
+		rbnode = zcache_find_rbnode(&zpool->rbtree, entry->rb_index,
+				NULL, NULL);
+		if (!rbnode || !spin_trylock(&rbnode->ra_lock)) {
+			list_move(&entry->lru, &zcache_lru);
+			write_unlock(&zpool->rb_lock);
+			continue;
+		}
+
+		if (radix_tree_lookup(&rbnode->ratree, entry->ra_index) !=
+				entry) {
+			/* Being removed, the remover frees it */
+			list_move(&entry->lru, &zcache_lru);
+			spin_unlock(&rbnode->ra_lock);
+			write_unlock(&zpool->rb_lock);
+			continue;
+		}
+
+		radix_tree_delete(&rbnode->ratree, entry->ra_index);
+		list_del(&entry->lru);
+
+		kref_get(&rbnode->refcount);
+		if (zcache_rbnode_empty(rbnode))
+			zcache_rbnode_isolate(zpool, rbnode, 1);
+		spin_unlock(&rbnode->ra_lock);
+		kref_put(&rbnode->refcount, zcache_rbnode_release);
+
+		atomic_long_inc(&zpool->evicts);
+		zcache_entry_release(entry);
+		write_unlock(&zpool->rb_lock);
+
+		zcache_evict_zpages++;
+		evicted++;
+	}
+	spin_unlock_irqrestore(&zcache_lru_lock, flags);
+
+	return evicted;
+}
+
 static unsigned long zcache_count(struct shrinker *s,
 				  struct shrink_control *sc)
 {
@@ -194,10 +387,8 @@ static unsigned long zcache_scan(struct shrinker *s, struct shrink_control *sc)
 	unsigned long file;
 	long file_gap;
 	unsigned long freed = 0;
-	unsigned long pool;
+	unsigned long pool, target, evicted = 0;
 	static bool running;
-	int i = 0;
-	int retries;
 
 	if (running)
 		goto end;
@@ -228,25 +419,28 @@ static unsigned long zcache_scan(struct shrinker *s, struct shrink_control *sc)
 		zcache_pool_shrink++;
 
 reclaim:
-	retries = file_gap;
-	while ((file_gap > 0) && retries) {
-		struct zcache_pool *zpool =
-			zcache.pools[i++ % MAX_ZCACHE_POOLS];
-		if (!zpool || !zpool->size)
-			continue;
-		if (zbud_reclaim_page(zpool->pool, 8)) {
+	/*
+	 * Evict the oldest pages until the pool has shrunk by the gap or by
+	 * what we were asked to scan. Freeing an object doesn't always free a
+	 * pool page, so the number of evictions is bounded too.
+	 */
+	file_gap = min_t(unsigned long, file_gap, sc->nr_to_scan);
+	target = pool - file_gap;
+	while (file_gap > 0 && zcache_pages() > target &&
+	       evicted < sc->nr_to_scan * 4) {
+		unsigned long nr = zcache_evict_entries(ZCACHE_EVICT_BATCH);
+
+		if (!nr) {
 			zcache_pool_shrink_fail++;
-			retries--;
-			continue;
+			break;
 		}
-		freed++;
-		file_gap--;
+		evicted += nr;
+		cond_resched();
 	}
 
+	pool -= min_t(unsigned long, pool, zcache_pages());
+	freed = pool;
 	zcache_pool_shrink_pages += freed;
-	for (i = 0; (i < MAX_ZCACHE_POOLS) && zcache.pools[i]; i++)
-		zcache.pools[i]->size =
-			zbud_get_pool_size(zcache.pools[i]->pool);
 
 	running = false;
 end:
@@ -263,20 +457,19 @@ static struct shrinker zcache_shrinker = {
  * Compression functions
  * (Below functions are copyed from zswap!)
  */
-static struct crypto_comp * __percpu *zcache_comp_pcpu_tfms;
-
 enum comp_op {
 	ZCACHE_COMPOP_COMPRESS,
 	ZCACHE_COMPOP_DECOMPRESS
 };
 
-static int zcache_comp_op(enum comp_op op, const u8 *src, unsigned int slen,
-				u8 *dst, unsigned int *dlen)
+static int zcache_comp_op(struct zcache_comp *comp, enum comp_op op,
+			const u8 *src, unsigned int slen,
+			u8 *dst, unsigned int *dlen)
 {
 	struct crypto_comp *tfm;
 	int ret;
 
-	tfm = *per_cpu_ptr(zcache_comp_pcpu_tfms, get_cpu());
+	tfm = *per_cpu_ptr(comp->tfms, get_cpu());
 	switch (op) {
 	case ZCACHE_COMPOP_COMPRESS:
 		ret = crypto_comp_compress(tfm, src, slen, dst, dlen);
@@ -292,30 +485,163 @@ static int zcache_comp_op(enum comp_op op, const u8 *src, unsigned int slen,
 	return ret;
 }
 
+static void zcache_comp_destroy(struct zcache_comp *comp)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm = *per_cpu_ptr(comp->tfms, cpu);
+
+		if (tfm)
+			crypto_free_comp(tfm);
+	}
+	free_percpu(comp->tfms);
+	kfree(comp);
+}
+
+static void zcache_comp_release(struct work_struct *work)
+{
+	struct zcache_comp *comp = container_of(work, struct zcache_comp,
+						release_work);
+
+	/* Wait for lookups that found it just before it was replaced */
+	synchronize_rcu();
+	pr_info("released %s compressor\n", comp->name);
+	zcache_comp_destroy(comp);
+}
+
+/*
+ * Transforms are allocated for every possible cpu up front so that a
+ * compressor can be switched to without touching cpu hotplug.
+ */
+static struct zcache_comp *zcache_comp_create(const char *name)
+{
+	struct zcache_comp *comp;
+	int cpu;
+
+	if (!crypto_has_comp(name, 0, 0))
+		return ERR_PTR(-ENOENT);
+
+	comp = kzalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return ERR_PTR(-ENOMEM);
+
+	strlcpy(comp->name, name, sizeof(comp->name));
+	atomic_set(&comp->refcount, 1);
+	INIT_WORK(&comp->release_work, zcache_comp_release);
+
+	comp->tfms = alloc_percpu(struct crypto_comp *);
+	if (!comp->tfms) {
+		kfree(comp);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm = crypto_alloc_comp(name, 0, 0);
+
+		if (IS_ERR(tfm)) {
+			pr_err("can't allocate compressor transform\n");
+			zcache_comp_destroy(comp);
+			return ERR_CAST(tfm);
+		}
+		*per_cpu_ptr(comp->tfms, cpu) = tfm;
+	}
+
+	return comp;
+}
+
+static struct zcache_comp *zcache_comp_get(void)
+{
+	struct zcache_comp *comp;
+
+	rcu_read_lock();
+	do {
+		comp = rcu_dereference(zcache_comp);
+	} while (comp && !atomic_inc_not_zero(&comp->refcount));
+	rcu_read_unlock();
+
+	return comp;
+}
+
+static void zcache_comp_put(struct zcache_comp *comp)
+{
+	if (atomic_dec_and_test(&comp->refcount))
+		schedule_work(&comp->release_work);
+}
+
+/* Make @name the compressor for newly stored pages */
+static int zcache_comp_switch(const char *name)
+{
+	struct zcache_comp *comp, *old;
+
+	comp = zcache_comp_create(name);
+	if (IS_ERR(comp))
+		return PTR_ERR(comp);
+
+	mutex_lock(&zcache_comp_lock);
+	old = rcu_dereference_protected(zcache_comp,
+			lockdep_is_held(&zcache_comp_lock));
+	rcu_assign_pointer(zcache_comp, comp);
+	strlcpy(zcache_compressor, comp->name, sizeof(zcache_compressor));
+	mutex_unlock(&zcache_comp_lock);
+
+	pr_info("using %s compressor\n", comp->name);
+
+	/* Drop the reference held as the current compressor */
+	if (old)
+		zcache_comp_put(old);
+
+	return 0;
+}
+
+static int zcache_compressor_set(const char *val,
+				 const struct kernel_param *kp)
+{
+	char name[CRYPTO_MAX_ALG_NAME];
+	int ret;
+
+	/* Before init just record the choice, zcache_comp_init() uses it */
+	if (!zcache_initialized)
+		return param_set_copystring(val, kp);
+
+	strlcpy(name, strstrip((char *)val), sizeof(name));
+	if (!strcmp(name, zcache_compressor))
+		return 0;
+
+	ret = zcache_comp_switch(name);
+	if (ret)
+		pr_err("%s compressor not available\n", name);
+
+	return ret;
+}
+
 static int __init zcache_comp_init(void)
 {
 	if (!crypto_has_comp(zcache_compressor, 0, 0)) {
 		pr_info("%s compressor not available\n", zcache_compressor);
 		/* fall back to default compressor */
-		zcache_compressor = ZCACHE_COMPRESSOR_DEFAULT;
+		strlcpy(zcache_compressor, ZCACHE_COMPRESSOR_DEFAULT,
+			sizeof(zcache_compressor));
 		if (!crypto_has_comp(zcache_compressor, 0, 0))
-			/* can't even load the default compressor */
-			return -ENODEV;
+			strlcpy(zcache_compressor, ZCACHE_COMPRESSOR_FALLBACK,
+				sizeof(zcache_compressor));
 	}
-	pr_info("using %s compressor\n", zcache_compressor);
 
-	/* alloc percpu transforms */
-	zcache_comp_pcpu_tfms = alloc_percpu(struct crypto_comp *);
-	if (!zcache_comp_pcpu_tfms)
-		return -ENOMEM;
-	return 0;
+	return zcache_comp_switch(zcache_compressor);
 }
 
 static void zcache_comp_exit(void)
 {
-	/* free percpu transforms */
-	if (zcache_comp_pcpu_tfms)
-		free_percpu(zcache_comp_pcpu_tfms);
+	struct zcache_comp *comp;
+
+	mutex_lock(&zcache_comp_lock);
+	comp = rcu_dereference_protected(zcache_comp,
+			lockdep_is_held(&zcache_comp_lock));
+	RCU_INIT_POINTER(zcache_comp, NULL);
+	mutex_unlock(&zcache_comp_lock);
+
+	if (comp)
+		zcache_comp_put(comp);
 }
 
 /*
@@ -326,33 +652,19 @@ static DEFINE_PER_CPU(u8 *, zcache_dstmem);
 
 static int __zcache_cpu_notifier(unsigned long action, unsigned long cpu)
 {
-	struct crypto_comp *tfm;
 	u8 *dst;
 
 	switch (action) {
 	case CPU_UP_PREPARE:
-		tfm = crypto_alloc_comp(zcache_compressor, 0, 0);
-		if (IS_ERR(tfm)) {
-			pr_err("can't allocate compressor transform\n");
-			return NOTIFY_BAD;
-		}
-		*per_cpu_ptr(zcache_comp_pcpu_tfms, cpu) = tfm;
 		dst = kmalloc(PAGE_SIZE * 2, GFP_KERNEL);
 		if (!dst) {
 			pr_err("can't allocate compressor buffer\n");
-			crypto_free_comp(tfm);
-			*per_cpu_ptr(zcache_comp_pcpu_tfms, cpu) = NULL;
 			return NOTIFY_BAD;
 		}
 		per_cpu(zcache_dstmem, cpu) = dst;
 		break;
 	case CPU_DEAD:
 	case CPU_UP_CANCELED:
-		tfm = *per_cpu_ptr(zcache_comp_pcpu_tfms, cpu);
-		if (tfm) {
-			crypto_free_comp(tfm);
-			*per_cpu_ptr(zcache_comp_pcpu_tfms, cpu) = NULL;
-		}
 		dst = per_cpu(zcache_dstmem, cpu);
 		kfree(dst);
 		per_cpu(zcache_dstmem, cpu) = NULL;
@@ -508,10 +820,12 @@ static void zcache_rbnode_isolate(struct zcache_pool *zpool,
 }
 
 /*
- * Store zaddr which allocated by zbud_alloc() to the hierarchy rbtree-ratree.
+ * Store zaddr, either a zcache_entry or ZERO_HANDLE, to the hierarchy
+ * rbtree-ratree. Entries are put on the LRU under the ra_lock so that
+ * whoever removes them from the radix tree finds them there.
  */
 static int zcache_store_zaddr(struct zcache_pool *zpool,
-		int ra_index, int rb_index, unsigned long zaddr)
+		int ra_index, int rb_index, void *zaddr)
 {
 	unsigned long flags;
 	struct zcache_rbnode *rbnode, *tmp;
@@ -556,19 +870,22 @@ static int zcache_store_zaddr(struct zcache_pool *zpool,
 	dup_zaddr = radix_tree_delete(&rbnode->ratree, ra_index);
 	if (unlikely(dup_zaddr)) {
 		WARN_ON("duplicated, will be replaced!\n");
-		if (dup_zaddr == ZERO_HANDLE) {
+		if (dup_zaddr == ZERO_HANDLE)
 			atomic_dec(&zcache_stored_zero_pages);
-		} else {
-			zbud_free(zpool->pool, (unsigned long)dup_zaddr);
-			atomic_dec(&zcache_stored_pages);
-			zpool->size = zbud_get_pool_size(zpool->pool);
-		}
+		else
+			zcache_entry_free(dup_zaddr);
 		zcache_dup_entry++;
 	}
 
-	/* Insert zcache_ra_handle to ratree */
-	ret = radix_tree_insert(&rbnode->ratree, ra_index,
-				(void *)zaddr);
+	/* Insert zcache_entry to ratree */
+	ret = radix_tree_insert(&rbnode->ratree, ra_index, zaddr);
+	if (!ret && zaddr != ZERO_HANDLE) {
+		struct zcache_entry *entry = zaddr;
+
+		spin_lock(&zcache_lru_lock);
+		list_add(&entry->lru, &zcache_lru);
+		spin_unlock(&zcache_lru_lock);
+	}
 	spin_unlock_irqrestore(&rbnode->ra_lock, flags);
 	if (unlikely(ret)) {
 		write_lock_irqsave(&zpool->rb_lock, flags);
@@ -636,15 +953,32 @@ out:
 	return ret;
 }
 
+/*
+ * Name the pool after the superblock of the first page seen, cleancache
+ * doesn't tell the backend which filesystem a pool belongs to.
+ */
+static void zcache_pool_set_name(struct zcache_pool *zpool, struct page *page)
+{
+	struct super_block *sb;
+
+	if (likely(zpool->name[0]) || !page->mapping)
+		return;
+
+	sb = page->mapping->host->i_sb;
+	snprintf(zpool->name, sizeof(zpool->name), "%s:%s",
+		 sb->s_type->name, sb->s_id);
+}
+
 static void zcache_store_page(int pool_id, struct cleancache_filekey key,
 		pgoff_t index, struct page *page)
 {
-	struct zcache_ra_handle *zhandle;
+	struct zcache_entry *entry = NULL;
+	struct zcache_comp *comp;
 	u8 *zpage, *src, *dst;
-	/* Address of zhandle + compressed data(zpage) */
-	unsigned long zaddr = 0;
+	unsigned long handle;
 	unsigned int zlen = PAGE_SIZE;
 	bool zero = 0;
+	void *zaddr;
 	int ret;
 
 	struct zcache_pool *zpool = zcache.pools[pool_id];
@@ -660,78 +994,96 @@ static void zcache_store_page(int pool_id, struct cleancache_filekey key,
 		return;
 	}
 
+	zcache_pool_set_name(zpool, page);
+
 	zero = zero_page(page);
 	if (zero)
 		goto zero;
 
 	if (zcache_is_full()) {
 		zcache_pool_limit_hit++;
-		if (zbud_reclaim_page(zpool->pool, 8)) {
+		if (!zcache_evict_entries(ZCACHE_EVICT_BATCH)) {
 			zcache_reclaim_fail++;
 			return;
 		}
 		/*
-		 * Continue if reclaimed a page frame succ.
+		 * Continue if the oldest pages were evicted
 		 */
 		zcache_evict_filepages++;
-		zpool->size = zbud_get_pool_size(zpool->pool);
+	}
+
+	comp = zcache_comp_get();
+	if (!comp)
+		return;
+
+	entry = kmem_cache_alloc(zcache_entry_cache, GFP_ZCACHE);
+	if (!entry) {
+		zcache_store_failed++;
+		zcache_comp_put(comp);
+		return;
 	}
 
 	/* compress */
 	dst = get_cpu_var(zcache_dstmem);
 	src = kmap_atomic(page);
-	ret = zcache_comp_op(ZCACHE_COMPOP_COMPRESS, src, PAGE_SIZE, dst,
-			&zlen);
+	ret = zcache_comp_op(comp, ZCACHE_COMPOP_COMPRESS, src, PAGE_SIZE,
+			dst, &zlen);
 	kunmap_atomic(src);
 	if (ret) {
 		pr_err("zcache compress error ret %d\n", ret);
 		put_cpu_var(zcache_dstmem);
-		return;
+		goto free_entry;
 	}
 
-	/* store zcache handle together with compressed page data */
-	ret = zbud_alloc(zpool->pool, zlen + sizeof(struct zcache_ra_handle),
-			GFP_ZCACHE, &zaddr);
+	ret = zpool_malloc(zpool->pool, zlen, GFP_ZCACHE, &handle);
 	if (ret) {
-		zcache_zbud_alloc_fail++;
+		zcache_zpool_alloc_fail++;
 		put_cpu_var(zcache_dstmem);
-		return;
+		goto free_entry;
 	}
 
-	zhandle = (struct zcache_ra_handle *)zbud_map(zpool->pool, zaddr);
-
-	/* Compressed page data stored at the end of zcache_ra_handle */
-	zpage = (u8 *)(zhandle + 1);
+	zpage = zpool_map_handle(zpool->pool, handle, ZPOOL_MM_WO);
 	memcpy(zpage, dst, zlen);
-	zbud_unmap(zpool->pool, zaddr);
+	zpool_unmap_handle(zpool->pool, handle);
 	put_cpu_var(zcache_dstmem);
 
+	entry->handle = handle;
+	entry->stored = jiffies;
+	entry->rb_index = key.u.ino;
+	entry->ra_index = index;
+	entry->zlen = zlen;
+	entry->zpool = zpool;
+	entry->comp = comp;
+
 zero:
-	if (zero)
-		zaddr = (unsigned long)ZERO_HANDLE;
+	zaddr = zero ? ZERO_HANDLE : entry;
 
 	/* store zcache handle */
 	ret = zcache_store_zaddr(zpool, index, key.u.ino, zaddr);
 	if (ret) {
 		zcache_store_failed++;
-		if (!zero)
-			zbud_free(zpool->pool, zaddr);
+		if (!zero) {
+			zpool_free(zpool->pool, handle);
+			goto free_entry;
+		}
 		return;
 	}
 
 	/* update stats */
+	atomic_long_inc(&zpool->stores);
 	if (zero) {
 		atomic_inc(&zcache_stored_zero_pages);
 	} else {
-		zhandle->ra_index = index;
-		zhandle->rb_index = key.u.ino;
-		zhandle->zlen = zlen;
-		zhandle->zpool = zpool;
 		atomic_inc(&zcache_stored_pages);
-		zpool->size = zbud_get_pool_size(zpool->pool);
+		atomic_long_inc(&zpool->nr_pages);
+		zcache_pool_update_size(zpool);
 	}
 
 	return;
+
+free_entry:
+	zcache_comp_put(comp);
+	kmem_cache_free(zcache_entry_cache, entry);
 }
 
 static int zcache_load_page(int pool_id, struct cleancache_filekey key,
@@ -741,43 +1093,39 @@ static int zcache_load_page(int pool_id, struct cleancache_filekey key,
 	u8 *src, *dst;
 	void *zaddr;
 	unsigned int dlen = PAGE_SIZE;
-	struct zcache_ra_handle *zhandle;
+	struct zcache_entry *entry;
 	struct zcache_pool *zpool = zcache.pools[pool_id];
 
+	zcache_pool_set_name(zpool, page);
+
 	zaddr = zcache_load_delete_zaddr(zpool, key.u.ino, index);
-	if (!zaddr)
+	if (!zaddr) {
+		atomic_long_inc(&zpool->misses);
 		return -ENOENT;
-	else if (zaddr == ZERO_HANDLE)
-		goto map;
-
-	zhandle = (struct zcache_ra_handle *)zbud_map(zpool->pool,
-			(unsigned long)zaddr);
-	/* Compressed page data stored at the end of zcache_ra_handle */
-	src = (u8 *)(zhandle + 1);
+	}
 
-	/* decompress */
-map:
-	dst = kmap_atomic(page);
-	if (zaddr != ZERO_HANDLE) {
-		ret = zcache_comp_op(ZCACHE_COMPOP_DECOMPRESS, src,
-				zhandle->zlen, dst, &dlen);
-	} else {
+	atomic_long_inc(&zpool->hits);
+	if (zaddr == ZERO_HANDLE) {
+		dst = kmap_atomic(page);
 		memset(dst, 0, PAGE_SIZE);
 		kunmap_atomic(dst);
 		flush_dcache_page(page);
 		atomic_dec(&zcache_stored_zero_pages);
 		goto out;
 	}
+
+	/* decompress */
+	entry = zaddr;
+	src = zpool_map_handle(zpool->pool, entry->handle, ZPOOL_MM_RO);
+	dst = kmap_atomic(page);
+	ret = zcache_comp_op(entry->comp, ZCACHE_COMPOP_DECOMPRESS, src,
+			entry->zlen, dst, &dlen);
 	kunmap_atomic(dst);
-	zbud_unmap(zpool->pool, (unsigned long)zaddr);
-	zbud_free(zpool->pool, (unsigned long)zaddr);
+	zpool_unmap_handle(zpool->pool, entry->handle);
+	zcache_entry_free(entry);
 
 	BUG_ON(ret);
 	BUG_ON(dlen != PAGE_SIZE);
-
-	/* update stats */
-	atomic_dec(&zcache_stored_pages);
-	zpool->size = zbud_get_pool_size(zpool->pool);
 out:
 	SetPageWasActive(page);
 	return ret;
@@ -791,11 +1139,11 @@ static void zcache_flush_page(int pool_id, struct cleancache_filekey key,
 
 	zaddr = zcache_load_delete_zaddr(zpool, key.u.ino, index);
 	if (zaddr && (zaddr != ZERO_HANDLE)) {
-		zbud_free(zpool->pool, (unsigned long)zaddr);
-		atomic_dec(&zcache_stored_pages);
-		zpool->size = zbud_get_pool_size(zpool->pool);
+		zcache_entry_free(zaddr);
+		atomic_long_inc(&zpool->invalidates);
 	} else if (zaddr == ZERO_HANDLE) {
 		atomic_dec(&zcache_stored_zero_pages);
+		atomic_long_inc(&zpool->invalidates);
 	}
 }
 
@@ -808,7 +1156,6 @@ static void zcache_flush_ratree(struct zcache_pool *zpool,
 {
 	unsigned long index = 0;
 	int count, i;
-	struct zcache_ra_handle *zhandle;
 	void *zaddr = NULL;
 
 	do {
@@ -820,23 +1167,14 @@ static void zcache_flush_ratree(struct zcache_pool *zpool,
 				index, FREE_BATCH);
 
 		for (i = 0; i < count; i++) {
-			if (zaddrs[i] == ZERO_HANDLE) {
-				zaddr = radix_tree_delete(&rbnode->ratree,
-					indices[i]);
-				if (zaddr)
-					atomic_dec(&zcache_stored_zero_pages);
-				continue;
-			}
-			zhandle = (struct zcache_ra_handle *)zbud_map(
-					zpool->pool, (unsigned long)zaddrs[i]);
-			index = zhandle->ra_index;
+			index = indices[i];
 			zaddr = radix_tree_delete(&rbnode->ratree, index);
 			if (!zaddr)
 				continue;
-			zbud_unmap(zpool->pool, (unsigned long)zaddrs[i]);
-			zbud_free(zpool->pool, (unsigned long)zaddrs[i]);
-			atomic_dec(&zcache_stored_pages);
-			zpool->size = zbud_get_pool_size(zpool->pool);
+			if (zaddr == ZERO_HANDLE)
+				atomic_dec(&zcache_stored_zero_pages);
+			else
+				zcache_entry_free(zaddr);
 		}
 
 		index++;
@@ -912,47 +1250,11 @@ static void zcache_flush_fs(int pool_id)
 	zcache_destroy_pool(zpool);
 }
 
-/*
- * Evict compressed pages from zcache pool on an LRU basis after the compressed
- * pool is full.
- */
-static int zcache_evict_zpage(struct zbud_pool *pool, unsigned long zaddr)
-{
-	struct zcache_pool *zpool;
-	struct zcache_ra_handle *zhandle;
-	void *zaddr_intree;
-
-	BUG_ON(zaddr == (unsigned long)ZERO_HANDLE);
-
-	zhandle = (struct zcache_ra_handle *)zbud_map(pool, zaddr);
-
-	zpool = zhandle->zpool;
-	/* There can be a race with zcache store */
-	if (!zpool)
-		return -EINVAL;
-
-	BUG_ON(pool != zpool->pool);
-
-	zaddr_intree = zcache_load_delete_zaddr(zpool, zhandle->rb_index,
-			zhandle->ra_index);
-	if (zaddr_intree) {
-		BUG_ON((unsigned long)zaddr_intree != zaddr);
-		zbud_unmap(pool, zaddr);
-		zbud_free(pool, zaddr);
-		atomic_dec(&zcache_stored_pages);
-		zpool->size = zbud_get_pool_size(pool);
-		zcache_evict_zpages++;
-	}
-	return 0;
-}
-
-static struct zbud_ops zcache_zbud_ops = {
-	.evict = zcache_evict_zpage
-};
-
 /* Return pool id */
 static int zcache_create_pool(void)
 {
+	static atomic_t zcache_pool_seq = ATOMIC_INIT(0);
+	char name[16];
 	int ret;
 	struct zcache_pool *zpool;
 
@@ -962,7 +1264,23 @@ static int zcache_create_pool(void)
 		goto out;
 	}
 
-	zpool->pool = zbud_create_pool(GFP_KERNEL, &zcache_zbud_ops);
+	/* zsmalloc names its stats after the pool, keep the names unique */
+	snprintf(name, sizeof(name), "zcache%d",
+		 atomic_inc_return(&zcache_pool_seq));
+
+	/*
+	 * Pages are stored from page cache deletion with the mapping's tree
+	 * lock held, so the pool must not allocate with __GFP_WAIT. zcache
+	 * evicts from its own LRU, the zpool is never asked to shrink.
+	 */
+	zpool->pool = zpool_create_pool(zcache_zpool_type, name, GFP_ZCACHE,
+					NULL);
+	if (!zpool->pool && strcmp(zcache_zpool_type, ZCACHE_ZPOOL_DEFAULT)) {
+		pr_info("%s zpool not available\n", zcache_zpool_type);
+		zcache_zpool_type = ZCACHE_ZPOOL_DEFAULT;
+		zpool->pool = zpool_create_pool(zcache_zpool_type, name,
+						GFP_ZCACHE, NULL);
+	}
 	if (!zpool->pool) {
 		kfree(zpool);
 		ret = -ENOMEM;
@@ -972,7 +1290,7 @@ static int zcache_create_pool(void)
 	spin_lock(&zcache.pool_lock);
 	if (zcache.num_pools == MAX_ZCACHE_POOLS) {
 		pr_err("Cannot create new pool (limit:%u)\n", MAX_ZCACHE_POOLS);
-		zbud_destroy_pool(zpool->pool);
+		zpool_destroy_pool(zpool->pool);
 		kfree(zpool);
 		ret = -EPERM;
 		goto out_unlock;
@@ -986,7 +1304,8 @@ static int zcache_create_pool(void)
 			break;
 	zcache.pools[ret] = zpool;
 	zcache.num_pools++;
-	pr_info("New pool created id:%d\n", ret);
+	pr_info("New %s pool created id:%d\n", zpool_get_type(zpool->pool),
+		ret);
 
 out_unlock:
 	spin_unlock(&zcache.pool_lock);
@@ -1012,7 +1331,7 @@ static void zcache_destroy_pool(struct zcache_pool *zpool)
 	if (!RB_EMPTY_ROOT(&zpool->rbtree))
 		WARN_ON("Memory leak detected. Freeing non-empty pool!\n");
 
-	zbud_destroy_pool(zpool->pool);
+	zpool_destroy_pool(zpool->pool);
 	kfree(zpool);
 }
 
@@ -1057,6 +1376,7 @@ static struct cleancache_ops zcache_ops = {
  */
 #ifdef CONFIG_DEBUG_FS
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 static int pool_pages_get(void *_data, u64 *val)
 {
@@ -1066,6 +1386,68 @@ static int pool_pages_get(void *_data, u64 *val)
 
 DEFINE_SIMPLE_ATTRIBUTE(pool_page_fops, pool_pages_get, NULL, "%llu\n");
 
+/* Age in milliseconds of the oldest compressed page */
+static int lru_age_get(void *_data, u64 *val)
+{
+	struct zcache_entry *entry;
+	unsigned long flags;
+
+	*val = 0;
+	spin_lock_irqsave(&zcache_lru_lock, flags);
+	if (!list_empty(&zcache_lru)) {
+		entry = list_last_entry(&zcache_lru, struct zcache_entry, lru);
+		*val = jiffies_to_msecs(jiffies - entry->stored);
+	}
+	spin_unlock_irqrestore(&zcache_lru_lock, flags);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(lru_age_fops, lru_age_get, NULL, "%llu\n");
+
+/* Per superblock statistics, one line per pool */
+static int zcache_pools_show(struct seq_file *m, void *v)
+{
+	struct zcache_pool *zpool;
+	int i;
+
+	seq_printf(m, "%-4s %-24s %-8s %10s %10s %10s %10s %10s %10s %10s\n",
+		   "id", "sb", "zpool", "stored", "pool_pages", "stores",
+		   "hits", "misses", "evicts", "invalidate");
+
+	spin_lock(&zcache.pool_lock);
+	for (i = 0; i < MAX_ZCACHE_POOLS; i++) {
+		zpool = zcache.pools[i];
+		if (!zpool)
+			continue;
+
+		seq_printf(m,
+			"%-4d %-24s %-8s %10ld %10llu %10ld %10ld %10ld %10ld %10ld\n",
+			i, zpool->name[0] ? zpool->name : "-",
+			zpool_get_type(zpool->pool),
+			atomic_long_read(&zpool->nr_pages), zpool->size,
+			atomic_long_read(&zpool->stores),
+			atomic_long_read(&zpool->hits),
+			atomic_long_read(&zpool->misses),
+			atomic_long_read(&zpool->evicts),
+			atomic_long_read(&zpool->invalidates));
+	}
+	spin_unlock(&zcache.pool_lock);
+
+	return 0;
+}
+
+static int zcache_pools_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zcache_pools_show, NULL);
+}
+
+static const struct file_operations zcache_pools_fops = {
+	.open = zcache_pools_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static struct dentry *zcache_debugfs_root;
 
 static int __init zcache_debugfs_init(void)
@@ -1080,7 +1462,7 @@ static int __init zcache_debugfs_init(void)
 	debugfs_create_u64("pool_limit_hit", S_IRUGO, zcache_debugfs_root,
 			&zcache_pool_limit_hit);
 	debugfs_create_u64("reject_alloc_fail", S_IRUGO, zcache_debugfs_root,
-			&zcache_zbud_alloc_fail);
+			&zcache_zpool_alloc_fail);
 	debugfs_create_u64("duplicate_entry", S_IRUGO, zcache_debugfs_root,
 			&zcache_dup_entry);
 	debugfs_create_file("pool_pages", S_IRUGO, zcache_debugfs_root, NULL,
@@ -1105,6 +1487,10 @@ static int __init zcache_debugfs_init(void)
 			zcache_debugfs_root, &zcache_pool_shrink_pages);
 	debugfs_create_u64("store_fail", S_IRUGO,
 			zcache_debugfs_root, &zcache_store_failed);
+	debugfs_create_file("lru_age_ms", S_IRUGO, zcache_debugfs_root, NULL,
+			&lru_age_fops);
+	debugfs_create_file("pools", S_IRUGO, zcache_debugfs_root, NULL,
+			&zcache_pools_fops);
 	return 0;
 }
 
@@ -1136,6 +1522,11 @@ static int __init init_zcache(void)
 		goto error;
 	}
 
+	if (zcache_entry_cache_create()) {
+		pr_err("entry cache creation failed\n");
+		goto entryfail;
+	}
+
 	if (zcache_comp_init()) {
 		pr_err("compressor initialization failed\n");
 		goto compfail;
@@ -1145,6 +1536,7 @@ static int __init init_zcache(void)
 		goto pcpufail;
 	}
 
+	zcache_initialized = true;
 	spin_lock_init(&zcache.pool_lock);
 	cleancache_register_ops(&zcache_ops);
 
@@ -1155,6 +1547,8 @@ static int __init init_zcache(void)
 pcpufail:
 	zcache_comp_exit();
 compfail:
+	zcache_entry_cache_destroy();
+entryfail:
 	zcache_rbnode_cache_destroy();
 error:
 	return -ENOMEM;
@@ -1166,4 +1560,3 @@ late_initcall(init_zcache);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Bob Liu <bob.liu@xxxxxxxxxx>");
 MODULE_DESCRIPTION("Compressed cache for clean file pages");
-
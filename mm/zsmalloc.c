@@ -66,6 +66,9 @@
 #include <linux/spinlock.h>
 #include <linux/types.h>
 #include <linux/debugfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/mutex.h>
 #include <linux/zsmalloc.h>
 #include <linux/zpool.h>
 
@@ -173,14 +176,16 @@ enum zs_stat_type {
 	NR_ZS_STAT_TYPE,
 };
 
-#ifdef CONFIG_ZSMALLOC_STAT
-
-static struct dentry *zs_stat_root;
-
 struct zs_size_stat {
 	unsigned long objs[NR_ZS_STAT_TYPE];
 };
 
+#ifdef CONFIG_ZSMALLOC_STAT
+static struct dentry *zs_stat_root;
+
+/* zs_malloc() requests are counted in PAGE_SIZE / 32 sized buckets */
+#define ZS_SIZE_HIST_BUCKETS	32
+#define ZS_SIZE_HIST_SHIFT	(PAGE_SHIFT - 5)
 #endif
 
 /*
@@ -217,9 +222,11 @@ struct size_class {
 	/* huge object: pages_per_zspage == 1 && maxobj_per_zspage == 1 */
 	bool huge;
 
-#ifdef CONFIG_ZSMALLOC_STAT
 	struct zs_size_stat stats;
-#endif
+	/* number of times zs_compactd picked this class */
+	unsigned long compactd_runs;
+	/* pages freed by compacting this class */
+	unsigned long pages_compacted;
 
 	spinlock_t lock;
 
@@ -255,8 +262,17 @@ struct zs_pool {
 	gfp_t flags;	/* allocation flags used when growing pool */
 	atomic_long_t pages_allocated;
 
+	/* on zs_pool_list, protected by zs_pool_mutex */
+	struct list_head list;
+	/* set when a class crossed the fragmentation threshold */
+	atomic_t compact_pending;
+
+	/* objects of this size and above go to a page of their own */
+	size_t huge_class_size;
+
 #ifdef CONFIG_ZSMALLOC_STAT
 	struct dentry *stat_dentry;
+	atomic_long_t size_hist[ZS_SIZE_HIST_BUCKETS];
 #endif
 };
 
@@ -269,6 +285,29 @@ struct zs_pool {
 #define CLASS_IDX_MASK	((1 << CLASS_IDX_BITS) - 1)
 #define FULLNESS_MASK	((1 << FULLNESS_BITS) - 1)
 
+/*
+ * Background compaction: zs_free() wakes zs_compactd once the share of
+ * allocated but unused objects in a class reaches compact_frag_pct
+ * percent and at least one zspage could be freed by compacting it.
+ * The daemon then compacts the worst classes of the pool first.
+ * Setting compact_frag_pct to 0 leaves compaction to zs_compact().
+ */
+static unsigned int zs_compact_frag_pct = 30;
+module_param_named(compact_frag_pct, zs_compact_frag_pct, uint, 0644);
+MODULE_PARM_DESC(compact_frag_pct,
+	"Fragmentation percentage of a size class that triggers compaction");
+
+/* minimum delay between two zs_compactd passes */
+#define ZS_COMPACTD_INTERVAL	HZ
+
+static LIST_HEAD(zs_pool_list);
+static DEFINE_MUTEX(zs_pool_mutex);
+static struct task_struct *zs_compactd_task;
+/* classes compacted in the current pass, owned by zs_compactd */
+static unsigned long *zs_compactd_done;
+static DECLARE_WAIT_QUEUE_HEAD(zs_compactd_wait);
+static atomic_t zs_compactd_pending = ATOMIC_INIT(0);
+
 struct mapping_area {
 #ifdef CONFIG_PGTABLE_MAPPING
 	struct vm_struct *vm; /* vm area for mapping object that span pages */
@@ -449,7 +488,10 @@ static int get_size_class_index(int size)
 	return min(zs_size_classes - 1, idx);
 }
 
-#ifdef CONFIG_ZSMALLOC_STAT
+/*
+ * Class stats are always kept since background compaction relies on
+ * them, CONFIG_ZSMALLOC_STAT only controls the debugfs export.
+ */
 
 /* type can be of enum type zs_stat_type or fullness_group */
 static inline void zs_stat_inc(struct size_class *class,
@@ -472,6 +514,60 @@ static inline unsigned long zs_stat_get(struct size_class *class,
 	return class->stats.objs[type];
 }
 
+/*
+ * Number of pages compaction could free in this class, from the
+ * allocated but unused objects. Must be called with class->lock held.
+ */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_wasted;
+	unsigned long obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
+	unsigned long obj_used = zs_stat_get(class, OBJ_USED);
+
+	if (obj_allocated <= obj_used)
+		return 0;
+
+	obj_wasted = obj_allocated - obj_used;
+	obj_wasted /= get_maxobj_per_zspage(class->size,
+			class->pages_per_zspage);
+
+	return obj_wasted * class->pages_per_zspage;
+}
+
+/* fragmentation of the class in percent of its allocated objects */
+static unsigned int zs_frag_pct(struct size_class *class)
+{
+	unsigned long obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
+	unsigned long obj_used = zs_stat_get(class, OBJ_USED);
+
+	if (obj_allocated <= obj_used)
+		return 0;
+
+	return (obj_allocated - obj_used) * 100 / obj_allocated;
+}
+
+/* Must be called with class->lock held. */
+static bool zs_class_fragmented(struct size_class *class)
+{
+	unsigned int threshold = ACCESS_ONCE(zs_compact_frag_pct);
+
+	if (!threshold || !zs_can_compact(class))
+		return false;
+
+	return zs_frag_pct(class) >= threshold;
+}
+
+static void zs_compactd_wakeup(struct zs_pool *pool)
+{
+	if (atomic_cmpxchg(&pool->compact_pending, 0, 1))
+		return;
+
+	atomic_set(&zs_compactd_pending, 1);
+	wake_up(&zs_compactd_wait);
+}
+
+#ifdef CONFIG_ZSMALLOC_STAT
+
 static int __init zs_stat_init(void)
 {
 	if (!debugfs_initialized())
@@ -556,6 +652,115 @@ static const struct file_operations zs_stat_size_ops = {
 	.release        = single_release,
 };
 
+static int zs_stats_frag_show(struct seq_file *s, void *v)
+{
+	int i;
+	struct zs_pool *pool = s->private;
+	struct size_class *class;
+	unsigned long obj_allocated, obj_used, can_compact;
+	unsigned long compactd_runs, pages_compacted;
+	unsigned int frag;
+	unsigned long total_can_compact = 0, total_runs = 0;
+	unsigned long total_compacted = 0;
+
+	seq_printf(s, " %5s %5s %13s %10s %8s %12s %13s %15s\n",
+			"class", "size", "obj_allocated", "obj_used",
+			"frag_pct", "can_compact", "compactd_runs",
+			"pages_compacted");
+
+	for (i = 0; i < zs_size_classes; i++) {
+		class = pool->size_class[i];
+
+		if (class->index != i)
+			continue;
+
+		spin_lock(&class->lock);
+		obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
+		obj_used = zs_stat_get(class, OBJ_USED);
+		frag = zs_frag_pct(class);
+		can_compact = zs_can_compact(class);
+		compactd_runs = class->compactd_runs;
+		pages_compacted = class->pages_compacted;
+		spin_unlock(&class->lock);
+
+		seq_printf(s, " %5u %5u %13lu %10lu %8u %12lu %13lu %15lu\n",
+			i, class->size, obj_allocated, obj_used, frag,
+			can_compact, compactd_runs, pages_compacted);
+
+		total_can_compact += can_compact;
+		total_runs += compactd_runs;
+		total_compacted += pages_compacted;
+	}
+
+	seq_puts(s, "\n");
+	seq_printf(s, " %5s %5s %13s %10s %8s %12lu %13lu %15lu\n",
+			"Total", "", "", "", "", total_can_compact,
+			total_runs, total_compacted);
+
+	return 0;
+}
+
+static int zs_stats_frag_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_frag_show, inode->i_private);
+}
+
+static const struct file_operations zs_stat_frag_ops = {
+	.open           = zs_stats_frag_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
+static inline void zs_stat_hist_inc(struct zs_pool *pool, size_t size)
+{
+	atomic_long_inc(&pool->size_hist[(size - 1) >> ZS_SIZE_HIST_SHIFT]);
+}
+
+static int zs_stats_hist_show(struct seq_file *s, void *v)
+{
+	int i;
+	struct zs_pool *pool = s->private;
+	unsigned long count[ZS_SIZE_HIST_BUCKETS];
+	unsigned long total = 0;
+	unsigned long lo, hi;
+
+	for (i = 0; i < ZS_SIZE_HIST_BUCKETS; i++) {
+		count[i] = atomic_long_read(&pool->size_hist[i]);
+		total += count[i];
+	}
+
+	seq_printf(s, " %5s %5s %12s %7s %4s\n",
+			"from", "to", "allocations", "permill", "huge");
+
+	for (i = 0; i < ZS_SIZE_HIST_BUCKETS; i++) {
+		lo = (i << ZS_SIZE_HIST_SHIFT) + 1;
+		hi = (i + 1) << ZS_SIZE_HIST_SHIFT;
+
+		seq_printf(s, " %5lu %5lu %12lu %7lu %4s\n",
+			lo, hi, count[i],
+			total ? count[i] * 1000 / total : 0,
+			lo >= pool->huge_class_size ? "y" : "");
+	}
+
+	seq_puts(s, "\n");
+	seq_printf(s, " %5s %5s %12lu\n", "Total", "", total);
+
+	return 0;
+}
+
+static int zs_stats_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_hist_show, inode->i_private);
+}
+
+static const struct file_operations zs_stat_hist_ops = {
+	.open           = zs_stats_hist_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static int zs_pool_stat_create(char *name, struct zs_pool *pool)
 {
 	struct dentry *entry;
@@ -578,6 +783,22 @@ static int zs_pool_stat_create(char *name, struct zs_pool *pool)
 		return -ENOMEM;
 	}
 
+	entry = debugfs_create_file("fragmentation", S_IFREG | S_IRUGO,
+			pool->stat_dentry, pool, &zs_stat_frag_ops);
+	if (!entry) {
+		pr_warn("%s: debugfs file entry <%s> creation failed\n",
+				name, "fragmentation");
+		return -ENOMEM;
+	}
+
+	entry = debugfs_create_file("size_histogram", S_IFREG | S_IRUGO,
+			pool->stat_dentry, pool, &zs_stat_hist_ops);
+	if (!entry) {
+		pr_warn("%s: debugfs file entry <%s> creation failed\n",
+				name, "size_histogram");
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
@@ -588,22 +809,10 @@ static void zs_pool_stat_destroy(struct zs_pool *pool)
 
 #else /* CONFIG_ZSMALLOC_STAT */
 
-static inline void zs_stat_inc(struct size_class *class,
-				enum zs_stat_type type, unsigned long cnt)
+static inline void zs_stat_hist_inc(struct zs_pool *pool, size_t size)
 {
 }
 
-static inline void zs_stat_dec(struct size_class *class,
-				enum zs_stat_type type, unsigned long cnt)
-{
-}
-
-static inline unsigned long zs_stat_get(struct size_class *class,
-				enum zs_stat_type type)
-{
-	return 0;
-}
-
 static int __init zs_stat_init(void)
 {
 	return 0;
@@ -1247,6 +1456,22 @@ unsigned long zs_get_total_pages(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_get_total_pages);
 
+/**
+ * zs_huge_class_size() - Returns the size of the first huge object
+ * @pool: zsmalloc pool
+ *
+ * Objects of this size or bigger are stored in a zspage made of a
+ * single page, one object per page, with the handle kept in the page
+ * metadata instead of in front of the object. They take a whole page
+ * whatever their size, so users may prefer to store such data
+ * uncompressed.
+ */
+size_t zs_huge_class_size(struct zs_pool *pool)
+{
+	return pool->huge_class_size;
+}
+EXPORT_SYMBOL_GPL(zs_huge_class_size);
+
 /**
  * zs_map_object - get address of allocated object from handle.
  * @pool: pool from which the object was allocated
@@ -1400,6 +1625,8 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size)
 	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
 
+	zs_stat_hist_inc(pool, size);
+
 	handle = alloc_handle(pool);
 	if (!handle)
 		return 0;
@@ -1477,6 +1704,7 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	int class_idx;
 	struct size_class *class;
 	enum fullness_group fullness;
+	bool fragmented;
 
 	if (unlikely(!handle))
 		return;
@@ -1499,10 +1727,14 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 				&pool->pages_allocated);
 		free_zspage(first_page);
 	}
+	fragmented = zs_class_fragmented(class);
 	spin_unlock(&class->lock);
 	unpin_tag(handle);
 
 	free_handle(pool, handle);
+
+	if (fragmented)
+		zs_compactd_wakeup(pool);
 }
 EXPORT_SYMBOL_GPL(zs_free);
 
@@ -1702,6 +1934,7 @@ static void putback_zspage(struct zs_pool *pool, struct size_class *class,
 			class->size, class->pages_per_zspage));
 		atomic_long_sub(class->pages_per_zspage,
 				&pool->pages_allocated);
+		class->pages_compacted += class->pages_per_zspage;
 
 		free_zspage(first_page);
 	}
@@ -1790,6 +2023,84 @@ unsigned long zs_compact(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_compact);
 
+/*
+ * Compact the fragmented classes of @pool, the one with the most
+ * reclaimable pages first. @done marks the classes already compacted in
+ * this pass so that a class compaction can't improve isn't picked again.
+ */
+static void zs_compact_fragmented(struct zs_pool *pool, unsigned long *done)
+{
+	int i;
+	struct size_class *class, *worst;
+	unsigned long pages, max_pages;
+
+	bitmap_zero(done, zs_size_classes);
+
+	while (!kthread_should_stop()) {
+		worst = NULL;
+		max_pages = 0;
+
+		for (i = 0; i < zs_size_classes; i++) {
+			class = pool->size_class[i];
+			if (class->index != i || test_bit(i, done))
+				continue;
+
+			spin_lock(&class->lock);
+			pages = zs_class_fragmented(class) ?
+					zs_can_compact(class) : 0;
+			spin_unlock(&class->lock);
+
+			if (pages > max_pages) {
+				max_pages = pages;
+				worst = class;
+			}
+		}
+
+		if (!worst)
+			break;
+
+		set_bit(worst->index, done);
+		__zs_compact(pool, worst);
+
+		spin_lock(&worst->lock);
+		worst->compactd_runs++;
+		spin_unlock(&worst->lock);
+	}
+}
+
+static int zs_compactd(void *data)
+{
+	struct zs_pool *pool;
+	unsigned long *done = data;
+
+	/* Reclaiming wasted zspages is never urgent */
+	set_user_nice(current, MAX_NICE);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(zs_compactd_wait,
+				atomic_read(&zs_compactd_pending) ||
+				kthread_should_stop());
+
+		if (!atomic_xchg(&zs_compactd_pending, 0))
+			continue;
+
+		mutex_lock(&zs_pool_mutex);
+		list_for_each_entry(pool, &zs_pool_list, list) {
+			if (kthread_should_stop())
+				break;
+			if (atomic_xchg(&pool->compact_pending, 0))
+				zs_compact_fragmented(pool, done);
+		}
+		mutex_unlock(&zs_pool_mutex);
+
+		/* Let fragmentation build up again before the next pass */
+		schedule_timeout_interruptible(ZS_COMPACTD_INTERVAL);
+	}
+
+	return 0;
+}
+
 /**
  * zs_create_pool - Creates an allocation pool to work from.
  * @flags: allocation flags used to allocate pool metadata
@@ -1809,6 +2120,7 @@ struct zs_pool *zs_create_pool(char *name, gfp_t flags)
 	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
 	if (!pool)
 		return NULL;
+	INIT_LIST_HEAD(&pool->list);
 
 	pool->size_class = kcalloc(zs_size_classes, sizeof(struct size_class *),
 			GFP_KERNEL);
@@ -1870,11 +2182,30 @@ struct zs_pool *zs_create_pool(char *name, gfp_t flags)
 		prev_class = class;
 	}
 
+	/*
+	 * Size classes only get bigger and hold fewer objects per page
+	 * from here on, so everything that doesn't fit in the class below
+	 * the first huge one is stored in a huge class.
+	 */
+	for (i = 0; i < zs_size_classes; i++) {
+		if (pool->size_class[i]->huge)
+			break;
+	}
+	if (i == 0)
+		pool->huge_class_size = 1;
+	else
+		pool->huge_class_size = ZS_MIN_ALLOC_SIZE +
+			(i - 1) * ZS_SIZE_CLASS_DELTA - ZS_HANDLE_SIZE + 1;
+
 	pool->flags = flags;
 
 	if (zs_pool_stat_create(name, pool))
 		goto err;
 
+	mutex_lock(&zs_pool_mutex);
+	list_add(&pool->list, &zs_pool_list);
+	mutex_unlock(&zs_pool_mutex);
+
 	return pool;
 
 err:
@@ -1887,6 +2218,10 @@ void zs_destroy_pool(struct zs_pool *pool)
 {
 	int i;
 
+	mutex_lock(&zs_pool_mutex);
+	list_del(&pool->list);
+	mutex_unlock(&zs_pool_mutex);
+
 	zs_pool_stat_destroy(pool);
 
 	for (i = 0; i < zs_size_classes; i++) {
@@ -1915,6 +2250,33 @@ void zs_destroy_pool(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_destroy_pool);
 
+static void __init zs_compactd_start(void)
+{
+	zs_compactd_done = kcalloc(BITS_TO_LONGS(zs_size_classes),
+				sizeof(unsigned long), GFP_KERNEL);
+	if (!zs_compactd_done)
+		goto fail;
+
+	zs_compactd_task = kthread_run(zs_compactd, zs_compactd_done,
+					"zs_compactd");
+	if (!IS_ERR(zs_compactd_task))
+		return;
+
+	zs_compactd_task = NULL;
+	kfree(zs_compactd_done);
+	zs_compactd_done = NULL;
+fail:
+	/* zs_compact() still works, only the daemon is missing */
+	pr_warn("zs_compactd failed to start\n");
+}
+
+static void __exit zs_compactd_stop(void)
+{
+	if (zs_compactd_task)
+		kthread_stop(zs_compactd_task);
+	kfree(zs_compactd_done);
+}
+
 static int __init zs_init(void)
 {
 	int ret = zs_register_cpu_notifier();
@@ -1933,6 +2295,8 @@ static int __init zs_init(void)
 		pr_err("zs stat initialization failed\n");
 		goto stat_fail;
 	}
+
+	zs_compactd_start();
 	return 0;
 
 stat_fail:
@@ -1947,6 +2311,7 @@ notifier_fail:
 
 static void __exit zs_exit(void)
 {
+	zs_compactd_stop();
 #ifdef CONFIG_ZPOOL
 	zpool_unregister_driver(&zs_zpool_driver);
 #endif
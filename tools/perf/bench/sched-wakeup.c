@@ -0,0 +1,199 @@
+/*
+ * sched-wakeup.c
+ *
+ * wakeup: Benchmark for the scheduler wakeup path latency
+ *
+ * Pairs of threads ping-pong through private futexes. Before waking its
+ * partner each thread stamps the time, the partner computes the delay once
+ * it is running again. This is dominated by select_task_rq() and the
+ * enqueue/switch costs, so on energy aware kernels it can be compared with
+ * and without /sys/kernel/debug/sched_features ENERGY_CAP_LUT to measure
+ * the cost of the wakeup time energy estimation.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+struct wakeup_thread {
+	u_int32_t		futex;
+	u64			stamp;
+	struct wakeup_thread	*partner;
+	struct stats		latency;
+	pthread_t		pthread;
+	bool			waker;
+};
+
+#define LOOPS_DEFAULT 100000
+static int			loops = LOOPS_DEFAULT;
+static unsigned int		nr_pairs = 1;
+static unsigned int		busy_usecs;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop",	&loops,		"Specify number of wakeups per thread"),
+	OPT_UINTEGER('p', "pairs",	&nr_pairs,	"Specify number of waker/wakee pairs"),
+	OPT_UINTEGER('u', "busy",	&busy_usecs,	"Busy loop usecs before each wakeup, to build up utilization"),
+	OPT_END()
+};
+
+static const char * const bench_sched_wakeup_usage[] = {
+	"perf bench sched wakeup <options>",
+	NULL
+};
+
+static u64 wakeup_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void busy_loop(void)
+{
+	u64 end;
+
+	if (!busy_usecs)
+		return;
+
+	end = wakeup_now_ns() + busy_usecs * 1000ULL;
+	while (wakeup_now_ns() < end)
+		;
+}
+
+static void wakeup_partner(struct wakeup_thread *td)
+{
+	struct wakeup_thread *partner = td->partner;
+
+	busy_loop();
+	partner->stamp = wakeup_now_ns();
+	__sync_synchronize();
+	*(volatile u_int32_t *)&partner->futex = 1;
+	futex_wake(&partner->futex, 1, FUTEX_PRIVATE_FLAG);
+}
+
+static void wait_partner(struct wakeup_thread *td)
+{
+	while (!*(volatile u_int32_t *)&td->futex)
+		futex_wait(&td->futex, 0, NULL, FUTEX_PRIVATE_FLAG);
+	__sync_synchronize();
+
+	update_stats(&td->latency, wakeup_now_ns() - td->stamp);
+	td->futex = 0;
+}
+
+static void *worker_thread(void *__tdata)
+{
+	struct wakeup_thread *td = __tdata;
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		if (td->waker) {
+			wakeup_partner(td);
+			wait_partner(td);
+		} else {
+			wait_partner(td);
+			wakeup_partner(td);
+		}
+	}
+
+	return NULL;
+}
+
+int bench_sched_wakeup(int argc, const char **argv,
+		       const char *prefix __maybe_unused)
+{
+	struct wakeup_thread *threads, *td;
+	struct timespec start, stop;
+	struct stats latency;
+	unsigned int nr_threads, t;
+	double avg, total_sec;
+	u64 total_ns;
+	int ret;
+
+	argc = parse_options(argc, argv, options, bench_sched_wakeup_usage, 0);
+	if (argc || !nr_pairs || loops <= 0) {
+		usage_with_options(bench_sched_wakeup_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	nr_threads = nr_pairs * 2;
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		err(EXIT_FAILURE, "calloc");
+
+	for (t = 0; t < nr_threads; t++) {
+		td = threads + t;
+		td->waker = !(t & 1);
+		td->partner = threads + (t ^ 1);
+		init_stats(&td->latency);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (t = 0; t < nr_threads; t++) {
+		td = threads + t;
+		ret = pthread_create(&td->pthread, NULL, worker_thread, td);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	for (t = 0; t < nr_threads; t++) {
+		ret = pthread_join(threads[t].pthread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	total_ns = (stop.tv_sec - start.tv_sec) * 1000000000ULL +
+		   stop.tv_nsec - start.tv_nsec;
+	total_sec = total_ns / 1e9;
+
+	/* Merge the per-thread samples, each thread saw the same count */
+	init_stats(&latency);
+	avg = 0;
+	for (t = 0; t < nr_threads; t++) {
+		td = threads + t;
+		avg += avg_stats(&td->latency);
+		latency.min = min(latency.min, td->latency.min);
+		latency.max = max(latency.max, td->latency.max);
+	}
+	avg /= nr_threads;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %d wakeups in each of %u threads (%u pairs)\n\n",
+		       loops, nr_threads, nr_pairs);
+
+		printf(" %14s: %.3f [sec]\n\n", "Total time", total_sec);
+
+		printf(" %14.3f usecs/wakeup (avg)\n", avg / 1e3);
+		printf(" %14.3f usecs/wakeup (min)\n", latency.min / 1e3);
+		printf(" %14.3f usecs/wakeup (max)\n", latency.max / 1e3);
+		printf(" %14d wakeups/sec\n",
+		       (int)((double)loops * nr_threads / total_sec));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3f\n", avg / 1e3);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(threads);
+	return 0;
+}
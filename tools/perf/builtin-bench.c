@@ -44,6 +44,7 @@ static struct bench numa_benchmarks[] = {
 static struct bench sched_benchmarks[] = {
 	{ "messaging",	"Benchmark for scheduling and IPC",		bench_sched_messaging	},
 	{ "pipe",	"Benchmark for pipe() between two processes",	bench_sched_pipe	},
+	{ "wakeup",	"Benchmark for wakeup path latency",		bench_sched_wakeup	},
 	{ "all",	"Test all scheduler benchmarks",		NULL			},
 	{ NULL,		NULL,						NULL			}
 };
@@ -0,0 +1,92 @@
+/*
+ * ION alloc/free throughput against the number of concurrent threads.
+ *
+ * Uses the ion-test device to run alloc/free pairs from 1 up to the
+ * number of online CPUs kernel threads and reports the aggregate
+ * allocation rate for each thread count. With per-CPU page pool
+ * magazines the rate should scale with the number of threads.
+ *
+ * usage: ion_alloc_bench [-h heap_id] [-s size] [-n iterations] [-f flags]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "ion_test.h"
+
+#define ION_TEST_DEV	"/dev/ion-test"
+/* ION_SYSTEM_HEAP_ID on msm */
+#define DEFAULT_HEAP_ID	25
+
+int main(int argc, char **argv)
+{
+	struct ion_test_alloc_bench bench;
+	unsigned int heap_id = DEFAULT_HEAP_ID;
+	unsigned long long size = 64 * 1024;
+	unsigned int iterations = 10000;
+	unsigned int flags = 0;
+	long ncpus, threads;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "h:s:n:f:")) != -1) {
+		switch (opt) {
+		case 'h':
+			heap_id = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoull(optarg, NULL, 0);
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			flags = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-h heap_id] [-s size] "
+				"[-n iterations] [-f flags]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	fd = open(ION_TEST_DEV, O_RDWR);
+	if (fd < 0) {
+		printf("%s: %s is not available, skipping\n", argv[0],
+		       ION_TEST_DEV);
+		return 0;
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	printf("ion: heap %u, size %llu, flags 0x%x, %u alloc/free per thread\n",
+	       heap_id, size, flags, iterations);
+	printf("%8s %14s %14s\n", "threads", "usecs", "allocs/s");
+
+	for (threads = 1; threads <= ncpus; threads++) {
+		memset(&bench, 0, sizeof(bench));
+		bench.size = size;
+		bench.heap_id_mask = 1u << heap_id;
+		bench.flags = flags;
+		bench.nr_threads = threads;
+		bench.nr_iterations = iterations;
+
+		if (ioctl(fd, ION_IOC_TEST_ALLOC_BENCH, &bench) < 0) {
+			printf("%s: alloc bench with %ld threads failed: %s\n",
+			       argv[0], threads, strerror(errno));
+			close(fd);
+			return 1;
+		}
+
+		printf("%8ld %14llu %14llu\n", threads,
+		       (unsigned long long)bench.elapsed_ns / 1000,
+		       bench.elapsed_ns ? (unsigned long long)threads *
+		       iterations * 1000000000ULL / bench.elapsed_ns : 0);
+	}
+
+	close(fd);
+	return 0;
+}
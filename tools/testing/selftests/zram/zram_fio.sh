@@ -0,0 +1,102 @@
+#!/bin/bash
+# Benchmark /dev/zram0 with fio, please run as root.
+#
+# Writes the device with an increasing number of concurrent fio jobs,
+# from one up to the number of online CPUs, and reports the aggregate
+# bandwidth for each job count. Per-CPU compression streams should make
+# the bandwidth scale with the number of writers.
+#
+# Then fills the device once and reports read latency for single 4k
+# pages, for 32k requests, which zram still reads synchronously, and for
+# 64k and 256k requests, which it decompresses in parallel batches.
+#
+# usage: zram_fio.sh [-s disksize] [-t runtime] [-a algorithm]
+
+dev=zram0
+disksize=256M
+runtime=10
+algo=lz4
+
+while getopts "s:t:a:" opt; do
+	case $opt in
+	s) disksize=$OPTARG ;;
+	t) runtime=$OPTARG ;;
+	a) algo=$OPTARG ;;
+	*) echo "usage: $0 [-s disksize] [-t runtime] [-a algorithm]"
+	   exit 1 ;;
+	esac
+done
+
+if [ $UID != 0 ]; then
+	echo "$0: must be run as root, skipping"
+	exit 0
+fi
+
+if ! which fio > /dev/null 2>&1; then
+	echo "$0: fio is not available, skipping"
+	exit 0
+fi
+
+if [ ! -b /dev/$dev ]; then
+	modprobe zram num_devices=1 > /dev/null 2>&1
+	if [ ! -b /dev/$dev ]; then
+		echo "$0: /dev/$dev is not available, skipping"
+		exit 0
+	fi
+fi
+
+sysfs=/sys/block/$dev
+
+zram_setup()
+{
+	echo 1 > $sysfs/reset || return 1
+	echo $algo > $sysfs/comp_algorithm 2> /dev/null
+	echo $disksize > $sysfs/disksize || return 1
+}
+
+# fio_bw <rw> <numjobs>: print aggregate bandwidth in KB/s
+fio_bw()
+{
+	fio --name=zram --filename=/dev/$dev --direct=1 --ioengine=psync \
+		--bs=4k --rw=$1 --numjobs=$2 --size=$disksize \
+		--buffer_compress_percentage=50 --refill_buffers \
+		--time_based --runtime=$runtime --group_reporting \
+		--minimal | awk -F ';' '{ print $7 + $48 }'
+}
+
+# fio_lat <rw> <bs>: print mean and 99th percentile read latency in usec
+fio_lat()
+{
+	fio --name=zram --filename=/dev/$dev --direct=1 --ioengine=psync \
+		--bs=$2 --rw=$1 --numjobs=1 --size=$disksize \
+		--time_based --runtime=$runtime --minimal | \
+		awk -F ';' '{ split($30, p99, "="); printf "%d %d", $40, p99[2] }'
+}
+
+ret=0
+ncpus=$(grep -c ^processor /proc/cpuinfo)
+
+echo "zram: $algo, disksize $disksize, ${runtime}s per run"
+printf "%8s %16s\n" "writers" "write KB/s"
+for jobs in $(seq 1 $ncpus); do
+	if ! zram_setup; then
+		echo "zram: failed to set up /dev/$dev"
+		ret=1
+		break
+	fi
+	printf "%8d %16s\n" $jobs "$(fio_bw randwrite $jobs)"
+done
+
+if [ $ret = 0 ] && zram_setup; then
+	fio --name=fill --filename=/dev/$dev --direct=1 --bs=64k --rw=write \
+		--size=$disksize --buffer_compress_percentage=50 \
+		--refill_buffers > /dev/null
+	printf "%8s %6s %12s %12s\n" "read" "bs" "mean usec" "p99 usec"
+	for run in "randread 4k" "read 32k" "read 64k" "read 256k"; do
+		set -- $run
+		printf "%8s %6s %12s %12s\n" $1 $2 $(fio_lat $1 $2)
+	done
+fi
+
+echo 1 > $sysfs/reset
+exit $ret